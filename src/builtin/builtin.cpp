@@ -1,7 +1,9 @@
 module;
 
+#include <array>
 #include <span>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <utility>
 
@@ -11,17 +13,82 @@ import hsh.context;
 
 namespace hsh::builtin {
 
+namespace {
+
+struct Entry {
+  std::string_view name_;
+  BuiltinFunction  function_;
+};
+
+// Every function next to its name, in the order of NAMES
+constexpr std::array<Entry, NAMES.size()> FUNCTIONS{{
+    {"[",      builtin_bracket},
+    {"bg",     builtin_bg},
+    {"cd",     builtin_cd},
+    {"echo",   builtin_echo},
+    {"exec",   builtin_exec},
+    {"exit",   builtin_exit},
+    {"export", builtin_export},
+    {"fg",     builtin_fg},
+    {"jobs",   builtin_jobs},
+    {"local",  builtin_local},
+    {"printf", builtin_printf},
+    {"pwd",    builtin_pwd},
+    {"read",   builtin_read},
+    {"return", builtin_return},
+    {"set",    builtin_set},
+    {"shift",  builtin_shift},
+    {"test",   builtin_test},
+    {"times",  builtin_times},
+    {"wait",   builtin_wait},
+}};
+
+static_assert(
+    [] {
+      for (size_t i = 0; i < NAMES.size(); ++i) {
+        if (FUNCTIONS[i].name_ != NAMES[i]) {
+          return false;
+        }
+      }
+      return true;
+    }(),
+    "FUNCTIONS must list the builtins in the order of NAMES"
+);
+
+} // namespace
+
 auto Registry::instance() -> Registry& {
   static Registry instance;
   return instance;
 }
 
-auto Registry::register_builtin(std::string const& name, BuiltinFunction func) -> void {
-  builtins_[name] = std::move(func);
+auto Registry::get(BuiltinIndex index) noexcept -> Handle {
+  return index < FUNCTIONS.size() ? Handle{FUNCTIONS[index].function_} : Handle{};
+}
+
+auto Registry::find(std::string_view name) const -> Handle {
+  if (auto index = find_builtin(name); index != NOT_BUILTIN) {
+    return get(index);
+  }
+  if (dynamic_.empty()) {
+    return {};
+  }
+  if (auto it = dynamic_.find(std::string(name)); it != dynamic_.end()) {
+    return Handle{&it->second};
+  }
+  return {};
+}
+
+auto Registry::register_builtin(std::string const& name, DynamicBuiltin func) -> void {
+  dynamic_[name] = std::move(func);
+}
+
+auto Registry::unregister_builtin(std::string const& name) -> void {
+  dynamic_.erase(name);
 }
 
 auto Registry::is_builtin(std::string const& name) const -> bool {
-  return builtins_.contains(name);
+  return static_cast<bool>(find(name));
 }
 
 auto Registry::execute_builtin(
@@ -30,25 +97,10 @@ auto Registry::execute_builtin(
     context::Context&            context,
     job::JobManager&             job_manager
 ) const -> int {
-  if (auto it = builtins_.find(name); it != builtins_.end()) {
-    return it->second(args, context, job_manager);
+  if (auto builtin = find(name)) {
+    return builtin(args, context, job_manager);
   }
   return 127;
 }
 
-auto register_all_builtins() -> void {
-  auto& registry = Registry::instance();
-
-  registry.register_builtin("cd", builtin_cd);
-  registry.register_builtin("echo", builtin_echo);
-  registry.register_builtin("pwd", builtin_pwd);
-  registry.register_builtin("export", builtin_export);
-  registry.register_builtin("exit", builtin_exit);
-  registry.register_builtin("jobs", builtin_jobs);
-  registry.register_builtin("fg", builtin_fg);
-  registry.register_builtin("bg", builtin_bg);
-  // registry.register_builtin("unset", unset);
-  // registry.register_builtin("source", source);
-}
-
 } // namespace hsh::builtin
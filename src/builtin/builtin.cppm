@@ -3,23 +3,59 @@ module;
 #include <functional>
 #include <span>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 
 export module hsh.builtin;
 
+export import hsh.builtin.condition;
+export import hsh.builtin.table;
+
 import hsh.context;
+import hsh.core;
 import hsh.job;
 
 export namespace hsh::builtin {
 
-using BuiltinFunction = std::
+using BuiltinFunction =
+    int (*)(std::span<std::string const> args, context::Context& context, job::JobManager& job_manager);
+using DynamicBuiltin = std::
     function<int(std::span<std::string const> args, context::Context& context, job::JobManager& job_manager)>;
 
+// A resolved builtin, calling it does not look the name up again. Empty if the name is not a builtin.
+class Handle {
+  BuiltinFunction       function_ = nullptr;
+  DynamicBuiltin const* dynamic_  = nullptr;
+
+public:
+  Handle() = default;
+  explicit Handle(BuiltinFunction function) noexcept : function_(function) {}
+  explicit Handle(DynamicBuiltin const* dynamic) noexcept : dynamic_(dynamic) {}
+
+  explicit operator bool() const noexcept {
+    return function_ != nullptr || dynamic_ != nullptr;
+  }
+  [[nodiscard]] auto is(BuiltinFunction function) const noexcept -> bool {
+    return function_ == function;
+  }
+
+  auto operator()(std::span<std::string const> args, context::Context& context, job::JobManager& job_manager) const
+      -> int {
+    return function_ != nullptr ? function_(args, context, job_manager) : (*dynamic_)(args, context, job_manager);
+  }
+};
+
+// Compiled-in builtins come from the constant table in hsh.builtin.table. Builtins registered at runtime are kept in a
+// slower secondary table and never shadow a compiled-in one.
 class Registry {
 public:
   static auto instance() -> Registry&;
 
-  auto register_builtin(std::string const& name, BuiltinFunction func) -> void;
+  static auto get(BuiltinIndex index) noexcept -> Handle;
+  auto        find(std::string_view name) const -> Handle;
+
+  auto register_builtin(std::string const& name, DynamicBuiltin func) -> void;
+  auto unregister_builtin(std::string const& name) -> void;
   auto is_builtin(std::string const& name) const -> bool;
   auto execute_builtin(
       std::string const&           name,
@@ -29,18 +65,31 @@ public:
   ) const -> int;
 
 private:
-  std::unordered_map<std::string, BuiltinFunction> builtins_;
+  std::unordered_map<std::string, DynamicBuiltin> dynamic_;
 };
 
-auto register_all_builtins() -> void;
-
 auto builtin_cd(std::span<std::string const> args, context::Context& context, job::JobManager& job_manager) -> int;
 auto builtin_pwd(std::span<std::string const> args, context::Context& context, job::JobManager& job_manager) -> int;
 auto builtin_echo(std::span<std::string const> args, context::Context& context, job::JobManager& job_manager) -> int;
+auto builtin_exec(std::span<std::string const> args, context::Context& context, job::JobManager& job_manager) -> int;
 auto builtin_export(std::span<std::string const> args, context::Context& context, job::JobManager& job_manager) -> int;
 auto builtin_exit(std::span<std::string const> args, context::Context& context, job::JobManager& job_manager) -> int;
 auto builtin_jobs(std::span<std::string const> args, context::Context& context, job::JobManager& job_manager) -> int;
 auto builtin_fg(std::span<std::string const> args, context::Context& context, job::JobManager& job_manager) -> int;
 auto builtin_bg(std::span<std::string const> args, context::Context& context, job::JobManager& job_manager) -> int;
+auto builtin_local(std::span<std::string const> args, context::Context& context, job::JobManager& job_manager) -> int;
+auto builtin_printf(std::span<std::string const> args, context::Context& context, job::JobManager& job_manager) -> int;
+auto builtin_read(std::span<std::string const> args, context::Context& context, job::JobManager& job_manager) -> int;
+auto builtin_return(std::span<std::string const> args, context::Context& context, job::JobManager& job_manager) -> int;
+auto builtin_set(std::span<std::string const> args, context::Context& context, job::JobManager& job_manager) -> int;
+auto builtin_shift(std::span<std::string const> args, context::Context& context, job::JobManager& job_manager) -> int;
+auto builtin_test(std::span<std::string const> args, context::Context& context, job::JobManager& job_manager) -> int;
+auto builtin_bracket(std::span<std::string const> args, context::Context& context, job::JobManager& job_manager) -> int;
+auto builtin_times(std::span<std::string const> args, context::Context& context, job::JobManager& job_manager) -> int;
+auto builtin_wait(std::span<std::string const> args, context::Context& context, job::JobManager& job_manager) -> int;
+
+// Replaces the shell with the command in argv, as `exec` does. Only returns if that failed.
+auto replace_shell(std::span<std::string const> argv, std::string_view search_path, char* const* env)
+    -> core::syscall::Result<void>;
 
 } // namespace hsh::builtin
@@ -1,11 +1,8 @@
 module;
 
 #include <cstring>
-#include <print>
 #include <string>
 
-#include <unistd.h>
-
 module hsh.builtin;
 
 import hsh.core;
@@ -20,26 +17,26 @@ auto builtin_cd(std::span<std::string const> args, context::Context& context, jo
     if (auto home = context.get_variable("HOME")) {
       target_dir = std::string{home.value()};
     } else {
-      std::println(stderr, "cd: HOME not set");
+      core::standard_error().println("cd: HOME not set");
       return 1;
     }
   } else if (args.size() == 1) {
     if (args[0] == "-") {
       if (auto oldpwd = context.get_variable("OLDPWD")) {
         target_dir = std::string{oldpwd.value()};
-        if (auto result = core::syscall::write_fd(STDOUT_FILENO, target_dir); !result) {
-          std::println(stderr, "cd: write error: {}", std::strerror(result.error()));
+        if (auto result = core::standard_output().write(target_dir); !result) {
+          core::standard_error().println("cd: write error: {}", std::strerror(result.error()));
           return 1;
         }
       } else {
-        std::println(stderr, "cd: OLDPWD not set");
+        core::standard_error().println("cd: OLDPWD not set");
         return 1;
       }
     } else {
       target_dir = args[0];
     }
   } else {
-    std::println(stderr, "cd: too many arguments");
+    core::standard_error().println("cd: too many arguments");
     return 1;
   }
 
@@ -49,7 +46,7 @@ auto builtin_cd(std::span<std::string const> args, context::Context& context, jo
     context.set_variable("OLDPWD", current_dir);
     return 0;
   }
-  std::println(stderr, "cd: {}: No such file or directory", target_dir);
+  core::standard_error().println("cd: {}: No such file or directory", target_dir);
   return 1;
 }
 
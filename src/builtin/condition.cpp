@@ -0,0 +1,299 @@
+module;
+
+#include <array>
+#include <charconv>
+#include <expected>
+#include <format>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <regex.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+module hsh.builtin.condition;
+
+import hsh.core;
+import hsh.context;
+
+namespace hsh::builtin {
+
+namespace {
+
+// Regexes stay cached until there are this many, then the cache starts over
+constexpr size_t MAX_CACHED_REGEXES = 64;
+
+constexpr std::array<std::pair<std::string_view, TestOperator>, 23> UNARY_OPERATORS{{
+    {"-e", TestOperator::Exists},
+    {"-a", TestOperator::Exists},
+    {"-f", TestOperator::Regular},
+    {"-d", TestOperator::Directory},
+    {"-L", TestOperator::Symlink},
+    {"-h", TestOperator::Symlink},
+    {"-b", TestOperator::BlockDevice},
+    {"-c", TestOperator::CharDevice},
+    {"-p", TestOperator::Fifo},
+    {"-S", TestOperator::Socket},
+    {"-s", TestOperator::NonEmptyFile},
+    {"-u", TestOperator::SetUid},
+    {"-g", TestOperator::SetGid},
+    {"-k", TestOperator::Sticky},
+    {"-O", TestOperator::Owned},
+    {"-G", TestOperator::GroupOwned},
+    {"-r", TestOperator::Readable},
+    {"-w", TestOperator::Writable},
+    {"-x", TestOperator::Executable},
+    {"-t", TestOperator::Terminal},
+    {"-z", TestOperator::EmptyString},
+    {"-n", TestOperator::NonEmptyString},
+    {"-v", TestOperator::VariableSet},
+}};
+
+constexpr std::array<std::pair<std::string_view, TestOperator>, 15> BINARY_OPERATORS{{
+    {"=", TestOperator::StringEqual},
+    {"==", TestOperator::StringEqual},
+    {"!=", TestOperator::StringNotEqual},
+    {"<", TestOperator::StringLess},
+    {">", TestOperator::StringGreater},
+    {"-eq", TestOperator::Equal},
+    {"-ne", TestOperator::NotEqual},
+    {"-lt", TestOperator::Less},
+    {"-le", TestOperator::LessEqual},
+    {"-gt", TestOperator::Greater},
+    {"-ge", TestOperator::GreaterEqual},
+    {"-nt", TestOperator::NewerThan},
+    {"-ot", TestOperator::OlderThan},
+    {"-ef", TestOperator::SameFile},
+    {"=~", TestOperator::Matches},
+}};
+
+template<size_t N>
+constexpr auto find_operator(
+    std::array<std::pair<std::string_view, TestOperator>, N> const& operators,
+    std::string_view                                                text
+) -> std::optional<TestOperator> {
+  for (auto const& [name, op] : operators) {
+    if (name == text) {
+      return op;
+    }
+  }
+  return std::nullopt;
+}
+
+auto parse_integer(std::string_view text) -> core::Result<long long> {
+  auto trimmed = text;
+  while (!trimmed.empty() && core::locale::is_space(trimmed.front())) {
+    trimmed.remove_prefix(1);
+  }
+  while (!trimmed.empty() && core::locale::is_space(trimmed.back())) {
+    trimmed.remove_suffix(1);
+  }
+  if (trimmed.starts_with('+')) {
+    trimmed.remove_prefix(1);
+  }
+
+  long long value = 0;
+  auto [ptr, ec]  = std::from_chars(trimmed.data(), trimmed.data() + trimmed.size(), value);
+  if (trimmed.empty() || ec != std::errc{} || ptr != trimmed.data() + trimmed.size()) {
+    return std::unexpected(std::format("{}: integer expression expected", text));
+  }
+  return value;
+}
+
+constexpr auto newer(struct stat const& left, struct stat const& right) noexcept -> bool {
+  if (left.st_mtim.tv_sec != right.st_mtim.tv_sec) {
+    return left.st_mtim.tv_sec > right.st_mtim.tv_sec;
+  }
+  return left.st_mtim.tv_nsec > right.st_mtim.tv_nsec;
+}
+
+struct CompiledRegex {
+  regex_t     regex_{};
+  int         error_ = 0; // regcomp status, regex_ is only usable if this is 0
+  std::string message_;
+
+  CompiledRegex()                     = default;
+  CompiledRegex(CompiledRegex const&) = delete;
+  auto operator=(CompiledRegex const&) -> CompiledRegex& = delete;
+  ~CompiledRegex() {
+    if (error_ == 0) {
+      regfree(&regex_);
+    }
+  }
+};
+
+auto compiled_regex(std::string_view pattern) -> CompiledRegex const& {
+  static core::FlatMap<std::unique_ptr<CompiledRegex>> cache;
+  if (auto const* compiled = cache.get(pattern)) {
+    return **compiled;
+  }
+  if (cache.size() >= MAX_CACHED_REGEXES) {
+    cache.clear();
+  }
+
+  auto compiled    = std::make_unique<CompiledRegex>();
+  compiled->error_ = regcomp(&compiled->regex_, std::string(pattern).c_str(), REG_EXTENDED);
+  if (compiled->error_ != 0) {
+    std::array<char, 256> buffer{};
+    regerror(compiled->error_, &compiled->regex_, buffer.data(), buffer.size());
+    compiled->message_ = buffer.data();
+  }
+  return *cache.insert_or_assign(pattern, std::move(compiled));
+}
+
+} // namespace
+
+auto find_unary_operator(std::string_view text) noexcept -> std::optional<TestOperator> {
+  return find_operator(UNARY_OPERATORS, text);
+}
+
+auto find_binary_operator(std::string_view text) noexcept -> std::optional<TestOperator> {
+  return find_operator(BINARY_OPERATORS, text);
+}
+
+auto StatCache::get(std::string_view path, bool follow) -> struct stat const* {
+  for (auto& entry : entries_) {
+    if (entry && entry->follow_ == follow && entry->path_ == path) {
+      return entry->found_ ? &entry->status_ : nullptr;
+    }
+  }
+
+  auto& entry = entries_[next_];
+  next_       = (next_ + 1) % entries_.size();
+  entry       = Entry{std::string(path), follow};
+
+  char const* name = entry->path_.c_str();
+  entry->found_    = (follow ? ::stat(name, &entry->status_) : ::lstat(name, &entry->status_)) == 0;
+  return entry->found_ ? &entry->status_ : nullptr;
+}
+
+auto test_unary(TestOperator op, std::string_view operand, StatCache& cache, context::Context& context) -> bool {
+  auto has_type = [&](mode_t type) {
+    auto const* status = cache.get(operand);
+    return status != nullptr && (status->st_mode & S_IFMT) == type;
+  };
+  auto has_mode = [&](mode_t bits) {
+    auto const* status = cache.get(operand);
+    return status != nullptr && (status->st_mode & bits) != 0;
+  };
+  auto accessible = [&](int mode) {
+    return ::access(std::string(operand).c_str(), mode) == 0;
+  };
+
+  switch (op) {
+    case TestOperator::Exists: return cache.get(operand) != nullptr;
+    case TestOperator::Regular: return has_type(S_IFREG);
+    case TestOperator::Directory: return has_type(S_IFDIR);
+    case TestOperator::BlockDevice: return has_type(S_IFBLK);
+    case TestOperator::CharDevice: return has_type(S_IFCHR);
+    case TestOperator::Fifo: return has_type(S_IFIFO);
+    case TestOperator::Socket: return has_type(S_IFSOCK);
+    case TestOperator::Symlink: {
+      auto const* status = cache.get(operand, false);
+      return status != nullptr && S_ISLNK(status->st_mode);
+    }
+    case TestOperator::NonEmptyFile: {
+      auto const* status = cache.get(operand);
+      return status != nullptr && status->st_size > 0;
+    }
+    case TestOperator::SetUid: return has_mode(S_ISUID);
+    case TestOperator::SetGid: return has_mode(S_ISGID);
+    case TestOperator::Sticky: return has_mode(S_ISVTX);
+    case TestOperator::Owned: {
+      auto const* status = cache.get(operand);
+      return status != nullptr && status->st_uid == ::geteuid();
+    }
+    case TestOperator::GroupOwned: {
+      auto const* status = cache.get(operand);
+      return status != nullptr && status->st_gid == ::getegid();
+    }
+    case TestOperator::Readable: return accessible(R_OK);
+    case TestOperator::Writable: return accessible(W_OK);
+    case TestOperator::Executable: return accessible(X_OK);
+    case TestOperator::Terminal: {
+      auto fd = parse_integer(operand);
+      return fd && ::isatty(static_cast<int>(*fd)) == 1;
+    }
+    case TestOperator::EmptyString: return operand.empty();
+    case TestOperator::NonEmptyString: return !operand.empty();
+    case TestOperator::VariableSet: return context.get_variable(operand).has_value();
+    default: return false;
+  }
+}
+
+auto test_binary(TestOperator op, std::string_view left, std::string_view right, StatCache& cache)
+    -> core::Result<bool> {
+  switch (op) {
+    case TestOperator::StringEqual: return left == right;
+    case TestOperator::StringNotEqual: return left != right;
+    case TestOperator::StringLess: return left < right;
+    case TestOperator::StringGreater: return left > right;
+    case TestOperator::NewerThan: {
+      auto const* left_status  = cache.get(left);
+      auto const* right_status = cache.get(right);
+      return left_status != nullptr && (right_status == nullptr || newer(*left_status, *right_status));
+    }
+    case TestOperator::OlderThan: {
+      auto const* left_status  = cache.get(left);
+      auto const* right_status = cache.get(right);
+      return right_status != nullptr && (left_status == nullptr || newer(*right_status, *left_status));
+    }
+    case TestOperator::SameFile: {
+      auto const* left_status  = cache.get(left);
+      auto const* right_status = cache.get(right);
+      return left_status != nullptr && right_status != nullptr && left_status->st_dev == right_status->st_dev &&
+             left_status->st_ino == right_status->st_ino;
+    }
+    default: break;
+  }
+
+  auto left_value = parse_integer(left);
+  if (!left_value) {
+    return std::unexpected(left_value.error());
+  }
+  auto right_value = parse_integer(right);
+  if (!right_value) {
+    return std::unexpected(right_value.error());
+  }
+
+  switch (op) {
+    case TestOperator::Equal: return *left_value == *right_value;
+    case TestOperator::NotEqual: return *left_value != *right_value;
+    case TestOperator::Less: return *left_value < *right_value;
+    case TestOperator::LessEqual: return *left_value <= *right_value;
+    case TestOperator::Greater: return *left_value > *right_value;
+    case TestOperator::GreaterEqual: return *left_value >= *right_value;
+    default: return std::unexpected(std::string("unknown binary operator"));
+  }
+}
+
+auto match_regex(std::string_view pattern, std::string_view text, std::vector<std::string>& groups)
+    -> core::Result<bool> {
+  auto const& compiled = compiled_regex(pattern);
+  if (compiled.error_ != 0) {
+    return std::unexpected(std::format("{}: {}", pattern, compiled.message_));
+  }
+
+  std::string             subject(text);
+  std::vector<regmatch_t> matches(compiled.regex_.re_nsub + 1);
+  if (regexec(&compiled.regex_, subject.c_str(), matches.size(), matches.data(), 0) != 0) {
+    return false;
+  }
+
+  groups.clear();
+  for (auto const& match : matches) {
+    if (match.rm_so < 0) {
+      groups.emplace_back();
+    } else {
+      auto offset = static_cast<size_t>(match.rm_so);
+      groups.push_back(subject.substr(offset, static_cast<size_t>(match.rm_eo) - offset));
+    }
+  }
+  return true;
+}
+
+} // namespace hsh::builtin
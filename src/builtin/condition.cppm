@@ -0,0 +1,92 @@
+module;
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/stat.h>
+
+export module hsh.builtin.condition;
+
+import hsh.core;
+import hsh.context;
+
+export namespace hsh::builtin {
+
+// Primaries shared by test, [ and [[
+enum struct TestOperator : std::uint8_t {
+  // Unary
+  Exists,         // -e, -a
+  Regular,        // -f
+  Directory,      // -d
+  Symlink,        // -L, -h
+  BlockDevice,    // -b
+  CharDevice,     // -c
+  Fifo,           // -p
+  Socket,         // -S
+  NonEmptyFile,   // -s
+  SetUid,         // -u
+  SetGid,         // -g
+  Sticky,         // -k
+  Owned,          // -O
+  GroupOwned,     // -G
+  Readable,       // -r
+  Writable,       // -w
+  Executable,     // -x
+  Terminal,       // -t
+  EmptyString,    // -z
+  NonEmptyString, // -n
+  VariableSet,    // -v
+
+  // Binary
+  StringEqual,    // =, ==
+  StringNotEqual, // !=
+  StringLess,     // <
+  StringGreater,  // >
+  Equal,          // -eq
+  NotEqual,       // -ne
+  Less,           // -lt
+  LessEqual,      // -le
+  Greater,        // -gt
+  GreaterEqual,   // -ge
+  NewerThan,      // -nt
+  OlderThan,      // -ot
+  SameFile,       // -ef
+  Matches,        // =~, only in [[ ]]
+};
+
+[[nodiscard]] auto find_unary_operator(std::string_view text) noexcept -> std::optional<TestOperator>;
+[[nodiscard]] auto find_binary_operator(std::string_view text) noexcept -> std::optional<TestOperator>;
+
+// The last paths stat'ed while one expression is evaluated, so `-f x -a -r x` costs a single stat
+class StatCache {
+  struct Entry {
+    std::string path_;
+    bool        follow_ = true;
+    bool        found_  = false;
+    struct stat status_{};
+  };
+
+  std::array<std::optional<Entry>, 2> entries_;
+  size_t                              next_ = 0;
+
+public:
+  // nullptr if the path does not exist, lstat is used unless follow is set
+  [[nodiscard]] auto get(std::string_view path, bool follow = true) -> struct stat const*;
+};
+
+[[nodiscard]] auto test_unary(TestOperator op, std::string_view operand, StatCache& cache, context::Context& context)
+    -> bool;
+// Fails if an integer comparison is given something that is not an integer
+[[nodiscard]] auto test_binary(TestOperator op, std::string_view left, std::string_view right, StatCache& cache)
+    -> core::Result<bool>;
+
+// Matches text against an extended regular expression. Compiled patterns are cached, groups receives the whole match
+// followed by every subexpression.
+[[nodiscard]] auto match_regex(std::string_view pattern, std::string_view text, std::vector<std::string>& groups)
+    -> core::Result<bool>;
+
+} // namespace hsh::builtin
@@ -2,12 +2,9 @@ module;
 
 #include <cstring>
 #include <format>
-#include <print>
 #include <span>
 #include <string>
 
-#include <unistd.h>
-
 module hsh.builtin;
 
 import hsh.context;
@@ -24,11 +21,11 @@ auto builtin_echo(std::span<std::string const> args, context::Context&, job::Job
     start_idx = 1;
   }
 
-  std::string output = std::
-      format("{}{}", core::util::join(args.begin() + static_cast<long>(start_idx), args.end()), newline ? "\n" : "");
-
-  if (auto result = core::syscall::write_fd(STDOUT_FILENO, output); !result) {
-    std::println(stderr, "echo: write error: {}", std::strerror(result.error()));
+  // Formatted straight into the shell's output buffer, without a string of its own
+  auto words  = core::util::join(args.begin() + static_cast<long>(start_idx), args.end());
+  auto result = core::standard_output().print("{}{}", words, newline ? "\n" : "");
+  if (!result) {
+    core::standard_error().println("echo: write error: {}", std::strerror(result.error()));
     return 1;
   }
 
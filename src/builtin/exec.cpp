@@ -0,0 +1,59 @@
+module;
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <expected>
+#include <span>
+#include <string>
+#include <string_view>
+
+module hsh.builtin;
+
+import hsh.context;
+import hsh.core;
+
+namespace hsh::builtin {
+
+auto replace_shell(std::span<std::string const> argv, std::string_view search_path, char* const* env)
+    -> core::syscall::Result<void> {
+  auto path = core::syscall::find_executable(argv[0], search_path);
+  if (!path) {
+    return std::unexpected(path.error());
+  }
+
+  // Nothing the shell buffered may be lost with it
+  [[maybe_unused]] auto _ = core::flush_output();
+
+  // Caught signals get their defaults back from the exec itself, only the ones an interactive shell ignores would
+  // stay ignored in the command
+  struct sigaction quit{};
+  sigaction(SIGQUIT, nullptr, &quit);
+  bool const ignoring = quit.sa_handler == SIG_IGN;
+  if (ignoring) {
+    [[maybe_unused]] auto __ = core::SignalManager::instance().reset_handlers();
+  }
+
+  auto result = core::syscall::exec_process(*path, argv, env);
+  if (ignoring) {
+    [[maybe_unused]] auto __ = core::SignalManager::instance().install_handlers();
+  }
+  return result;
+}
+
+auto builtin_exec(std::span<std::string const> args, context::Context& context, job::JobManager&) -> int {
+  if (!args.empty() && args[0] == "--") {
+    args = args.subspan(1);
+  }
+  // Without a command only the redirections matter, and the runner leaves those in place
+  if (args.empty()) {
+    return 0;
+  }
+
+  auto replaced = replace_shell(args, context.get_variable("PATH").value_or("/bin:/usr/bin"), core::env::envp());
+  int  error    = replaced.error();
+  core::standard_error().println("exec: {}: {}", args[0], error == ENOENT ? "not found" : std::strerror(error));
+  return error == ENOENT ? 127 : 126;
+}
+
+} // namespace hsh::builtin
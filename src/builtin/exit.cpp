@@ -2,13 +2,13 @@ module;
 
 #include <charconv>
 #include <cstdlib>
-#include <print>
 #include <span>
 #include <string>
 
 module hsh.builtin;
 
 import hsh.context;
+import hsh.core;
 
 namespace hsh::builtin {
 
@@ -17,14 +17,14 @@ auto builtin_exit(std::span<std::string const> args, context::Context& context,
 
   if (!args.empty()) {
     if (args.size() > 1) {
-      std::println(stderr, "exit: too many arguments");
+      core::standard_error().println("exit: too many arguments");
       return 1;
     }
 
     auto const& arg = args[0];
     if (auto [ptr, ec] = std::from_chars(arg.data(), arg.data() + arg.size(), exit_code);
         ec != std::errc{} || ptr != arg.data() + arg.size()) {
-      std::println(stderr, "exit: {}: numeric argument required", arg);
+      core::standard_error().println("exit: {}: numeric argument required", arg);
       std::exit(2);
     }
   }
@@ -2,13 +2,10 @@ module;
 
 #include <cstring>
 #include <format>
-#include <print>
 #include <span>
 #include <string>
 #include <string_view>
 
-#include <unistd.h>
-
 module hsh.builtin;
 
 import hsh.context;
@@ -19,10 +16,10 @@ namespace hsh::builtin {
 auto builtin_export(std::span<std::string const> args, context::Context& context, job::JobManager&) -> int {
   if (args.empty()) {
     for (auto const& [name, value] : context.list_variables()) {
-      if (context.is_exported(std::string{name})) {
+      if (context.is_exported(name)) {
         std::string output = std::format("{}={}\n", name, value);
-        if (auto result = core::syscall::write_fd(STDOUT_FILENO, output); !result) {
-          std::println(stderr, "export: write error: {}", std::strerror(result.error()));
+        if (auto result = core::standard_output().write(output); !result) {
+          core::standard_error().println("export: write error: {}", std::strerror(result.error()));
           return 1;
         }
       }
@@ -42,13 +39,13 @@ auto builtin_export(std::span<std::string const> args, context::Context& context
       std::string value = arg.substr(eq_pos + 1);
 
       if (name.empty() || !core::locale::is_alpha_u(name[0])) {
-        std::println(stderr, "export: {}: not a valid identifier", name);
+        core::standard_error().println("export: {}: not a valid identifier", name);
         return 1;
       }
 
       for (char c : name) {
         if (!core::locale::is_alnum_u(c)) {
-          std::println(stderr, "export: {}: not a valid identifier", name);
+          core::standard_error().println("export: {}: not a valid identifier", name);
           return 1;
         }
       }
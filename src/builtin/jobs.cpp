@@ -1,152 +1,308 @@
 module;
 
 #include <algorithm>
+#include <cerrno>
 #include <charconv>
 #include <csignal>
-#include <print>
+#include <format>
+#include <optional>
 #include <span>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include <sys/wait.h>
 
 module hsh.builtin;
 
 import hsh.context;
+import hsh.core;
 import hsh.job;
 
 namespace hsh::builtin {
 
-auto builtin_jobs(std::span<std::string const> args, context::Context&, job::JobManager& job_manager) -> int {
-  if (!args.empty()) {
-    std::println(stderr, "jobs: too many arguments");
-    return 1;
+namespace {
+
+auto status_name(job::JobStatus status) -> std::string_view {
+  switch (status) {
+    case job::JobStatus::Running: return "Running";
+    case job::JobStatus::Stopped: return "Stopped";
+    case job::JobStatus::Done: return "Done";
   }
+  return "";
+}
 
-  for (auto const& job : job_manager.get_jobs()) {
-    std::string status_str;
-    switch (job.status_) {
-      case job::JobStatus::Running: status_str = "Running"; break;
-      case job::JobStatus::Stopped: status_str = "Stopped"; break;
-      case job::JobStatus::Done: status_str = "Done"; break;
+// %N, N, %% and %+, or the current job if no spec is given
+auto resolve_job(std::string_view builtin, std::span<std::string const> args, job::JobManager& job_manager)
+    -> job::Job* {
+  if (args.empty() || args[0] == "%%" || args[0] == "%+") {
+    auto* job = job_manager.current_job();
+    if (job == nullptr) {
+      core::standard_error().println("{}: no current job", builtin);
     }
-    std::println("[{}]  {} {}", job.job_id_, status_str, job.command_);
+    return job;
   }
 
-  return 0;
+  std::string_view spec = args[0];
+  if (spec.starts_with('%')) {
+    spec.remove_prefix(1);
+  }
+
+  int job_id = 0;
+  if (auto [ptr, ec] = std::from_chars(spec.data(), spec.data() + spec.size(), job_id);
+      ec != std::errc{} || ptr != spec.data() + spec.size()) {
+    core::standard_error().println("{}: {}: no such job", builtin, args[0]);
+    return nullptr;
+  }
+
+  auto* job = job_manager.get_job(job_id);
+  if (job == nullptr) {
+    core::standard_error().println("{}: %{}: no such job", builtin, job_id);
+  }
+  return job;
 }
 
-auto builtin_fg(std::span<std::string const> args, context::Context&, job::JobManager& job_manager) -> int {
-  auto const& jobs_list = job_manager.get_jobs();
-  if (jobs_list.empty()) {
-    std::println(stderr, "fg: no current job");
-    return 1;
+// What one operand of wait refers to, a single process of a job or all of it. A process whose job was already reported
+// and removed only has its status left.
+struct WaitTarget {
+  int                job_id_ = 0;
+  pid_t              pid_    = -1;
+  std::optional<int> status_;
+};
+
+// A pid is looked up among all members of a job, including the ones that were already reaped
+auto resolve_wait_target(std::string const& operand, job::JobManager& job_manager) -> std::optional<WaitTarget> {
+  if (operand.starts_with('%')) {
+    auto* job = resolve_job("wait", std::span{&operand, 1}, job_manager);
+    return job != nullptr ? std::optional{WaitTarget{job->job_id_}} : std::nullopt;
   }
 
-  auto target_job = jobs_list.back();
+  pid_t pid = 0;
+  if (auto [ptr, ec] = std::from_chars(operand.data(), operand.data() + operand.size(), pid);
+      ec != std::errc{} || ptr != operand.data() + operand.size() || pid <= 0) {
+    core::standard_error().println("wait: `{}': not a pid or valid job spec", operand);
+    return std::nullopt;
+  }
+  if (auto const* job = job_manager.find_job(pid)) {
+    return WaitTarget{job->job_id_, pid};
+  }
+  if (auto status = job_manager.take_unwaited(pid)) {
+    return WaitTarget{0, pid, status};
+  }
+  core::standard_error().println("wait: pid {} is not a child of this shell", pid);
+  return std::nullopt;
+}
 
-  if (!args.empty()) {
-    std::string arg = args[0];
+// Status of a finished target, nothing while it still runs
+auto finished_status(WaitTarget const& target, job::JobManager& job_manager) -> std::optional<int> {
+  if (target.status_) {
+    return target.status_;
+  }
+  auto const* job = job_manager.get_job(target.job_id_);
+  if (job == nullptr) {
+    return std::nullopt;
+  }
+  if (target.pid_ == -1) {
+    return job->is_done() ? std::optional{job->exit_status()} : std::nullopt;
+  }
+  auto process = std::ranges::find(job->processes_, target.pid_, &job::Process::pid_);
+  return process->done_ ? std::optional{process->exit_status_} : std::nullopt;
+}
 
-    if (!arg.empty() && arg[0] == '%') {
-      arg = arg.substr(1);
-    }
+// A waited for job is forgotten once all of it has finished
+void forget_if_done(int job_id, job::JobManager& job_manager) {
+  if (auto const* job = job_manager.get_job(job_id); job != nullptr && job->is_done()) {
+    job_manager.remove_job(job_id);
+  }
+}
 
-    int job_id = 0;
-    if (auto [ptr, ec] = std::from_chars(arg.data(), arg.data() + arg.size(), job_id);
-        ec != std::errc{} || ptr != arg.data() + arg.size()) {
-      std::println(stderr, "fg: {}: no such job", args[0]);
-      return 1;
-    }
+} // namespace
 
-    auto it = std::ranges::find_if(jobs_list, [job_id](job::Job const& j) { return j.job_id_ == job_id; });
-    if (it == jobs_list.end()) {
-      std::println(stderr, "fg: %{}: no such job", job_id);
-      return 1;
+auto builtin_jobs(std::span<std::string const> args, context::Context&, job::JobManager& job_manager) -> int {
+  bool list_pids = false;
+  bool only_pgid = false;
+  for (auto const& arg : args) {
+    if (arg == "-l") {
+      list_pids = true;
+    } else if (arg == "-p") {
+      only_pgid = true;
+    } else {
+      core::standard_error().println("jobs: {}: invalid option", arg);
+      return 2;
     }
-    target_job = *it;
   }
 
-  if (target_job.status_ == job::JobStatus::Stopped) {
-    if (kill(target_job.pid_, SIGCONT) == -1) {
-      std::println(stderr, "fg: failed to continue job");
-      return 1;
+  for (auto const* job : job_manager.get_jobs()) {
+    if (only_pgid) {
+      core::standard_output().println("{}", job->pgid_);
+      continue;
     }
+    if (list_pids) {
+      std::string pids;
+      for (auto const& process : job->processes_) {
+        pids += std::format(" {}", process.pid_);
+      }
+      core::standard_output().println("[{}] {} {} {}", job->job_id_, pids, status_name(job->status_), job->command_);
+      continue;
+    }
+    core::standard_output().println("[{}]  {} {}", job->job_id_, status_name(job->status_), job->command_);
   }
 
-  std::println("{}", target_job.command_);
+  return 0;
+}
 
-  int status = 0;
-  if (waitpid(target_job.pid_, &status, 0) == -1) {
-    std::println(stderr, "fg: failed to wait for job");
+auto builtin_fg(std::span<std::string const> args, context::Context&, job::JobManager& job_manager) -> int {
+  auto* job = resolve_job("fg", args, job_manager);
+  if (job == nullptr) {
     return 1;
   }
-  job_manager.remove_job(target_job.pid_);
 
-  if (WIFEXITED(status)) {
-    return WEXITSTATUS(status);
-  }
-  if (WIFSIGNALED(status)) {
-    return 128 + WTERMSIG(status);
-  }
-
-  return 1;
-}
+  int const   job_id = job->job_id_;
+  pid_t const pgid   = job->pgid_;
 
-auto builtin_bg(std::span<std::string const> args, context::Context&, job::JobManager& job_manager) -> int {
-  auto const& jobs_list = job_manager.get_jobs();
-  if (jobs_list.empty()) {
-    std::println(stderr, "bg: no current job");
+  if (job->status_ == job::JobStatus::Stopped && kill(-pgid, SIGCONT) == -1) {
+    core::standard_error().println("fg: failed to continue job");
     return 1;
   }
+  job->status_ = job::JobStatus::Running;
 
-  job::Job target_job{0, 0, ""};
-  bool     found = false;
+  core::standard_output().println("{}", job->command_);
+  [[maybe_unused]] auto _ = core::flush_output();
 
-  if (!args.empty()) {
-    std::string arg = args[0];
+  std::vector<pid_t> pending;
+  for (auto const& process : job->processes_) {
+    if (!process.done_) {
+      pending.push_back(process.pid_);
+    }
+  }
+
+  core::SignalManager::instance().set_foreground_process(pgid);
 
-    if (!arg.empty() && arg[0] == '%') {
-      arg = arg.substr(1);
+  for (pid_t pid : pending) {
+    int   status = 0;
+    pid_t result = 0;
+    while ((result = waitpid(pid, &status, WUNTRACED)) == -1 && errno == EINTR) {}
+    if (result == -1) {
+      // already reaped elsewhere
+      job_manager.update_process(pid, 0);
+      continue;
     }
 
-    int job_id = 0;
-    if (auto [ptr, ec] = std::from_chars(arg.data(), arg.data() + arg.size(), job_id);
-        ec != std::errc{} || ptr != arg.data() + arg.size()) {
-      std::println(stderr, "bg: {}: no such job", args[0]);
-      return 1;
+    if (WIFSTOPPED(status)) {
+      core::SignalManager::instance().set_foreground_process(0);
+      job_manager.update_job_status(job_id, job::JobStatus::Stopped);
+      core::standard_output().println("[{}]  + stopped     {}", job_id, job->command_);
+      return 128 + WSTOPSIG(status);
     }
 
-    auto it = std::ranges::find_if(jobs_list, [job_id](job::Job const& j) { return j.job_id_ == job_id; });
-    if (it == jobs_list.end()) {
-      std::println(stderr, "bg: %{}: no such job", job_id);
+    job_manager.update_process(pid, WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status));
+  }
+
+  core::SignalManager::instance().set_foreground_process(0);
+
+  int exit_status = job->exit_status();
+  job_manager.remove_job(job_id);
+  return exit_status;
+}
+
+auto builtin_bg(std::span<std::string const> args, context::Context&, job::JobManager& job_manager) -> int {
+  job::Job* job = nullptr;
+  if (args.empty()) {
+    // The most recent stopped job
+    for (auto const* candidate : job_manager.get_jobs()) {
+      if (candidate->status_ == job::JobStatus::Stopped) {
+        job = job_manager.get_job(candidate->job_id_);
+      }
+    }
+    if (job == nullptr) {
+      core::standard_error().println("bg: no stopped job");
       return 1;
     }
-    target_job = *it;
-    found      = true;
   } else {
-    for (auto it = jobs_list.rbegin(); it != jobs_list.rend(); ++it) {
-      if (it->status_ == job::JobStatus::Stopped) {
-        target_job = *it;
-        found      = true;
-        break;
-      }
+    job = resolve_job("bg", args, job_manager);
+    if (job == nullptr) {
+      return 1;
     }
   }
 
-  if (!found) {
-    std::println(stderr, "bg: no stopped job");
+  if (kill(-job->pgid_, SIGCONT) == -1) {
+    core::standard_error().println("bg: failed to continue job");
     return 1;
   }
 
-  if (kill(target_job.pid_, SIGCONT) == -1) {
-    std::println(stderr, "bg: failed to continue job");
-    return 1;
+  job->status_ = job::JobStatus::Running;
+  core::standard_output().println("[{}] {} &", job->job_id_, job->command_);
+
+  return 0;
+}
+
+auto builtin_wait(std::span<std::string const> args, context::Context&, job::JobManager& job_manager) -> int {
+  bool any = false;
+  if (!args.empty() && args[0] == "-n") {
+    any  = true;
+    args = args.subspan(1);
+  } else if (!args.empty() && args[0].starts_with('-')) {
+    core::standard_error().println("wait: {}: invalid option", args[0]);
+    return 2;
+  }
+
+  // Without operands every job is waited for, only the running ones so that a stopped job does not block forever
+  std::vector<std::optional<WaitTarget>> targets;
+  if (args.empty()) {
+    for (auto const* job : job_manager.get_jobs()) {
+      if (job->status_ != job::JobStatus::Stopped) {
+        targets.emplace_back(WaitTarget{job->job_id_});
+      }
+    }
+  }
+  for (auto const& operand : args) {
+    targets.push_back(resolve_wait_target(operand, job_manager));
   }
 
-  job_manager.update_job_status(target_job.pid_, job::JobStatus::Running);
-  std::println("[{}] {}", target_job.job_id_, target_job.command_);
+  // Whatever the shell printed so far must not be held back while it blocks
+  [[maybe_unused]] auto _ = core::flush_output();
 
-  return 0;
+  if (any) {
+    std::erase(targets, std::nullopt);
+    if (targets.empty()) {
+      return 127;
+    }
+    // The first target to finish, without waiting for the others
+    while (true) {
+      for (auto const& target : targets) {
+        if (auto status = finished_status(*target, job_manager)) {
+          forget_if_done(target->job_id_, job_manager);
+          return *status;
+        }
+      }
+      if (auto waited = job_manager.wait_for_exit(); !waited) {
+        return waited.error() == EINTR ? 128 + SIGINT : 127;
+      }
+    }
+  }
+
+  // The status of the last operand is the status of wait, a plain wait succeeds
+  int exit_status = 0;
+  for (auto const& target : targets) {
+    if (!target) {
+      exit_status = 127;
+      continue;
+    }
+    std::optional<int> status;
+    while (!(status = finished_status(*target, job_manager))) {
+      if (auto waited = job_manager.wait_for_exit(); !waited) {
+        if (waited.error() == EINTR) {
+          return 128 + SIGINT;
+        }
+        break;
+      }
+    }
+    if (!args.empty()) {
+      exit_status = status.value_or(127);
+    }
+    forget_if_done(target->job_id_, job_manager);
+  }
+  return exit_status;
 }
 
 } // namespace hsh::builtin
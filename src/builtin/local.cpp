@@ -0,0 +1,38 @@
+module;
+
+#include <span>
+#include <string>
+#include <string_view>
+
+module hsh.builtin;
+
+import hsh.context;
+import hsh.core;
+
+namespace hsh::builtin {
+
+auto builtin_local(std::span<std::string const> args, context::Context& context, job::JobManager&) -> int {
+  if (context.frame_depth() == 0) {
+    core::standard_error().println("local: can only be used in a function");
+    return 1;
+  }
+
+  int exit_status = 0;
+  for (auto const& arg : args) {
+    auto             eq_pos = arg.find('=');
+    std::string_view name   = std::string_view{arg}.substr(0, eq_pos);
+    if (name.empty() || core::locale::identifier_end(name, 0) != name.size()) {
+      core::standard_error().println("local: {}: not a valid identifier", name);
+      exit_status = 1;
+      continue;
+    }
+
+    context.declare_local(name);
+    if (eq_pos != std::string::npos) {
+      context.set_variable(std::string{name}, arg.substr(eq_pos + 1));
+    }
+  }
+  return exit_status;
+}
+
+} // namespace hsh::builtin
@@ -0,0 +1,432 @@
+module;
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <format>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+module hsh.builtin;
+
+import hsh.context;
+import hsh.core;
+
+namespace hsh::builtin {
+
+namespace {
+
+// Formats stay cached until there are this many, then the cache starts over
+constexpr size_t MAX_CACHED_FORMATS = 64;
+
+struct Directive {
+  std::string flags_;
+  int         width_         = -1; // -1 if absent
+  int         precision_     = -1;
+  bool        width_arg_     = false; // width given as *
+  bool        precision_arg_ = false;
+  char        conversion_    = 's';
+};
+
+// A format string split once into literal text, with escapes already resolved, and conversions
+struct Segment {
+  std::string              literal_;
+  std::optional<Directive> directive_;
+};
+
+struct Format {
+  std::vector<Segment> segments_;
+  std::string          error_;            // set if the format is invalid, segments_ then stops before the error
+  bool                 consumes_ = false; // whether any directive takes an argument
+};
+
+constexpr auto is_octal(char c) noexcept -> bool {
+  return c >= '0' && c <= '7';
+}
+
+constexpr auto hex_value(char c) noexcept -> int {
+  if (core::locale::is_digit(c)) {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+// Resolves the backslash escape starting at text[pos] (the backslash) into out and returns its length. For %b
+// arguments octal escapes are written \0ooo, and \c ends the output.
+auto append_escape(std::string_view text, size_t pos, std::string& out, bool argument, bool& stop) -> size_t {
+  if (pos + 1 >= text.size()) {
+    out += '\\';
+    return 1;
+  }
+
+  char c = text[pos + 1];
+  switch (c) {
+    case '\\': out += '\\'; return 2;
+    case 'a': out += '\a'; return 2;
+    case 'b': out += '\b'; return 2;
+    case 'e': out += '\x1b'; return 2;
+    case 'f': out += '\f'; return 2;
+    case 'n': out += '\n'; return 2;
+    case 'r': out += '\r'; return 2;
+    case 't': out += '\t'; return 2;
+    case 'v': out += '\v'; return 2;
+    case '"': out += '"'; return 2;
+    case '\'': out += '\''; return 2;
+    case 'c':
+      if (argument) {
+        stop = true;
+        return 2;
+      }
+      break;
+    case 'x': {
+      int    value  = 0;
+      size_t length = 2;
+      while (length < 4 && pos + length < text.size() && hex_value(text[pos + length]) >= 0) {
+        value = value * 16 + hex_value(text[pos + length]);
+        ++length;
+      }
+      if (length == 2) {
+        break;
+      }
+      out += static_cast<char>(value);
+      return length;
+    }
+    default: break;
+  }
+
+  if (is_octal(c)) {
+    // \ooo in formats, \0ooo in %b arguments
+    size_t start  = pos + 1 + (argument && c == '0' ? 1 : 0);
+    size_t length = 0;
+    int    value  = 0;
+    while (length < 3 && start + length < text.size() && is_octal(text[start + length])) {
+      value = value * 8 + (text[start + length] - '0');
+      ++length;
+    }
+    out += static_cast<char>(value);
+    return start + length - pos;
+  }
+
+  out += '\\';
+  out += c;
+  return 2;
+}
+
+auto parse_format(std::string_view text) -> Format {
+  Format  format;
+  Segment current;
+  bool    unused = false;
+
+  for (size_t pos = 0; pos < text.size();) {
+    if (text[pos] == '\\') {
+      pos += append_escape(text, pos, current.literal_, false, unused);
+      continue;
+    }
+    if (text[pos] != '%') {
+      current.literal_ += text[pos++];
+      continue;
+    }
+    if (pos + 1 < text.size() && text[pos + 1] == '%') {
+      current.literal_ += '%';
+      pos += 2;
+      continue;
+    }
+
+    Directive directive;
+    size_t    start = pos++;
+    while (pos < text.size() && std::string_view{"-+ #0'"}.contains(text[pos])) {
+      directive.flags_ += text[pos++];
+    }
+
+    auto parse_number = [&](int& number, bool& from_argument) {
+      if (pos < text.size() && text[pos] == '*') {
+        from_argument = true;
+        ++pos;
+        return;
+      }
+      auto [ptr, ec] = std::from_chars(text.data() + pos, text.data() + text.size(), number);
+      if (ec == std::errc{}) {
+        pos = static_cast<size_t>(ptr - text.data());
+      }
+    };
+    parse_number(directive.width_, directive.width_arg_);
+    if (pos < text.size() && text[pos] == '.') {
+      ++pos;
+      directive.precision_ = 0;
+      parse_number(directive.precision_, directive.precision_arg_);
+    }
+    // Length modifiers are accepted and ignored, arguments are converted at full width anyway
+    while (pos < text.size() && std::string_view{"hlLjzt"}.contains(text[pos])) {
+      ++pos;
+    }
+
+    if (pos >= text.size() || !std::string_view{"diouxXfFeEgGaAcsbq"}.contains(text[pos])) {
+      format.error_ = std::format("`{}': invalid format character", text.substr(start, pos + 1 - start));
+      break;
+    }
+    directive.conversion_ = text[pos++];
+
+    current.directive_ = std::move(directive);
+    format.segments_.push_back(std::move(current));
+    format.consumes_ = true;
+    current          = Segment{};
+  }
+
+  if (!current.literal_.empty()) {
+    format.segments_.push_back(std::move(current));
+  }
+  return format;
+}
+
+auto cached_format(std::string const& text) -> Format const& {
+  static core::FlatMap<Format> cache;
+  if (auto const* format = cache.get(text)) {
+    return *format;
+  }
+  if (cache.size() >= MAX_CACHED_FORMATS) {
+    cache.clear();
+  }
+  return cache.insert_or_assign(text, parse_format(text));
+}
+
+// Quotes text so the shell reads it back unchanged
+auto shell_quote(std::string_view text) -> std::string {
+  if (text.empty()) {
+    return "''";
+  }
+  bool safe = true;
+  for (char c : text) {
+    if (!core::locale::is_alnum_u(c) && !std::string_view{"@%+=:,./-"}.contains(c)) {
+      safe = false;
+      break;
+    }
+  }
+  if (safe) {
+    return std::string(text);
+  }
+
+  std::string quoted = "'";
+  for (char c : text) {
+    if (c == '\'') {
+      quoted += "'\\''";
+    } else {
+      quoted += c;
+    }
+  }
+  quoted += '\'';
+  return quoted;
+}
+
+class Formatter {
+  std::span<std::string const> args_;
+  size_t                       next_   = 0;
+  std::string&                 output_;
+  bool                         failed_ = false;
+  bool                         stop_   = false;
+
+public:
+  Formatter(std::span<std::string const> args, std::string& output)
+      : args_(args), output_(output) {}
+
+  [[nodiscard]] auto failed() const noexcept -> bool {
+    return failed_;
+  }
+  [[nodiscard]] auto stopped() const noexcept -> bool {
+    return stop_;
+  }
+  [[nodiscard]] auto exhausted() const noexcept -> bool {
+    return next_ >= args_.size();
+  }
+
+  void format(Format const& format) {
+    for (auto const& segment : format.segments_) {
+      output_ += segment.literal_;
+      if (segment.directive_) {
+        convert(*segment.directive_);
+      }
+      if (stop_) {
+        return;
+      }
+    }
+  }
+
+private:
+  auto next_argument() -> std::string_view {
+    return next_ < args_.size() ? std::string_view{args_[next_++]} : std::string_view{};
+  }
+
+  // Integers may be written in decimal, octal or hex, or as 'c for the value of a character
+  template<typename T>
+  auto next_number() -> T {
+    auto arg = next_argument();
+    if (arg.empty()) {
+      return T{};
+    }
+    if (arg.size() >= 2 && (arg[0] == '\'' || arg[0] == '"')) {
+      return static_cast<T>(static_cast<unsigned char>(arg[1]));
+    }
+
+    std::string text{arg};
+    char*       end = nullptr;
+    errno           = 0;
+    T value{};
+    if constexpr (std::is_floating_point_v<T>) {
+      value = std::strtold(text.c_str(), &end);
+    } else if constexpr (std::is_signed_v<T>) {
+      value = std::strtoll(text.c_str(), &end, 0);
+    } else {
+      value = text.starts_with('-') ? static_cast<T>(std::strtoll(text.c_str(), &end, 0))
+                                    : std::strtoull(text.c_str(), &end, 0);
+    }
+    if (errno != 0 || end == text.c_str() || *end != '\0') {
+      core::standard_error().println("printf: {}: invalid number", arg);
+      failed_ = true;
+    }
+    return value;
+  }
+
+  template<typename T>
+  void append_formatted(std::string const& spec, T value) {
+    int size = std::snprintf(nullptr, 0, spec.c_str(), value);
+    if (size <= 0) {
+      return;
+    }
+    size_t offset = output_.size();
+    output_.resize(offset + static_cast<size_t>(size) + 1);
+    std::snprintf(output_.data() + offset, static_cast<size_t>(size) + 1, spec.c_str(), value);
+    output_.resize(offset + static_cast<size_t>(size));
+  }
+
+  // Strings are padded by hand and appended by length, so they may contain NUL bytes
+  void append_padded(std::string_view text, Directive const& directive, int width, int precision) {
+    if (precision >= 0 && static_cast<size_t>(precision) < text.size()) {
+      text = text.substr(0, static_cast<size_t>(precision));
+    }
+    // A negative width given as * left-justifies, -1 otherwise means no width at all
+    bool      left    = directive.flags_.contains('-') || (directive.width_arg_ && width < 0);
+    long long field   = directive.width_arg_ ? std::abs(static_cast<long long>(width)) : std::max(width, 0);
+    size_t    padding = std::cmp_greater(field, text.size()) ? static_cast<size_t>(field) - text.size() : 0;
+    if (!left) {
+      output_.append(padding, ' ');
+    }
+    output_ += text;
+    if (left) {
+      output_.append(padding, ' ');
+    }
+  }
+
+  void convert(Directive const& directive) {
+    int width     = directive.width_;
+    int precision = directive.precision_;
+    if (directive.width_arg_) {
+      width = static_cast<int>(next_number<long long>());
+    }
+    if (directive.precision_arg_) {
+      // A negative precision counts as none
+      precision = std::max(static_cast<int>(next_number<long long>()), -1);
+    }
+
+    std::string spec = "%" + directive.flags_;
+    if (width >= 0 || directive.width_arg_) {
+      spec += std::to_string(width);
+    }
+    if (precision >= 0) {
+      spec += '.' + std::to_string(precision);
+    }
+
+    switch (char conversion = directive.conversion_) {
+      case 'd':
+      case 'i': append_formatted(spec + "lld", next_number<long long>()); break;
+      case 'o':
+      case 'u':
+      case 'x':
+      case 'X': append_formatted(spec + "ll" + conversion, next_number<unsigned long long>()); break;
+      case 'f':
+      case 'F':
+      case 'e':
+      case 'E':
+      case 'g':
+      case 'G':
+      case 'a':
+      case 'A': append_formatted(spec + 'L' + conversion, next_number<long double>()); break;
+      case 'c': append_padded(next_argument().substr(0, 1), directive, width, -1); break;
+      case 'b': {
+        auto        arg = next_argument();
+        std::string expanded;
+        for (size_t pos = 0; pos < arg.size() && !stop_;) {
+          if (arg[pos] == '\\') {
+            pos += append_escape(arg, pos, expanded, true, stop_);
+          } else {
+            expanded += arg[pos++];
+          }
+        }
+        append_padded(expanded, directive, width, precision);
+        break;
+      }
+      case 'q': append_padded(shell_quote(next_argument()), directive, width, precision); break;
+      default: append_padded(next_argument(), directive, width, precision); break;
+    }
+  }
+};
+
+} // namespace
+
+auto builtin_printf(std::span<std::string const> args, context::Context& context, job::JobManager&) -> int {
+  std::optional<std::string> variable;
+  if (args.size() >= 2 && args[0] == "-v") {
+    variable = args[1];
+    args     = args.subspan(2);
+    if (variable->empty() || core::locale::identifier_end(*variable, 0) != variable->size()) {
+      core::standard_error().println("printf: `{}': not a valid identifier", *variable);
+      return 2;
+    }
+  }
+  if (!args.empty() && args[0] == "--") {
+    args = args.subspan(1);
+  }
+  if (args.empty()) {
+    core::standard_error().println("printf: usage: printf [-v var] format [arguments]");
+    return 2;
+  }
+
+  auto const& format = cached_format(args[0]);
+
+  std::string output;
+  Formatter   formatter{args.subspan(1), output};
+  // The format is reused until every argument is consumed
+  do {
+    formatter.format(format);
+  } while (format.consumes_ && format.error_.empty() && !formatter.stopped() && !formatter.exhausted());
+
+  int status = formatter.failed() ? 1 : 0;
+  if (!format.error_.empty()) {
+    core::standard_error().println("printf: {}", format.error_);
+    status = 1;
+  }
+
+  if (variable) {
+    context.set_variable(*variable, std::move(output));
+    return status;
+  }
+  if (auto result = core::standard_output().write(output); !result) {
+    core::standard_error().println("printf: write error: {}", std::strerror(result.error()));
+    return 1;
+  }
+  return status;
+}
+
+} // namespace hsh::builtin
@@ -2,12 +2,9 @@ module;
 
 #include <cstring>
 #include <format>
-#include <print>
 #include <span>
 #include <string>
 
-#include <unistd.h>
-
 module hsh.builtin;
 
 import hsh.context;
@@ -17,12 +14,12 @@ namespace hsh::builtin {
 
 auto builtin_pwd(std::span<std::string const> args, context::Context& context, job::JobManager&) -> int {
   if (!args.empty()) {
-    std::println(stderr, "pwd: too many arguments");
+    core::standard_error().println("pwd: too many arguments");
     return 1;
   }
 
-  if (auto result = core::syscall::write_fd(STDOUT_FILENO, std::format("{}\n", context.get_cwd())); !result) {
-    std::println(stderr, "pwd: write error: {}", std::strerror(result.error()));
+  if (auto result = core::standard_output().println("{}", context.get_cwd()); !result) {
+    core::standard_error().println("pwd: write error: {}", std::strerror(result.error()));
     return 1;
   }
 
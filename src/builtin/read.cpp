@@ -0,0 +1,429 @@
+module;
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+module hsh.builtin;
+
+import hsh.context;
+import hsh.core;
+
+namespace hsh::builtin {
+
+namespace {
+
+using core::syscall::Result;
+
+constexpr size_t BLOCK_SIZE    = 64 * 1024;
+constexpr size_t MIN_PEEK_SIZE = 256;
+
+struct ReadOptions {
+  bool                       raw_       = false;
+  char                       delimiter_ = '\n';
+  size_t                     limit_     = std::numeric_limits<size_t>::max(); // -n
+  std::optional<std::string> array_;
+};
+
+// Block of a regular file kept between calls, so a loop over a file reads each byte from the kernel once. It is only
+// reused while the descriptor still refers to the same, unmodified file.
+struct FileBlock {
+  std::array<char, BLOCK_SIZE> data_;
+  size_t                       size_  = 0;
+  off_t                        start_ = 0;
+  dev_t                        device_{};
+  ino_t                        inode_{};
+  off_t                        file_size_ = 0;
+  timespec                     modified_{};
+
+  [[nodiscard]] auto covers(struct stat const& info, off_t position) const noexcept -> bool {
+    return size_ > 0 && device_ == info.st_dev && inode_ == info.st_ino && file_size_ == info.st_size &&
+           modified_.tv_sec == info.st_mtim.tv_sec && modified_.tv_nsec == info.st_mtim.tv_nsec &&
+           position >= start_ && position < start_ + static_cast<off_t>(size_);
+  }
+};
+
+auto file_block() -> FileBlock& {
+  static FileBlock block;
+  return block;
+}
+
+// Scans for the delimiter in at most limit bytes of chunk. Returns how many bytes belong to the record and whether it
+// ended there, the delimiter itself is not part of the record.
+auto scan(std::string_view chunk, char delimiter, size_t limit) -> std::pair<size_t, bool> {
+  chunk = chunk.substr(0, limit);
+  if (auto const* found = static_cast<char const*>(std::memchr(chunk.data(), delimiter, chunk.size()))) {
+    return {static_cast<size_t>(found - chunk.data()), true};
+  }
+  return {chunk.size(), chunk.size() == limit};
+}
+
+// Regular files are read in blocks, the file offset is then set just past the delimiter
+auto read_file(int fd, struct stat const& info, ReadOptions const& options, std::string& record) -> Result<bool> {
+  auto position = core::syscall::seek_fd(fd, 0, SEEK_CUR);
+  if (!position) {
+    return std::unexpected(position.error());
+  }
+
+  auto& block = file_block();
+  while (true) {
+    if (!block.covers(info, *position)) {
+      auto got = core::syscall::read_fd_at(fd, block.data_.data(), block.data_.size(), *position);
+      if (!got) {
+        return std::unexpected(got.error());
+      }
+      block.size_      = *got;
+      block.start_     = *position;
+      block.device_    = info.st_dev;
+      block.inode_     = info.st_ino;
+      block.file_size_ = info.st_size;
+      block.modified_  = info.st_mtim;
+      if (*got == 0) {
+        // End of file, leave the offset after whatever was taken into the record
+        if (auto seeked = core::syscall::seek_fd(fd, *position, SEEK_SET); !seeked) {
+          return std::unexpected(seeked.error());
+        }
+        return false;
+      }
+    }
+
+    auto offset        = static_cast<size_t>(*position - block.start_);
+    auto chunk         = std::string_view{block.data_.data() + offset, block.size_ - offset};
+    auto [used, ended] = scan(chunk, options.delimiter_, options.limit_ - record.size());
+    record.append(chunk.substr(0, used));
+    *position += static_cast<off_t>(used);
+
+    if (ended) {
+      bool delimited = used < chunk.size() && chunk[used] == options.delimiter_ && record.size() < options.limit_;
+      *position += delimited ? 1 : 0;
+      if (auto seeked = core::syscall::seek_fd(fd, *position, SEEK_SET); !seeked) {
+        return std::unexpected(seeked.error());
+      }
+      return true;
+    }
+  }
+}
+
+// Pipes are peeked at with tee(2) and only the record is consumed, which leaves the rest for whoever reads next.
+// The peek starts small and grows while no delimiter shows up, so short lines stay cheap.
+auto read_pipe(int fd, ReadOptions const& options, std::string& record) -> Result<bool> {
+  static std::optional<std::pair<core::FileDescriptor, core::FileDescriptor>> scratch;
+  if (!scratch) {
+    auto pipe = core::make_pipe();
+    if (!pipe) {
+      return std::unexpected(EMFILE);
+    }
+    scratch.emplace(std::move(*pipe));
+  }
+
+  // The file block doubles as the buffer here, so whatever it cached is dropped
+  auto& block = file_block();
+  block.size_ = 0;
+
+  auto&  buffer    = block.data_;
+  size_t peek_size = MIN_PEEK_SIZE;
+  while (true) {
+    auto peeked = core::syscall::tee_pipe(fd, scratch->second.get(), peek_size);
+    if (!peeked && peeked.error() == EINTR) {
+      continue;
+    }
+    if (!peeked) {
+      return std::unexpected(peeked.error());
+    }
+    if (*peeked == 0) {
+      return false;
+    }
+
+    // Drain the scratch pipe completely, it has to be empty for the next peek. A signal must not interrupt this or the
+    // consuming reads below, they are retried.
+    size_t copied = 0;
+    while (copied < *peeked) {
+      auto got = core::syscall::read_fd(scratch->first.get(), buffer.data() + copied, *peeked - copied);
+      if (!got && got.error() == EINTR) {
+        continue;
+      }
+      if (!got) {
+        return std::unexpected(got.error());
+      }
+      copied += *got;
+    }
+
+    auto chunk         = std::string_view{buffer.data(), copied};
+    auto [used, ended] = scan(chunk, options.delimiter_, options.limit_ - record.size());
+    record.append(chunk.substr(0, used));
+
+    bool   delimited = ended && used < chunk.size() && chunk[used] == options.delimiter_;
+    size_t consume   = used + (delimited && record.size() < options.limit_ ? 1 : 0);
+    for (size_t consumed = 0; consumed < consume;) {
+      auto got = core::syscall::read_fd(fd, buffer.data(), consume - consumed);
+      if (!got && got.error() == EINTR) {
+        continue;
+      }
+      if (!got) {
+        return std::unexpected(got.error());
+      }
+      consumed += *got;
+    }
+
+    if (ended) {
+      return true;
+    }
+    peek_size = std::min(peek_size * 2, BLOCK_SIZE);
+  }
+}
+
+// Terminals and anything else that can neither seek nor be peeked at are read one byte at a time
+auto read_bytes(int fd, ReadOptions const& options, std::string& record) -> Result<bool> {
+  while (record.size() < options.limit_) {
+    char c   = 0;
+    auto got = core::syscall::read_fd(fd, &c, 1);
+    if (!got) {
+      if (got.error() == EINTR) {
+        continue;
+      }
+      return std::unexpected(got.error());
+    }
+    if (*got == 0) {
+      return false;
+    }
+    if (c == options.delimiter_) {
+      return true;
+    }
+    record += c;
+  }
+  return true;
+}
+
+auto read_record(int fd, ReadOptions const& options, std::string& record) -> Result<bool> {
+  if (options.limit_ == record.size()) {
+    return true;
+  }
+
+  auto info = core::syscall::stat_fd(fd);
+  if (info && S_ISREG(info->st_mode)) {
+    return read_file(fd, *info, options, record);
+  }
+  if (info && S_ISFIFO(info->st_mode)) {
+    if (auto result = read_pipe(fd, options, record); result || result.error() != EINVAL) {
+      return result;
+    }
+  }
+  return read_bytes(fd, options, record);
+}
+
+auto ends_with_escape(std::string_view text) -> bool {
+  size_t backslashes = 0;
+  for (auto it = text.rbegin(); it != text.rend() && *it == '\\'; ++it) {
+    ++backslashes;
+  }
+  return backslashes % 2 == 1;
+}
+
+// Splits a record on IFS the way read does: runs of IFS whitespace count as one separator, and so does a single other
+// IFS character together with the whitespace around it. Without -r a backslash quotes the next character.
+class FieldSplitter {
+  std::string_view line_;
+  std::string_view ifs_;
+  bool             raw_;
+  size_t           pos_ = 0;
+
+public:
+  FieldSplitter(std::string_view line, std::string_view ifs, bool raw)
+      : line_(line), ifs_(ifs), raw_(raw) {
+    skip_whitespace();
+  }
+
+  [[nodiscard]] auto done() const noexcept -> bool {
+    return pos_ >= line_.size();
+  }
+
+  auto next() -> std::string {
+    std::string field;
+    while (pos_ < line_.size()) {
+      char c = line_[pos_];
+      if (!raw_ && c == '\\') {
+        if (pos_ + 1 < line_.size()) {
+          field += line_[pos_ + 1];
+        }
+        pos_ += 2;
+        continue;
+      }
+      if (is_separator(c)) {
+        break;
+      }
+      field += c;
+      ++pos_;
+    }
+
+    skip_whitespace();
+    if (pos_ < line_.size() && is_separator(line_[pos_]) && !is_whitespace(line_[pos_])) {
+      ++pos_;
+      skip_whitespace();
+    }
+    return field;
+  }
+
+  // Everything not split off yet, for the last variable. Trailing IFS whitespace is dropped.
+  auto rest() -> std::string {
+    size_t end = line_.size();
+    while (end > pos_ && is_whitespace(line_[end - 1]) && (raw_ || !ends_with_escape(line_.substr(0, end - 1)))) {
+      --end;
+    }
+    auto text = line_.substr(pos_, end - pos_);
+    pos_      = line_.size();
+    return raw_ ? std::string(text) : unescape(text);
+  }
+
+  [[nodiscard]] static auto unescape(std::string_view text) -> std::string {
+    std::string result;
+    result.reserve(text.size());
+    for (size_t i = 0; i < text.size(); ++i) {
+      if (text[i] == '\\') {
+        ++i;
+        if (i == text.size()) {
+          break;
+        }
+      }
+      result += text[i];
+    }
+    return result;
+  }
+
+private:
+  [[nodiscard]] auto is_separator(char c) const noexcept -> bool {
+    return ifs_.contains(c);
+  }
+  [[nodiscard]] auto is_whitespace(char c) const noexcept -> bool {
+    return (c == ' ' || c == '\t' || c == '\n') && is_separator(c);
+  }
+  void skip_whitespace() noexcept {
+    while (pos_ < line_.size() && is_whitespace(line_[pos_])) {
+      ++pos_;
+    }
+  }
+};
+
+auto parse_options(std::span<std::string const> args, ReadOptions& options) -> std::optional<size_t> {
+  size_t i = 0;
+  for (; i < args.size(); ++i) {
+    std::string_view arg = args[i];
+    if (arg == "--") {
+      return i + 1;
+    }
+    if (arg.size() < 2 || arg[0] != '-') {
+      break;
+    }
+
+    for (size_t j = 1; j < arg.size(); ++j) {
+      char option = arg[j];
+      if (option == 'r') {
+        options.raw_ = true;
+        continue;
+      }
+      if (option != 'd' && option != 'n' && option != 'a') {
+        core::standard_error().println("read: -{}: invalid option", option);
+        return std::nullopt;
+      }
+
+      std::string_view value;
+      if (j + 1 < arg.size()) {
+        value = arg.substr(j + 1);
+      } else if (i + 1 < args.size()) {
+        value = args[++i];
+      } else {
+        core::standard_error().println("read: -{}: option requires an argument", option);
+        return std::nullopt;
+      }
+
+      if (option == 'd') {
+        options.delimiter_ = value.empty() ? '\0' : value[0];
+      } else if (option == 'a') {
+        options.array_ = std::string(value);
+      } else if (auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), options.limit_);
+                 ec != std::errc{} || ptr != value.data() + value.size()) {
+        core::standard_error().println("read: {}: invalid number", value);
+        return std::nullopt;
+      }
+      break;
+    }
+  }
+  return i;
+}
+
+} // namespace
+
+auto builtin_read(std::span<std::string const> args, context::Context& context, job::JobManager&) -> int {
+  ReadOptions options;
+  auto        first_name = parse_options(args, options);
+  if (!first_name) {
+    return 2;
+  }
+
+  auto names = args.subspan(*first_name);
+  for (auto const& name : names) {
+    if (name.empty() || core::locale::identifier_end(name, 0) != name.size()) {
+      core::standard_error().println("read: `{}': not a valid identifier", name);
+      return 2;
+    }
+  }
+
+  // A prompt printed just before has to be visible while read waits
+  [[maybe_unused]] auto _ = core::flush_output();
+
+  // Without -r, a backslash before the delimiter continues the record
+  std::string record;
+  bool        complete = false;
+  while (true) {
+    auto result = read_record(STDIN_FILENO, options, record);
+    if (!result) {
+      core::standard_error().println("read: read error: {}", std::strerror(result.error()));
+      return 1;
+    }
+    complete = *result;
+    if (options.raw_ || !complete || !ends_with_escape(record) || record.size() >= options.limit_) {
+      break;
+    }
+    record.pop_back();
+    if (options.delimiter_ != '\n') {
+      record += '\\';
+      record += options.delimiter_;
+    }
+  }
+
+  // Copied, a view into the variable store would not survive the assignments below
+  auto        ifs_value = context.get_variable("IFS");
+  std::string ifs       = ifs_value ? std::string(*ifs_value) : std::string(" \t\n");
+
+  if (options.array_) {
+    FieldSplitter            splitter{record, ifs, options.raw_};
+    std::vector<std::string> fields;
+    while (!splitter.done()) {
+      fields.push_back(splitter.next());
+    }
+    context.set_array(*options.array_, std::move(fields));
+  } else if (names.empty()) {
+    context.set_variable("REPLY", options.raw_ ? record : FieldSplitter::unescape(record));
+  } else {
+    FieldSplitter splitter{record, ifs, options.raw_};
+    for (size_t i = 0; i + 1 < names.size(); ++i) {
+      context.set_variable(names[i], splitter.done() ? std::string{} : splitter.next());
+    }
+    context.set_variable(names.back(), splitter.rest());
+  }
+
+  return complete ? 0 : 1;
+}
+
+} // namespace hsh::builtin
@@ -0,0 +1,38 @@
+module;
+
+#include <charconv>
+#include <span>
+#include <string>
+
+module hsh.builtin;
+
+import hsh.context;
+import hsh.core;
+
+namespace hsh::builtin {
+
+auto builtin_return(std::span<std::string const> args, context::Context& context, job::JobManager&) -> int {
+  if (context.frame_depth() == 0) {
+    core::standard_error().println("return: can only `return' from a function");
+    return 2;
+  }
+
+  // Without an operand the function returns the status of the last command
+  int exit_status = context.get_exit_status();
+  if (args.size() > 1) {
+    core::standard_error().println("return: too many arguments");
+    exit_status = 2;
+  } else if (!args.empty()) {
+    std::string const& arg = args[0];
+    if (auto [ptr, ec] = std::from_chars(arg.data(), arg.data() + arg.size(), exit_status);
+        ec != std::errc{} || ptr != arg.data() + arg.size()) {
+      core::standard_error().println("return: {}: numeric argument required", arg);
+      exit_status = 2;
+    }
+  }
+
+  context.request_return();
+  return exit_status & 0xff;
+}
+
+} // namespace hsh::builtin
@@ -0,0 +1,87 @@
+module;
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <format>
+#include <span>
+#include <string>
+#include <string_view>
+
+module hsh.builtin;
+
+import hsh.context;
+import hsh.core;
+
+namespace hsh::builtin {
+
+namespace {
+
+constexpr std::array<std::string_view, 1> OPTION_NAMES{"pipefail"};
+
+auto print_options(context::Context const& context, bool as_commands) -> int {
+  std::string output;
+  for (auto name : OPTION_NAMES) {
+    bool enabled = context.get_option(std::string{name});
+    if (as_commands) {
+      output += std::format("set {}o {}\n", enabled ? '-' : '+', name);
+    } else {
+      output += std::format("{:<15}\t{}\n", name, enabled ? "on" : "off");
+    }
+  }
+
+  if (auto result = core::standard_output().write(output); !result) {
+    core::standard_error().println("set: write error: {}", std::strerror(result.error()));
+    return 1;
+  }
+  return 0;
+}
+
+} // namespace
+
+auto builtin_set(std::span<std::string const> args, context::Context& context, job::JobManager&) -> int {
+  if (args.empty()) {
+    std::string output;
+    for (auto const& [name, value] : context.list_variables()) {
+      output += std::format("{}={}\n", name, value);
+    }
+    if (auto result = core::standard_output().write(output); !result) {
+      core::standard_error().println("set: write error: {}", std::strerror(result.error()));
+      return 1;
+    }
+    return 0;
+  }
+
+  for (size_t i = 0; i < args.size(); ++i) {
+    std::string const& arg = args[i];
+
+    // Everything after "--", or from the first operand on, replaces the positional parameters
+    if (arg == "--" || (arg[0] != '-' && arg[0] != '+')) {
+      size_t first = arg == "--" ? i + 1 : i;
+      context.set_positional_parameters({args.begin() + static_cast<std::ptrdiff_t>(first), args.end()});
+      return 0;
+    }
+
+    if (arg != "-o" && arg != "+o") {
+      core::standard_error().println("set: {}: invalid option", arg);
+      return 2;
+    }
+
+    bool const enable = arg[0] == '-';
+    if (i + 1 == args.size()) {
+      return print_options(context, !enable);
+    }
+
+    std::string const& name = args[++i];
+    if (!std::ranges::contains(OPTION_NAMES, name)) {
+      core::standard_error().println("set: {}: invalid option name", name);
+      return 1;
+    }
+    context.set_option(name, enable);
+  }
+
+  return 0;
+}
+
+} // namespace hsh::builtin
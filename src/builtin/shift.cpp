@@ -0,0 +1,37 @@
+module;
+
+#include <charconv>
+#include <span>
+#include <string>
+
+module hsh.builtin;
+
+import hsh.context;
+import hsh.core;
+
+namespace hsh::builtin {
+
+auto builtin_shift(std::span<std::string const> args, context::Context& context, job::JobManager&) -> int {
+  if (args.size() > 1) {
+    core::standard_error().println("shift: too many arguments");
+    return 1;
+  }
+
+  size_t count = 1;
+  if (!args.empty()) {
+    std::string const& arg = args[0];
+    if (auto [ptr, ec] = std::from_chars(arg.data(), arg.data() + arg.size(), count);
+        ec != std::errc{} || ptr != arg.data() + arg.size()) {
+      core::standard_error().println("shift: {}: numeric argument required", arg);
+      return 1;
+    }
+  }
+
+  if (!context.shift_positional_parameters(count)) {
+    core::standard_error().println("shift: shift count out of range");
+    return 1;
+  }
+  return 0;
+}
+
+} // namespace hsh::builtin
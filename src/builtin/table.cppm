@@ -0,0 +1,96 @@
+module;
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+export module hsh.builtin.table;
+
+export namespace hsh::builtin {
+
+// Builtins compiled into the shell, builtin.cpp pairs each with its function in the same order
+inline constexpr std::array<std::string_view, 19> NAMES{
+    "[",
+    "bg",
+    "cd",
+    "echo",
+    "exec",
+    "exit",
+    "export",
+    "fg",
+    "jobs",
+    "local",
+    "printf",
+    "pwd",
+    "read",
+    "return",
+    "set",
+    "shift",
+    "test",
+    "times",
+    "wait",
+};
+
+// Position of a compiled-in builtin in NAMES, small enough to be kept on every Command node
+using BuiltinIndex = std::uint8_t;
+
+inline constexpr BuiltinIndex NOT_BUILTIN = 0xff;
+
+} // namespace hsh::builtin
+
+namespace hsh::builtin {
+
+inline constexpr size_t TABLE_SIZE = 128;
+static_assert(NAMES.size() * 2 <= TABLE_SIZE, "grow TABLE_SIZE so a collision free seed stays easy to find");
+
+constexpr auto hash_name(std::string_view name, std::uint32_t seed) noexcept -> std::uint32_t {
+  std::uint32_t hash = 2166136261U ^ seed;
+  for (char c : name) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 16777619U;
+  }
+  return hash;
+}
+
+constexpr auto is_perfect(std::uint32_t seed) noexcept -> bool {
+  std::array<bool, TABLE_SIZE> used{};
+  for (auto name : NAMES) {
+    auto& slot = used[hash_name(name, seed) % TABLE_SIZE];
+    if (slot) {
+      return false;
+    }
+    slot = true;
+  }
+  return true;
+}
+
+// First seed that maps every name to its own slot, found by the compiler
+inline constexpr std::uint32_t SEED = [] {
+  std::uint32_t seed = 0;
+  while (!is_perfect(seed)) {
+    ++seed;
+  }
+  return seed;
+}();
+
+inline constexpr auto SLOTS = [] {
+  std::array<BuiltinIndex, TABLE_SIZE> slots{};
+  slots.fill(NOT_BUILTIN);
+  for (size_t i = 0; i < NAMES.size(); ++i) {
+    slots[hash_name(NAMES[i], SEED) % TABLE_SIZE] = static_cast<BuiltinIndex>(i);
+  }
+  return slots;
+}();
+
+} // namespace hsh::builtin
+
+export namespace hsh::builtin {
+
+// One hash and at most one comparison
+constexpr auto find_builtin(std::string_view name) noexcept -> BuiltinIndex {
+  BuiltinIndex index = SLOTS[hash_name(name, SEED) % TABLE_SIZE];
+  return index != NOT_BUILTIN && NAMES[index] == name ? index : NOT_BUILTIN;
+}
+
+} // namespace hsh::builtin
@@ -0,0 +1,153 @@
+module;
+
+#include <expected>
+#include <format>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+module hsh.builtin;
+
+import hsh.builtin.condition;
+import hsh.context;
+import hsh.core;
+
+namespace hsh::builtin {
+
+namespace {
+
+// Recursive descent over the arguments of test:
+//   or      := and ( -o and )*
+//   and     := not ( -a not )*
+//   not     := ! not | primary
+//   primary := ( or ) | unary operand | operand binary operand | operand
+class TestParser {
+  std::span<std::string const> args_;
+  size_t                       pos_ = 0;
+  context::Context&            context_;
+  StatCache                    cache_;
+
+public:
+  TestParser(std::span<std::string const> args, context::Context& context)
+      : args_(args), context_(context) {}
+
+  auto evaluate() -> core::Result<bool> {
+    if (args_.empty()) {
+      return false;
+    }
+    auto result = parse_or();
+    if (result && pos_ < args_.size()) {
+      return std::unexpected(std::format("{}: unexpected argument", args_[pos_]));
+    }
+    return result;
+  }
+
+private:
+  [[nodiscard]] auto remaining() const noexcept -> size_t {
+    return args_.size() - pos_;
+  }
+
+  [[nodiscard]] auto binary_at(size_t index) const noexcept -> std::optional<TestOperator> {
+    if (index >= args_.size()) {
+      return std::nullopt;
+    }
+    auto op = find_binary_operator(args_[index]);
+    return op == TestOperator::Matches ? std::nullopt : op;
+  }
+
+  auto parse_or() -> core::Result<bool> {
+    auto left = parse_and();
+    while (left && pos_ < args_.size() && args_[pos_] == "-o") {
+      ++pos_;
+      auto right = parse_and();
+      if (!right) {
+        return right;
+      }
+      left = *left || *right;
+    }
+    return left;
+  }
+
+  auto parse_and() -> core::Result<bool> {
+    auto left = parse_not();
+    while (left && pos_ < args_.size() && args_[pos_] == "-a") {
+      ++pos_;
+      auto right = parse_not();
+      if (!right) {
+        return right;
+      }
+      left = *left && *right;
+    }
+    return left;
+  }
+
+  auto parse_not() -> core::Result<bool> {
+    // `! = x` compares the string "!", a lone `!` is a non-empty string
+    if (remaining() >= 2 && args_[pos_] == "!" && !binary_at(pos_ + 1)) {
+      ++pos_;
+      auto result = parse_not();
+      if (!result) {
+        return result;
+      }
+      return !*result;
+    }
+    return parse_primary();
+  }
+
+  auto parse_primary() -> core::Result<bool> {
+    if (remaining() == 0) {
+      return std::unexpected(std::string("argument expected"));
+    }
+
+    auto const& arg = args_[pos_];
+    if (remaining() >= 3) {
+      if (auto op = binary_at(pos_ + 1)) {
+        pos_ += 3;
+        return test_binary(*op, arg, args_[pos_ - 1], cache_);
+      }
+    }
+    if (arg == "(" && remaining() >= 2) {
+      ++pos_;
+      auto result = parse_or();
+      if (result && (pos_ >= args_.size() || args_[pos_] != ")")) {
+        return std::unexpected(std::string("')' expected"));
+      }
+      ++pos_;
+      return result;
+    }
+    if (remaining() >= 2) {
+      if (auto op = find_unary_operator(arg)) {
+        pos_ += 2;
+        return test_unary(*op, args_[pos_ - 1], cache_, context_);
+      }
+    }
+    ++pos_;
+    return !arg.empty();
+  }
+};
+
+auto run_test(std::string_view name, std::span<std::string const> args, context::Context& context) -> int {
+  auto result = TestParser{args, context}.evaluate();
+  if (!result) {
+    core::standard_error().println("{}: {}", name, result.error());
+    return 2;
+  }
+  return *result ? 0 : 1;
+}
+
+} // namespace
+
+auto builtin_test(std::span<std::string const> args, context::Context& context, job::JobManager&) -> int {
+  return run_test("test", args, context);
+}
+
+auto builtin_bracket(std::span<std::string const> args, context::Context& context, job::JobManager&) -> int {
+  if (args.empty() || args.back() != "]") {
+    core::standard_error().println("[: missing `]'");
+    return 2;
+  }
+  return run_test("[", args.first(args.size() - 1), context);
+}
+
+} // namespace hsh::builtin
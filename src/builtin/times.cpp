@@ -0,0 +1,44 @@
+module;
+
+#include <cstring>
+#include <format>
+#include <span>
+#include <string>
+
+#include <sys/resource.h>
+
+module hsh.builtin;
+
+import hsh.context;
+import hsh.core;
+
+namespace hsh::builtin {
+
+auto builtin_times(std::span<std::string const> args, context::Context&, job::JobManager&) -> int {
+  if (!args.empty()) {
+    core::standard_error().println("times: too many arguments");
+    return 1;
+  }
+
+  rusage self{};
+  rusage children{};
+  getrusage(RUSAGE_SELF, &self);
+  getrusage(RUSAGE_CHILDREN, &children);
+
+  // shell user and system time, then the same for all reaped children
+  auto result = core::standard_output().print(
+      "{} {}\n{} {}\n",
+      core::util::format_duration(core::util::to_duration(self.ru_utime)),
+      core::util::format_duration(core::util::to_duration(self.ru_stime)),
+      core::util::format_duration(core::util::to_duration(children.ru_utime)),
+      core::util::format_duration(core::util::to_duration(children.ru_stime))
+  );
+  if (!result) {
+    core::standard_error().println("times: write error: {}", std::strerror(result.error()));
+    return 1;
+  }
+
+  return 0;
+}
+
+} // namespace hsh::builtin
@@ -5,10 +5,14 @@ module;
 #include <charconv>
 #include <cstring>
 #include <format>
+#include <memory>
 #include <optional>
+#include <ranges>
+#include <span>
 #include <string>
 #include <string_view>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include <pwd.h>
@@ -20,33 +24,24 @@ import hsh.core;
 
 namespace hsh::context {
 
-auto Context::get_variable(std::string const& name) -> std::optional<std::string_view> {
-  if (auto special = get_special_parameter(name)) {
-    special_param_cache_[name] = *special;
-    return special_param_cache_[name];
-  }
-
-  if (auto it = local_variables_.find(name); it != local_variables_.end()) {
-    return it->second;
-  }
+auto Context::get_variable(std::string_view name) -> std::optional<std::string_view> {
+  return lookup_variable(SymbolTable::instance().find(name), name);
+}
 
-  return core::env::get(name);
+auto Context::get_variable(Symbol symbol) -> std::optional<std::string_view> {
+  return lookup_variable(symbol, SymbolTable::instance().name(symbol));
 }
 
-void Context::unset_variable(std::string const& name) {
-  local_variables_.erase(name);
+void Context::unset_variable(std::string_view name) {
+  variables_.unset(name);
   core::env::unset(name);
 }
 
 auto Context::list_variables() const -> std::vector<std::pair<std::string_view, std::string_view>> {
-  auto result = std::vector<std::pair<std::string_view, std::string_view>>{};
-
-  for (auto const& [name, value] : local_variables_) {
-    result.emplace_back(name, value);
-  }
+  auto result = variables_.list();
 
   for (auto const& [name, value] : core::env::list()) {
-    if (!local_variables_.contains(std::string{name})) {
+    if (!variables_.contains(name)) {
       result.emplace_back(name, value);
     }
   }
@@ -54,26 +49,38 @@ auto Context::list_variables() const -> std::vector<std::pair<std::string_view,
   return result;
 }
 
-auto Context::is_exported(std::string const& name) const -> bool {
-  return !local_variables_.contains(name) && core::env::get(name).has_value();
+auto Context::is_exported(std::string_view name) const -> bool {
+  return !variables_.contains(name) && core::env::get(name).has_value();
+}
+
+void Context::set_array(std::string name, std::vector<std::string> values) {
+  variables_.set_array(std::move(name), std::move(values));
+}
+
+auto Context::get_array(std::string_view name) const -> std::optional<std::span<std::string const>> {
+  return variables_.get_array(name);
+}
+
+void Context::unset_array(std::string_view name) {
+  variables_.unset_array(name);
 }
 
 auto Context::get_alias(std::string const& name) const -> std::optional<std::string_view> {
-  if (auto it = aliases_.find(name); it != aliases_.end()) {
+  if (auto it = aliases_->find(name); it != aliases_->end()) {
     return it->second;
   }
   return std::nullopt;
 }
 
 void Context::unset_alias(std::string const& name) {
-  aliases_.erase(name);
+  unshare(aliases_).erase(name);
 }
 
 auto Context::list_aliases() const -> std::vector<std::pair<std::string_view, std::string_view>> {
   auto result = std::vector<std::pair<std::string_view, std::string_view>>{};
-  result.reserve(aliases_.size());
+  result.reserve(aliases_->size());
 
-  for (auto const& [name, value] : aliases_) {
+  for (auto const& [name, value] : *aliases_) {
     result.emplace_back(name, value);
   }
 
@@ -81,7 +88,7 @@ auto Context::list_aliases() const -> std::vector<std::pair<std::string_view, st
 }
 
 auto Context::get_option(std::string const& name) const -> bool {
-  if (auto it = options_.find(name); it != options_.end()) {
+  if (auto it = options_->find(name); it != options_->end()) {
     return it->second;
   }
   return false;
@@ -121,83 +128,61 @@ auto Context::get_exit_status() const noexcept -> int {
 }
 
 void Context::set_exit_status(int status) {
-  exit_status_ = status;
-  special_param_cache_.erase("?");
+  if (status != exit_status_) {
+    exit_status_ = status;
+    exit_status_text_.assign(status);
+  }
 }
 
-auto Context::get_special_parameter(std::string const& name) const -> std::optional<std::string> {
+auto Context::get_special_parameter(std::string_view name) const -> std::optional<std::string_view> {
+  if (name.empty()) {
+    return std::nullopt;
+  }
+
   if (name.size() == 1) {
     switch (name[0]) {
-      case '?': {
-        return std::to_string(exit_status_);
-      }
-      case '$': {
-        return std::to_string(shell_pid_ == 0 ? core::syscall::get_pid() : shell_pid_);
-      }
-      case '!': {
-        return last_bg_pid_ == 0 ? std::optional<std::string>{} : std::to_string(last_bg_pid_);
-      }
-      case '0': {
-        return std::string{script_name_};
-      }
-      case '#': {
-        return std::to_string(positional_parameters_.size());
-      }
-      case '*': {
-        if (positional_parameters_.empty()) {
-          return "";
-        }
-        std::string result;
-        for (size_t i = 0; i < positional_parameters_.size(); ++i) {
-          if (i > 0) {
-            result += " ";
-          }
-          result += positional_parameters_[i];
+      case '?': return exit_status_text_.view();
+      case '#': return positional_count_text_.view();
+      case '$':
+        if (shell_pid_ == 0) {
+          shell_pid_text_.assign(core::syscall::get_pid());
         }
-        return result;
-      }
-      case '@': {
-        // For $@, we return space-separated like $* for now
-        // In actual shell expansion, $@ and $* behave differently in quotes
-        if (positional_parameters_.empty()) {
-          return "";
+        return shell_pid_text_.view();
+      case '!':
+        if (last_bg_pid_ == 0) {
+          return std::nullopt;
         }
-        std::string result;
-        for (size_t i = 0; i < positional_parameters_.size(); ++i) {
-          if (i > 0) {
-            result += " ";
+        return last_bg_pid_text_.view();
+      case '*':
+      case '@':
+        // Joined for uses inside a larger word, a whole "$@" word is spliced by the expander instead
+        if (!joined_positional_) {
+          joined_positional_.emplace();
+          auto parameters = get_positional_parameters();
+          for (size_t i = 0; i < parameters.size(); ++i) {
+            if (i > 0) {
+              *joined_positional_ += ' ';
+            }
+            *joined_positional_ += parameters[i];
           }
-          result += positional_parameters_[i];
         }
-        return result;
-      }
-      default: {
-        if ('1' <= name[0] && name[0] <= '9') {
-          if (size_t index = name[0] - '1'; index < positional_parameters_.size()) {
-            return positional_parameters_[index];
-          }
-          return "";
-        }
-        break;
-      }
+        return *joined_positional_;
+      default: break;
     }
   }
 
-  if (!name.empty()) {
-    size_t index = 0;
-    if (auto [ptr, ec] = std::from_chars(name.data(), name.data() + name.size(), index);
-        ec == std::errc{} && ptr == name.data() + name.size()) {
-      if (index == 0) {
-        return std::string{script_name_};
-      }
-      if (index - 1 < positional_parameters_.size()) {
-        return positional_parameters_[index - 1];
-      }
-      return "";
-    }
+  size_t index = 0;
+  if (auto [ptr, ec] = std::from_chars(name.data(), name.data() + name.size(), index);
+      ec != std::errc{} || ptr != name.data() + name.size()) {
+    return std::nullopt;
   }
-
-  return std::nullopt;
+  if (index == 0) {
+    return script_name_;
+  }
+  if (auto parameters = get_positional_parameters(); index - 1 < parameters.size()) {
+    return parameters[index - 1];
+  }
+  return std::string_view{};
 }
 
 void Context::set_positional_parameter(size_t index, std::string value) {
@@ -206,39 +191,47 @@ void Context::set_positional_parameter(size_t index, std::string value) {
     return;
   }
 
-  // Resize vector if necessary (index is 1-based)
-  if (index > positional_parameters_.size()) {
-    positional_parameters_.resize(index);
+  // Copy the visible window, resized if necessary (index is 1-based)
+  auto                     current = get_positional_parameters();
+  std::vector<std::string> params(current.begin(), current.end());
+  if (index > params.size()) {
+    params.resize(index);
   }
-  positional_parameters_[index - 1] = std::move(value);
+  params[index - 1] = std::move(value);
+  set_positional_parameters(std::move(params));
 }
 
 void Context::set_positional_parameters(std::vector<std::string> params) {
-  positional_parameters_ = std::move(params);
-  special_param_cache_.erase("#");
-  special_param_cache_.erase("*");
-  special_param_cache_.erase("@");
-  for (auto it = special_param_cache_.begin(); it != special_param_cache_.end();) {
-    if (!it->first.empty() && std::ranges::all_of(it->first, [](char c) { return '0' <= c && c <= '9'; })) {
-      it = special_param_cache_.erase(it);
-    } else {
-      ++it;
-    }
-  }
+  positional_parameters_ = std::make_shared<std::vector<std::string> const>(std::move(params));
+  positional_offset_     = 0;
+  positional_parameters_changed();
 }
 
 auto Context::get_positional_parameter(size_t index) const -> std::optional<std::string_view> {
   if (index == 0) {
     return script_name_;
   }
-  if (index - 1 < positional_parameters_.size()) {
-    return positional_parameters_[index - 1];
+  if (auto parameters = get_positional_parameters(); index - 1 < parameters.size()) {
+    return parameters[index - 1];
   }
   return std::nullopt;
 }
 
 auto Context::get_positional_count() const noexcept -> size_t {
-  return positional_parameters_.size();
+  return positional_parameters_->size() - positional_offset_;
+}
+
+auto Context::get_positional_parameters() const noexcept -> std::span<std::string const> {
+  return std::span{*positional_parameters_}.subspan(positional_offset_);
+}
+
+auto Context::shift_positional_parameters(size_t count) -> bool {
+  if (count > get_positional_count()) {
+    return false;
+  }
+  positional_offset_ += count;
+  positional_parameters_changed();
+  return true;
 }
 
 void Context::set_script_name(std::string name) {
@@ -251,6 +244,7 @@ auto Context::get_script_name() const noexcept -> std::string_view {
 
 void Context::set_shell_pid(int pid) {
   shell_pid_ = pid;
+  shell_pid_text_.assign(pid);
 }
 
 auto Context::get_shell_pid() const -> int {
@@ -259,24 +253,116 @@ auto Context::get_shell_pid() const -> int {
 
 void Context::set_last_background_pid(int pid) {
   last_bg_pid_ = pid;
-  special_param_cache_.erase("!");
+  last_bg_pid_text_.assign(pid);
 }
 
 auto Context::get_last_background_pid() const noexcept -> int {
   return last_bg_pid_;
 }
 
+void Context::push_frame(std::vector<std::string> arguments) {
+  frames_.push_back(Frame{std::move(positional_parameters_), positional_offset_, {}});
+  set_positional_parameters(std::move(arguments));
+}
+
+void Context::pop_frame() {
+  auto& frame = frames_.back();
+  for (auto& local : frame.locals_ | std::views::reverse) {
+    unset_variable(local.name_);
+    if (local.value_ && local.exported_) {
+      export_variable(std::move(local.name_), std::move(*local.value_));
+    } else if (local.value_) {
+      set_variable(std::move(local.name_), std::move(*local.value_));
+    }
+  }
+
+  positional_parameters_ = std::move(frame.positional_parameters_);
+  positional_offset_     = frame.positional_offset_;
+  positional_parameters_changed();
+
+  frames_.pop_back();
+  returning_ = false;
+}
+
+auto Context::frame_depth() const noexcept -> size_t {
+  return frames_.size();
+}
+
+auto Context::declare_local(std::string_view name) -> bool {
+  if (frames_.empty()) {
+    return false;
+  }
+
+  // Only the first declaration in a frame remembers the caller's value
+  auto& locals = frames_.back().locals_;
+  if (!std::ranges::contains(locals, name, &Frame::Local::name_)) {
+    // Copied, the view does not survive the unset below
+    auto previous = get_variable(name);
+    locals.push_back(Frame::Local{
+        std::string{name},
+        previous ? std::optional<std::string>{*previous} : std::nullopt,
+        is_exported(name),
+    });
+  }
+  unset_variable(name);
+  return true;
+}
+
+void Context::request_return() noexcept {
+  returning_ = true;
+}
+
+auto Context::returning() const noexcept -> bool {
+  return returning_;
+}
+
 auto Context::create_scope() const -> Context {
   Context scope;
 
-  scope.options_     = options_;
-  scope.exit_status_ = exit_status_;
+  scope.variables_ = variables_.child();
+  scope.aliases_   = aliases_;
+  scope.options_   = options_;
+
+  scope.positional_parameters_ = positional_parameters_;
+  scope.positional_offset_     = positional_offset_;
+  scope.positional_parameters_changed();
+  scope.script_name_ = script_name_;
+  scope.set_shell_pid(shell_pid_);
+  scope.set_last_background_pid(last_bg_pid_);
+  scope.set_exit_status(exit_status_);
 
   return scope;
 }
 
 void Context::merge_scope(Context const& scope) {
-  exit_status_ = scope.exit_status_;
+  set_exit_status(scope.exit_status_);
+}
+
+void Context::positional_parameters_changed() {
+  positional_count_text_.assign(static_cast<long>(get_positional_count()));
+  joined_positional_.reset();
+}
+
+auto Context::lookup_variable(std::optional<Symbol> symbol, std::string_view name) -> std::optional<std::string_view> {
+  // Ordinary names start with a letter or underscore and never reach the special parameters
+  if (!name.empty() && !core::locale::is_alpha_u(name[0])) {
+    if (auto special = get_special_parameter(name)) {
+      return special;
+    }
+  }
+
+  if (symbol) {
+    if (auto const* value = variables_.get(*symbol)) {
+      return *value;
+    }
+  }
+
+  // An array referenced without a subscript expands to its first element
+  if (auto values = variables_.get_array(name)) {
+    return values->empty() ? std::string_view{} : std::string_view{values->front()};
+  }
+
+  return core::env::get(name);
 }
 
 void Context::refresh_pwd_cache() {
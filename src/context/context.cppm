@@ -1,6 +1,11 @@
 module;
 
+#include <array>
+#include <charconv>
+#include <cstdint>
+#include <memory>
 #include <optional>
+#include <span>
 #include <string>
 #include <string_view>
 #include <unordered_map>
@@ -10,25 +15,71 @@ module;
 export module hsh.context;
 
 import hsh.core;
+export import hsh.context.symbol;
+export import hsh.context.variable_store;
 
 export namespace hsh::context {
 
+// Decimal text of an integer special parameter, rewritten only when the value changes
+class NumberText {
+  std::array<char, 24> digits_{'0'};
+  std::uint8_t         size_ = 1;
+
+public:
+  void assign(long value) noexcept {
+    auto [ptr, ec] = std::to_chars(digits_.data(), digits_.data() + digits_.size(), value);
+    size_          = static_cast<std::uint8_t>(ptr - digits_.data());
+  }
+  [[nodiscard]] auto view() const noexcept -> std::string_view {
+    return {digits_.data(), size_};
+  }
+};
+
+// State a function call replaces, restored when it returns
+struct Frame {
+  // A variable declared local and the value it shadows
+  struct Local {
+    std::string                name_;
+    std::optional<std::string> value_;
+    bool                       exported_;
+  };
+
+  std::shared_ptr<std::vector<std::string> const> positional_parameters_;
+  size_t                                          positional_offset_;
+  std::vector<Local>                              locals_;
+};
+
 class Context {
-  std::unordered_map<std::string, std::string> local_variables_;
-  std::unordered_map<std::string, std::string> aliases_;
-  std::unordered_map<std::string, bool>        options_;
-  std::optional<std::string>                   cwd_cache_;
-  std::optional<std::string>                   user_cache_;
-  std::optional<std::string>                   host_cache_;
+  using Aliases = std::unordered_map<std::string, std::string>;
+  using Options = std::unordered_map<std::string, bool>;
 
-  // Special parameters
-  std::vector<std::string> positional_parameters_;
-  std::string              script_name_ = core::constant::EXE_NAME;
-  int                      shell_pid_   = 0;
-  int                      last_bg_pid_ = 0;
-  int                      exit_status_ = 0;
+  VariableStore variables_;
+  // Shared with scopes and copied by whichever side changes them first
+  std::shared_ptr<Aliases>   aliases_ = std::make_shared<Aliases>();
+  std::shared_ptr<Options>   options_ = std::make_shared<Options>();
+  std::optional<std::string> cwd_cache_;
+  std::optional<std::string> user_cache_;
+  std::optional<std::string> host_cache_;
 
-  std::unordered_map<std::string, std::string> special_param_cache_;
+  // Special parameters
+  // $1... are a window starting at positional_offset_, so shift only moves the offset. The vector is shared with
+  // scopes and replaced rather than modified.
+  std::shared_ptr<std::vector<std::string> const> positional_parameters_ =
+      std::make_shared<std::vector<std::string> const>();
+  size_t      positional_offset_ = 0;
+  std::string script_name_       = core::constant::EXE_NAME;
+  int         shell_pid_         = 0;
+  int         last_bg_pid_       = 0;
+  int         exit_status_       = 0;
+
+  NumberText                         exit_status_text_;      // $?
+  NumberText                         positional_count_text_; // $#
+  NumberText                         last_bg_pid_text_;      // $!
+  mutable NumberText                 shell_pid_text_;        // $$
+  mutable std::optional<std::string> joined_positional_;     // $* and $@, joined on first use
+
+  std::vector<Frame> frames_;
+  bool               returning_ = false;
 
 public:
   Context()  = default;
@@ -40,21 +91,31 @@ public:
   Context& operator=(Context&&)      = default;
 
   // === Variable ===
-  auto get_variable(std::string const& name) -> std::optional<std::string_view>;
+  // The view is only valid until the next assignment or unset of any variable, copy it to keep it longer
+  auto get_variable(std::string_view name) -> std::optional<std::string_view>;
+  auto get_variable(Symbol symbol) -> std::optional<std::string_view>;
   template<typename N, typename V>
   void set_variable(N&& name, V&& value);
   template<typename N, typename V>
   void export_variable(N&& name, V&& value);
-  void unset_variable(std::string const& name);
+  void unset_variable(std::string_view name);
   auto list_variables() const -> std::vector<std::pair<std::string_view, std::string_view>>;
-  auto is_exported(std::string const& name) const -> bool;
+  auto is_exported(std::string_view name) const -> bool;
+
+  // === Array ===
+  void set_array(std::string name, std::vector<std::string> values);
+  auto get_array(std::string_view name) const -> std::optional<std::span<std::string const>>;
+  void unset_array(std::string_view name);
 
   // === Special Parameters ===
-  auto get_special_parameter(std::string const& name) const -> std::optional<std::string>;
+  auto get_special_parameter(std::string_view name) const -> std::optional<std::string_view>;
   void set_positional_parameter(size_t index, std::string value);
   void set_positional_parameters(std::vector<std::string> params);
   auto get_positional_parameter(size_t index) const -> std::optional<std::string_view>;
   auto get_positional_count() const noexcept -> size_t;
+  auto get_positional_parameters() const noexcept -> std::span<std::string const>;
+  // Drops the first count positional parameters, fails without changing anything if there are fewer
+  auto shift_positional_parameters(size_t count) -> bool;
   void set_script_name(std::string name);
   auto get_script_name() const noexcept -> std::string_view;
   void set_shell_pid(int pid);
@@ -86,40 +147,66 @@ public:
   auto get_exit_status() const noexcept -> int;
   void set_exit_status(int status);
 
+  // === Function Frames ===
+  // A call swaps in its arguments as the positional parameters, the caller's come back when the frame is popped,
+  // together with every variable the function declared local
+  void push_frame(std::vector<std::string> arguments);
+  void pop_frame();
+  auto frame_depth() const noexcept -> size_t;
+  // Unsets name until the innermost frame is popped, false outside of a function
+  auto declare_local(std::string_view name) -> bool;
+  // Set by return, the runner stops executing statements until the frame is popped
+  void request_return() noexcept;
+  auto returning() const noexcept -> bool;
+
   // === Context Scoping ===
+  // A scope sees every variable of this context, its own changes are dropped with it. Only the exit status is merged.
   auto create_scope() const -> Context;
   void merge_scope(Context const& scope);
 
 private:
+  auto lookup_variable(std::optional<Symbol> symbol, std::string_view name) -> std::optional<std::string_view>;
   void refresh_pwd_cache();
   void refresh_user_cache();
   void refresh_host_cache();
+  void positional_parameters_changed();
+  template<typename T>
+  static auto unshare(std::shared_ptr<T>& shared) -> T&;
 };
 
 // TODO typename CharT
 template<typename N, typename V>
 void Context::set_variable(N&& name, V&& value) {
-  if constexpr (std::is_same_v<std::decay_t<N>, std::string_view>) {
-    local_variables_.insert_or_assign(std::string{std::forward<N>(name)}, std::forward<V>(value));
-  } else {
-    local_variables_.insert_or_assign(std::forward<N>(name), std::forward<V>(value));
+  // Assigning to an exported variable keeps it exported
+  if (is_exported(std::string_view{name})) {
+    core::env::set(std::string(std::forward<N>(name)), std::string(std::forward<V>(value)));
+    return;
   }
+  variables_.set(std::forward<N>(name), std::forward<V>(value));
 }
 
 template<typename N, typename V>
 void Context::export_variable(N&& name, V&& value) {
-  local_variables_.erase(std::string(name));
+  variables_.unset(std::string_view{name});
   core::env::set(std::forward<N>(name), std::forward<V>(value));
 }
 
 template<typename N, typename V>
 void Context::set_alias(N&& name, V&& value) {
-  aliases_.insert_or_assign(std::forward<N>(name), std::forward<V>(value));
+  unshare(aliases_).insert_or_assign(std::forward<N>(name), std::forward<V>(value));
 }
 
 template<typename N>
 void Context::set_option(N&& name, bool value) {
-  options_.insert_or_assign(std::forward<N>(name), value);
+  unshare(options_).insert_or_assign(std::forward<N>(name), value);
+}
+
+template<typename T>
+auto Context::unshare(std::shared_ptr<T>& shared) -> T& {
+  if (shared.use_count() > 1) {
+    shared = std::make_shared<T>(*shared);
+  }
+  return *shared;
 }
 
 } // namespace hsh::context
@@ -0,0 +1,43 @@
+module;
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+module hsh.context.symbol;
+
+import hsh.core;
+
+namespace hsh::context {
+
+auto SymbolTable::instance() -> SymbolTable& {
+  static SymbolTable table;
+  return table;
+}
+
+auto SymbolTable::intern(std::string_view name) -> Symbol {
+  if (auto const* symbol = ids_.get(name)) {
+    return *symbol;
+  }
+  auto symbol = static_cast<Symbol>(names_.size());
+  names_.emplace_back(name);
+  ids_.insert_or_assign(name, symbol);
+  return symbol;
+}
+
+auto SymbolTable::find(std::string_view name) const -> std::optional<Symbol> {
+  if (auto const* symbol = ids_.get(name)) {
+    return *symbol;
+  }
+  return std::nullopt;
+}
+
+auto SymbolTable::name(Symbol symbol) const -> std::string_view {
+  return symbol < names_.size() ? std::string_view{names_[symbol]} : std::string_view{};
+}
+
+auto SymbolTable::size() const noexcept -> size_t {
+  return names_.size();
+}
+
+} // namespace hsh::context
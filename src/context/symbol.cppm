@@ -0,0 +1,38 @@
+module;
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+
+export module hsh.context.symbol;
+
+import hsh.core;
+
+export namespace hsh::context {
+
+// Dense id of an interned variable name, usable as an index into per-scope slot tables
+using Symbol = std::uint32_t;
+
+// Process wide table of variable names. Names are interned once when a word is parsed, so evaluating a reference later
+// is an array index instead of scanning, copying and hashing the name again. Ids are never reused.
+class SymbolTable {
+  core::FlatMap<Symbol>   ids_;
+  std::deque<std::string> names_; // a deque keeps the views handed out by name() valid
+
+  SymbolTable() = default;
+
+public:
+  SymbolTable(SymbolTable const&)            = delete;
+  SymbolTable& operator=(SymbolTable const&) = delete;
+
+  static auto instance() -> SymbolTable&;
+
+  auto               intern(std::string_view name) -> Symbol;
+  [[nodiscard]] auto find(std::string_view name) const -> std::optional<Symbol>;
+  [[nodiscard]] auto name(Symbol symbol) const -> std::string_view;
+  [[nodiscard]] auto size() const noexcept -> size_t;
+};
+
+} // namespace hsh::context
@@ -0,0 +1,163 @@
+module;
+
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+module hsh.context.variable_store;
+
+import hsh.core;
+import hsh.context.symbol;
+
+namespace hsh::context {
+
+auto VariableStore::child() const -> VariableStore {
+  VariableStore scope;
+  scope.top_->parent_ = top_;
+  scope.top_->depth_  = top_->depth_ + 1;
+  return scope;
+}
+
+auto VariableStore::get(Symbol symbol) const -> std::string const* {
+  for (Layer const* layer = top_.get(); layer != nullptr; layer = layer->parent_.get()) {
+    if (symbol >= layer->scalars_.size()) {
+      continue;
+    }
+    auto const& entry = layer->scalars_[symbol];
+    if (entry.state_ != Slot::State::Absent) {
+      return entry.state_ == Slot::State::Set ? &entry.value_ : nullptr;
+    }
+  }
+  return nullptr;
+}
+
+auto VariableStore::get(std::string_view name) const -> std::string const* {
+  // A name that was never interned cannot have been set
+  auto symbol = SymbolTable::instance().find(name);
+  return symbol ? get(*symbol) : nullptr;
+}
+
+auto VariableStore::contains(std::string_view name) const -> bool {
+  return get(name) != nullptr;
+}
+
+void VariableStore::set(Symbol symbol, std::string value) {
+  auto& entry  = slot(writable(), symbol);
+  entry.state_ = Slot::State::Set;
+  entry.value_ = std::move(value);
+}
+
+void VariableStore::unset(Symbol symbol) {
+  auto& layer = writable();
+  if (layer.parent_ == nullptr && symbol >= layer.scalars_.size()) {
+    return;
+  }
+  auto& entry  = slot(layer, symbol);
+  entry.state_ = layer.parent_ == nullptr ? Slot::State::Absent : Slot::State::Hidden;
+  entry.value_.clear();
+}
+
+void VariableStore::unset(std::string_view name) {
+  if (auto symbol = SymbolTable::instance().find(name)) {
+    unset(*symbol);
+  }
+}
+
+auto VariableStore::list() const -> std::vector<std::pair<std::string_view, std::string_view>> {
+  std::vector<std::pair<std::string_view, std::string_view>> result;
+  std::vector<bool>                                          seen;
+
+  auto const& symbols = SymbolTable::instance();
+  for (Layer const* layer = top_.get(); layer != nullptr; layer = layer->parent_.get()) {
+    seen.resize(std::max(seen.size(), layer->scalars_.size()));
+    for (Symbol symbol = 0; symbol < layer->scalars_.size(); ++symbol) {
+      auto const& entry = layer->scalars_[symbol];
+      if (entry.state_ == Slot::State::Absent || seen[symbol]) {
+        continue;
+      }
+      seen[symbol] = true;
+      if (entry.state_ == Slot::State::Set) {
+        result.emplace_back(symbols.name(symbol), entry.value_);
+      }
+    }
+  }
+
+  return result;
+}
+
+auto VariableStore::get_array(std::string_view name) const -> std::optional<std::span<std::string const>> {
+  for (Layer const* layer = top_.get(); layer != nullptr; layer = layer->parent_.get()) {
+    if (auto const* entry = layer->arrays_.get(name)) {
+      if (!entry->has_value()) {
+        return std::nullopt;
+      }
+      return **entry;
+    }
+  }
+  return std::nullopt;
+}
+
+void VariableStore::set_array(std::string name, std::vector<std::string> values) {
+  writable().arrays_.insert_or_assign(std::move(name), std::optional{std::move(values)});
+}
+
+void VariableStore::unset_array(std::string_view name) {
+  auto& layer = writable();
+  if (layer.parent_ == nullptr) {
+    layer.arrays_.erase(name);
+  } else {
+    layer.arrays_.insert_or_assign(name, std::nullopt);
+  }
+}
+
+auto VariableStore::slot(Layer& layer, Symbol symbol) -> Slot& {
+  if (symbol >= layer.scalars_.size()) {
+    layer.scalars_.resize(symbol + 1);
+  }
+  return layer.scalars_[symbol];
+}
+
+auto VariableStore::writable() -> Layer& {
+  if (top_.use_count() > 1) {
+    // A child scope still reads this layer, leave it as it is
+    auto frozen   = std::move(top_);
+    top_          = std::make_shared<Layer>();
+    top_->depth_  = frozen->depth_ + 1;
+    top_->parent_ = std::move(frozen);
+  }
+
+  if (top_->depth_ > MAX_DEPTH) {
+    // The nearest entry wins. Nothing is below the flattened layer, so hidden entries only shadow until the end.
+    auto flat = std::make_shared<Layer>();
+    for (Layer const* layer = top_.get(); layer != nullptr; layer = layer->parent_.get()) {
+      for (Symbol symbol = 0; symbol < layer->scalars_.size(); ++symbol) {
+        auto const& entry    = layer->scalars_[symbol];
+        bool        shadowed = symbol < flat->scalars_.size() && flat->scalars_[symbol].state_ != Slot::State::Absent;
+        if (entry.state_ != Slot::State::Absent && !shadowed) {
+          slot(*flat, symbol) = entry;
+        }
+      }
+      for (auto const& [name, values] : layer->arrays_) {
+        if (!flat->arrays_.contains(name)) {
+          flat->arrays_.insert_or_assign(name, values);
+        }
+      }
+    }
+    for (auto& entry : flat->scalars_) {
+      if (entry.state_ == Slot::State::Hidden) {
+        entry = Slot{};
+      }
+    }
+    flat->arrays_.erase_if([](auto const& entry) { return !entry.second.has_value(); });
+    top_ = std::move(flat);
+  }
+
+  return *top_;
+}
+
+} // namespace hsh::context
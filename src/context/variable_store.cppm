@@ -0,0 +1,79 @@
+module;
+
+#include <concepts>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+export module hsh.context.variable_store;
+
+import hsh.core;
+import hsh.context.symbol;
+
+export namespace hsh::context {
+
+// Shell variables of one scope. A child scope is an empty overlay on its parent, so creating one is O(1), lookups fall
+// through the chain of layers and writes only touch the top layer. A layer still read by a child is frozen: the owner
+// stacks a fresh layer on top before writing, which keeps every scope an isolated snapshot. Scalars live in slots indexed
+// by their interned Symbol.
+class VariableStore {
+  template<typename T>
+  using Entries = core::FlatMap<std::optional<T>>; // nullopt hides the value of a parent layer
+
+  struct Slot {
+    enum struct State : std::uint8_t {
+      Absent, // look further down the chain
+      Set,
+      Hidden, // unset in this layer, hides the value of a parent layer
+    };
+    State       state_ = State::Absent;
+    std::string value_;
+  };
+
+  struct Layer {
+    std::vector<Slot>                 scalars_; // indexed by Symbol, grown on write
+    Entries<std::vector<std::string>> arrays_;
+    std::shared_ptr<Layer const>      parent_;
+    size_t                            depth_ = 0;
+  };
+
+  // Chains longer than this are collapsed into a single layer on the next write
+  static constexpr size_t MAX_DEPTH = 16;
+
+  std::shared_ptr<Layer> top_ = std::make_shared<Layer>();
+
+public:
+  [[nodiscard]] auto child() const -> VariableStore;
+
+  [[nodiscard]] auto get(Symbol symbol) const -> std::string const*;
+  [[nodiscard]] auto get(std::string_view name) const -> std::string const*;
+  [[nodiscard]] auto contains(std::string_view name) const -> bool;
+  void               set(Symbol symbol, std::string value);
+  template<typename N, typename V>
+    requires std::convertible_to<N, std::string_view>
+  void set(N&& name, V&& value);
+  void unset(Symbol symbol);
+  void unset(std::string_view name);
+  [[nodiscard]] auto list() const -> std::vector<std::pair<std::string_view, std::string_view>>;
+
+  [[nodiscard]] auto get_array(std::string_view name) const -> std::optional<std::span<std::string const>>;
+  void               set_array(std::string name, std::vector<std::string> values);
+  void               unset_array(std::string_view name);
+
+private:
+  static auto slot(Layer& layer, Symbol symbol) -> Slot&;
+  auto        writable() -> Layer&;
+};
+
+template<typename N, typename V>
+  requires std::convertible_to<N, std::string_view>
+void VariableStore::set(N&& name, V&& value) {
+  set(SymbolTable::instance().intern(std::string_view{name}), std::string(std::forward<V>(value)));
+}
+
+} // namespace hsh::context
@@ -3,7 +3,9 @@ export module hsh.core;
 export import hsh.core.constant;
 export import hsh.core.env;
 export import hsh.core.file_descriptor;
+export import hsh.core.flat_map;
 export import hsh.core.locale;
+export import hsh.core.output;
 export import hsh.core.result;
 export import hsh.core.signal;
 export import hsh.core.syscall;
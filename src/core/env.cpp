@@ -1,11 +1,12 @@
 module;
 
+#include <algorithm>
 #include <array>
-#include <cstdlib>
+#include <memory>
 #include <optional>
+#include <span>
 #include <string>
 #include <string_view>
-#include <unordered_map>
 #include <vector>
 
 #include <linux/limits.h>
@@ -14,6 +15,7 @@ module;
 module hsh.core.env;
 
 import hsh.core.constant;
+import hsh.core.flat_map;
 
 extern "C" {
   extern char** environ; // NOLINT
@@ -24,7 +26,10 @@ namespace hsh::core::env {
 namespace {
 
 struct EnvVar {
-  std::unordered_map<std::string, std::string> cache_;
+  FlatMap<std::string> variables_;
+  Block                block_;
+  bool                 populated_ = false;
+  bool                 dirty_     = true; // block_ is out of date
 
   EnvVar(EnvVar const&)            = delete;
   EnvVar& operator=(EnvVar const&) = delete;
@@ -44,67 +49,105 @@ EnvVar& EnvVar::instance() {
   return instance;
 }
 
+auto table() -> EnvVar& {
+  auto& env = EnvVar::instance();
+  if (!env.populated_) {
+    populate_cache();
+  }
+  return env;
+}
+
 } // namespace
 
-auto get(std::string const& name) -> std::optional<std::string_view> {
-  auto& cache = EnvVar::instance().cache_;
-  if (auto it = cache.find(name); it != cache.end()) {
-    if (it->second.empty()) {
-      return std::nullopt;
-    }
-    return it->second;
+Block::Block(std::span<std::pair<std::string_view, std::string_view> const> variables) {
+  size_t total = 0;
+  for (auto const& [name, value] : variables) {
+    total += name.size() + value.size() + 2; // '=' and '\0'
   }
 
-  if (char const* value = std::getenv(name.c_str())) {
-    cache[name] = value;
-    return cache[name];
+  data_ = std::make_unique_for_overwrite<char[]>(total);
+  entries_.clear();
+  entries_.reserve(variables.size() + 1);
+
+  char* out = data_.get();
+  for (auto const& [name, value] : variables) {
+    entries_.push_back(out);
+    out    = std::ranges::copy(name, out).out;
+    *out++ = '=';
+    out    = std::ranges::copy(value, out).out;
+    *out++ = '\0';
   }
+  entries_.push_back(nullptr);
+}
 
-  cache[name] = "";
+auto get(std::string_view name) -> std::optional<std::string_view> {
+  if (auto const* value = table().variables_.get(name)) {
+    return *value;
+  }
   return std::nullopt;
 }
 
 auto list() -> std::vector<std::pair<std::string_view, std::string_view>> {
-  auto& cache  = EnvVar::instance().cache_;
-  auto  result = std::vector<std::pair<std::string_view, std::string_view>>{};
-  result.reserve(cache.size());
-  for (auto const& [key, value] : cache) {
+  auto& variables = table().variables_;
+  auto  result    = std::vector<std::pair<std::string_view, std::string_view>>{};
+  result.reserve(variables.size());
+  for (auto const& [key, value] : variables) {
     result.emplace_back(key, value);
   }
   return result;
 }
 
 void set(std::string name, std::string value) {
-  auto& cache = EnvVar::instance().cache_;
-  if (setenv(name.c_str(), value.c_str(), 1) == 0) {
-    cache.insert_or_assign(std::move(name), std::move(value));
+  auto& env = table();
+  env.variables_.insert_or_assign(std::move(name), std::move(value));
+  env.dirty_ = true;
+}
+
+void unset(std::string_view name) {
+  auto& env = table();
+  if (env.variables_.erase(name)) {
+    env.dirty_ = true;
   }
 }
 
-void unset(std::string const& name) {
-  auto& cache = EnvVar::instance().cache_;
-  if (unsetenv(name.c_str()) == 0) {
-    if (auto it = cache.find(name); it != cache.end()) {
-      cache.erase(it);
+void populate_cache() {
+  auto& env = EnvVar::instance();
+  if (env.populated_) {
+    return;
+  }
+  env.populated_ = true;
+
+  for (char** entry = ::environ; entry != nullptr && *entry != nullptr; ++entry) {
+    std::string_view env_str = *entry;
+    if (auto eq_pos = env_str.find('='); eq_pos != std::string_view::npos) {
+      env.variables_.insert_or_assign(env_str.substr(0, eq_pos), std::string{env_str.substr(eq_pos + 1)});
     }
   }
+  env.dirty_ = true;
 }
 
-void clear_cache() {
-  auto& cache = EnvVar::instance().cache_;
-  cache.clear();
+auto envp() -> char* const* {
+  auto& env = table();
+  if (env.dirty_) {
+    env.block_ = Block{list()};
+    env.dirty_ = false;
+  }
+  return env.block_.envp();
 }
 
-void populate_cache() {
-  auto& cache = EnvVar::instance().cache_;
-  for (char** env = ::environ; *env != nullptr; ++env) {
-    std::string env_str = *env;
-    if (auto eq_pos = env_str.find('='); eq_pos != std::string::npos) {
-      std::string key   = env_str.substr(0, eq_pos);
-      std::string value = env_str.substr(eq_pos + 1);
-      cache.insert_or_assign(std::move(key), std::move(value));
+auto envp_with(std::span<std::pair<std::string, std::string> const> overlay) -> Block {
+  auto variables = list();
+  std::erase_if(variables, [&](auto const& entry) {
+    return std::ranges::contains(overlay, entry.first, &std::pair<std::string, std::string>::first);
+  });
+  for (size_t i = 0; i < overlay.size(); ++i) {
+    auto const& [name, value] = overlay[i];
+    // The last assignment to a name wins
+    if (!std::ranges::contains(overlay.subspan(i + 1), name, &std::pair<std::string, std::string>::first)) {
+      variables.emplace_back(name, value);
     }
   }
+  return Block{variables};
 }
 
 void export_shell(int argc, char const** argv) {
@@ -124,8 +167,4 @@ void export_shell(int argc, char const** argv) {
   set(constant::SHELL, shell_path);
 }
 
-auto environ() -> char** {
-  return ::environ;
-}
-
 } // namespace hsh::core::env
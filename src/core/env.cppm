@@ -1,6 +1,8 @@
 module;
 
+#include <memory>
 #include <optional>
+#include <span>
 #include <string>
 #include <string_view>
 #include <utility>
@@ -10,12 +12,31 @@ export module hsh.core.env;
 
 export namespace hsh::core::env {
 
-auto get(std::string const& name) -> std::optional<std::string_view>;
+// NAME=value strings laid out the way execve expects them. The pointers stay valid when a Block is moved.
+class Block {
+  std::unique_ptr<char[]> data_;
+  std::vector<char*>      entries_{nullptr};
+
+public:
+  Block() = default;
+  explicit Block(std::span<std::pair<std::string_view, std::string_view> const> variables);
+
+  [[nodiscard]] auto envp() const noexcept -> char* const* {
+    return entries_.data();
+  }
+};
+
+// The exported variables live in a table owned by the shell, the libc environment is never modified
+auto get(std::string_view name) -> std::optional<std::string_view>;
 auto list() -> std::vector<std::pair<std::string_view, std::string_view>>;
 void set(std::string name, std::string value);
-void unset(std::string const& name);
+void unset(std::string_view name);
 void populate_cache();
 void export_shell(int argc, char const** argv);
-auto environ() -> char**;
+
+// Environment for new processes, rebuilt only when an exported variable changed since the last call
+auto envp() -> char* const*;
+// The exported variables plus `NAME=value` assignments that only apply to a single command
+auto envp_with(std::span<std::pair<std::string, std::string> const> overlay) -> Block;
 
 } // namespace hsh::core::env
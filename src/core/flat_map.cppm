@@ -0,0 +1,242 @@
+module;
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+export module hsh.core.flat_map;
+
+export namespace hsh::core {
+
+// String keyed hash table with open addressing and linear probing. Entries are stored in a single array next to their
+// precomputed hash, so a probe compares hashes before touching any key. Lookups accept any string_view without
+// building a std::string, and values that fit the small string buffer are stored inline in the slot. Like any flat
+// table, growing moves every entry: references and views into the map are invalidated by the next insert.
+template<typename V>
+class FlatMap {
+public:
+  using key_type    = std::string;
+  using mapped_type = V;
+  using value_type  = std::pair<std::string, V>;
+
+private:
+  struct Slot {
+    size_t     hash_ = 0;
+    bool       used_ = false;
+    value_type entry_;
+  };
+
+  static constexpr size_t NPOS         = static_cast<size_t>(-1);
+  static constexpr size_t MIN_CAPACITY = 16;
+
+  std::vector<Slot> slots_;
+  size_t            size_ = 0;
+
+  template<bool Const>
+  class Iterator {
+    using SlotPtr = std::conditional_t<Const, Slot const*, Slot*>;
+
+    SlotPtr current_ = nullptr;
+    SlotPtr end_     = nullptr;
+
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type        = FlatMap::value_type;
+    using difference_type   = std::ptrdiff_t;
+    using reference         = std::conditional_t<Const, value_type const&, value_type&>;
+    using pointer           = std::conditional_t<Const, value_type const*, value_type*>;
+
+    Iterator() = default;
+    Iterator(SlotPtr current, SlotPtr end) : current_(current), end_(end) {
+      skip_empty();
+    }
+
+    auto operator*() const -> reference {
+      return current_->entry_;
+    }
+    auto operator->() const -> pointer {
+      return &current_->entry_;
+    }
+    auto operator++() -> Iterator& {
+      ++current_;
+      skip_empty();
+      return *this;
+    }
+    auto operator++(int) -> Iterator {
+      auto copy = *this;
+      ++*this;
+      return copy;
+    }
+    auto operator==(Iterator const&) const -> bool = default;
+
+  private:
+    void skip_empty() {
+      while (current_ != end_ && !current_->used_) {
+        ++current_;
+      }
+    }
+  };
+
+public:
+  using iterator       = Iterator<false>;
+  using const_iterator = Iterator<true>;
+
+  [[nodiscard]] static auto hash_of(std::string_view key) noexcept -> size_t {
+    return std::hash<std::string_view>{}(key);
+  }
+
+  [[nodiscard]] auto size() const noexcept -> size_t {
+    return size_;
+  }
+  [[nodiscard]] auto empty() const noexcept -> bool {
+    return size_ == 0;
+  }
+
+  auto begin() -> iterator {
+    return iterator{slots_.data(), slots_.data() + slots_.size()};
+  }
+  auto end() -> iterator {
+    return iterator{slots_.data() + slots_.size(), slots_.data() + slots_.size()};
+  }
+  auto begin() const -> const_iterator {
+    return const_iterator{slots_.data(), slots_.data() + slots_.size()};
+  }
+  auto end() const -> const_iterator {
+    return const_iterator{slots_.data() + slots_.size(), slots_.data() + slots_.size()};
+  }
+
+  // Returns the stored value, or nullptr if the key is absent
+  [[nodiscard]] auto get(std::string_view key) -> V* {
+    size_t index = find_index(key, hash_of(key));
+    return index == NPOS ? nullptr : &slots_[index].entry_.second;
+  }
+  [[nodiscard]] auto get(std::string_view key) const -> V const* {
+    size_t index = find_index(key, hash_of(key));
+    return index == NPOS ? nullptr : &slots_[index].entry_.second;
+  }
+  [[nodiscard]] auto contains(std::string_view key) const -> bool {
+    return find_index(key, hash_of(key)) != NPOS;
+  }
+
+  template<typename K, typename T>
+  auto insert_or_assign(K&& key, T&& value) -> V& {
+    std::string_view view{key};
+    size_t           hash = hash_of(view);
+    if (size_t index = find_index(view, hash); index != NPOS) {
+      return slots_[index].entry_.second = std::forward<T>(value);
+    }
+
+    // Built before the table may grow, key and value can still point into it
+    value_type entry{std::string(std::forward<K>(key)), V(std::forward<T>(value))};
+    reserve(size_ + 1);
+    auto& slot  = slots_[free_index(hash)];
+    slot.hash_  = hash;
+    slot.used_  = true;
+    slot.entry_ = std::move(entry);
+    ++size_;
+    return slot.entry_.second;
+  }
+
+  auto operator[](std::string_view key) -> V& {
+    if (auto* value = get(key)) {
+      return *value;
+    }
+    return insert_or_assign(key, V{});
+  }
+
+  // Backward shift deletion, so probes never have to step over tombstones
+  auto erase(std::string_view key) -> bool {
+    size_t hole = find_index(key, hash_of(key));
+    if (hole == NPOS) {
+      return false;
+    }
+
+    size_t const mask = slots_.size() - 1;
+    for (size_t next = (hole + 1) & mask; slots_[next].used_; next = (next + 1) & mask) {
+      size_t home = slots_[next].hash_ & mask;
+      // An entry may only move back if its home slot is not cyclically within (hole, next]
+      bool movable = hole <= next ? (home <= hole || home > next) : (home <= hole && home > next);
+      if (movable) {
+        slots_[hole] = std::move(slots_[next]);
+        hole         = next;
+      }
+    }
+
+    slots_[hole] = Slot{};
+    --size_;
+    return true;
+  }
+
+  template<typename Predicate>
+  auto erase_if(Predicate predicate) -> size_t {
+    std::vector<std::string> keys;
+    for (auto const& entry : *this) {
+      if (predicate(entry)) {
+        keys.push_back(entry.first);
+      }
+    }
+    for (auto const& key : keys) {
+      erase(key);
+    }
+    return keys.size();
+  }
+
+  void clear() {
+    for (auto& slot : slots_) {
+      slot = Slot{};
+    }
+    size_ = 0;
+  }
+
+  // Keeps the load factor at or below 3/4
+  void reserve(size_t count) {
+    if (count * 4 <= slots_.size() * 3) {
+      return;
+    }
+    rehash(std::max(MIN_CAPACITY, std::bit_ceil(count * 4 / 3 + 1)));
+  }
+
+private:
+  auto find_index(std::string_view key, size_t hash) const noexcept -> size_t {
+    if (slots_.empty()) {
+      return NPOS;
+    }
+    size_t const mask = slots_.size() - 1;
+    for (size_t index = hash & mask;; index = (index + 1) & mask) {
+      auto const& slot = slots_[index];
+      if (!slot.used_) {
+        return NPOS;
+      }
+      if (slot.hash_ == hash && slot.entry_.first == key) {
+        return index;
+      }
+    }
+  }
+
+  auto free_index(size_t hash) const noexcept -> size_t {
+    size_t const mask  = slots_.size() - 1;
+    size_t       index = hash & mask;
+    while (slots_[index].used_) {
+      index = (index + 1) & mask;
+    }
+    return index;
+  }
+
+  void rehash(size_t capacity) {
+    auto old = std::exchange(slots_, std::vector<Slot>(capacity));
+    for (auto& slot : old) {
+      if (slot.used_) {
+        slots_[free_index(slot.hash_)] = std::move(slot);
+      }
+    }
+  }
+};
+
+} // namespace hsh::core
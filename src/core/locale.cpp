@@ -1,6 +1,9 @@
 module;
 
+#include <cstddef>
 #include <locale>
+#include <string_view>
+#include <utility>
 
 module hsh.core.locale;
 
@@ -8,54 +11,85 @@ import hsh.core.constant;
 
 namespace hsh::core::locale {
 
-std::locale const& current() noexcept {
-  static std::locale current_locale;
-  if (constant::LOCALE.empty()) {
-    current_locale = std::locale::classic();
-  } else {
-    current_locale = std::locale(constant::LOCALE);
-  }
-  return current_locale;
-}
-
-bool is_alpha(char c) noexcept {
-  return std::isalpha(c, current());
-}
+namespace {
 
-bool is_digit(char c) noexcept {
-  return std::isdigit(c, current());
+auto is_locale_letter(char32_t code_point) noexcept -> bool {
+  static auto const& facet = std::use_facet<std::ctype<wchar_t>>(current());
+  return facet.is(std::ctype_base::alpha, static_cast<wchar_t>(code_point));
 }
 
-bool is_alnum(char c) noexcept {
-  return std::isalnum(c, current());
-}
-
-bool is_space(char c) noexcept {
-  return std::isspace(c, current());
-}
+} // namespace
 
-bool is_upper(char c) noexcept {
-  return std::isupper(c, current());
+auto current() noexcept -> std::locale const& {
+  static std::locale const locale = is_c_locale() ? std::locale::classic() : std::locale(constant::LOCALE);
+  return locale;
 }
 
-bool is_lower(char c) noexcept {
-  return std::islower(c, current());
-}
+auto decode_utf8(std::string_view text) noexcept -> std::pair<char32_t, size_t> {
+  if (text.empty()) {
+    return {0, 0};
+  }
 
-char to_upper(char c) noexcept {
-  return std::toupper(c, current());
-}
+  auto     lead       = static_cast<unsigned char>(text[0]);
+  size_t   length     = 0;
+  char32_t code_point = 0;
+  if (lead < 0x80) {
+    return {lead, 1};
+  }
+  if ((lead & 0xe0) == 0xc0) {
+    length     = 2;
+    code_point = lead & 0x1f;
+  } else if ((lead & 0xf0) == 0xe0) {
+    length     = 3;
+    code_point = lead & 0x0f;
+  } else if ((lead & 0xf8) == 0xf0) {
+    length     = 4;
+    code_point = lead & 0x07;
+  } else {
+    return {0, 0};
+  }
+  if (text.size() < length) {
+    return {0, 0};
+  }
 
-char to_lower(char c) noexcept {
-  return std::tolower(c, current());
-}
+  for (size_t i = 1; i < length; ++i) {
+    auto byte = static_cast<unsigned char>(text[i]);
+    if ((byte & 0xc0) != 0x80) {
+      return {0, 0};
+    }
+    code_point = (code_point << 6) | (byte & 0x3f);
+  }
 
-bool is_alpha_u(char c) noexcept {
-  return std::isalpha(c, current()) || c == '_';
+  // Reject overlong encodings, surrogates and anything past the last code point
+  constexpr char32_t MIN_FOR_LENGTH[] = {0, 0, 0x80, 0x800, 0x10000};
+  if (code_point < MIN_FOR_LENGTH[length] || (code_point >= 0xd800 && code_point <= 0xdfff) || code_point > 0x10ffff) {
+    return {0, 0};
+  }
+  return {code_point, length};
 }
 
-bool is_alnum_u(char c) noexcept {
-  return std::isalnum(c, current()) || c == '_';
+auto identifier_end(std::string_view text, size_t start) noexcept -> size_t {
+  size_t end = start;
+  while (end < text.size()) {
+    char c = text[end];
+    if (static_cast<unsigned char>(c) < 0x80) {
+      if (!(end == start ? is_alpha_u(c) : is_alnum_u(c))) {
+        break;
+      }
+      ++end;
+      continue;
+    }
+
+    if (is_c_locale()) {
+      break;
+    }
+    auto [code_point, length] = decode_utf8(text.substr(end));
+    if (length == 0 || !is_locale_letter(code_point)) {
+      break;
+    }
+    end += length;
+  }
+  return end;
 }
 
 } // namespace hsh::core::locale
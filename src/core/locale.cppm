@@ -1,22 +1,100 @@
 module;
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <locale>
+#include <string_view>
+#include <utility>
 
 export module hsh.core.locale;
 
+import hsh.core.constant;
+
+namespace hsh::core::locale {
+
+enum Class : std::uint8_t {
+  ALPHA = 1 << 0,
+  DIGIT = 1 << 1,
+  SPACE = 1 << 2,
+  UPPER = 1 << 3,
+  LOWER = 1 << 4,
+  UNDER = 1 << 5,
+};
+
+// Classification of every byte in the C locale, bytes above 0x7f belong to no class
+inline constexpr auto CLASSES = [] {
+  std::array<std::uint8_t, 256> table{};
+  for (int c = 'a'; c <= 'z'; ++c) {
+    table[c] = ALPHA | LOWER;
+  }
+  for (int c = 'A'; c <= 'Z'; ++c) {
+    table[c] = ALPHA | UPPER;
+  }
+  for (int c = '0'; c <= '9'; ++c) {
+    table[c] = DIGIT;
+  }
+  for (unsigned char c : std::string_view{" \t\n\v\f\r"}) {
+    table[c] = SPACE;
+  }
+  table['_'] = UNDER;
+  return table;
+}();
+
+constexpr auto has(char c, std::uint8_t classes) noexcept -> bool {
+  return (CLASSES[static_cast<unsigned char>(c)] & classes) != 0;
+}
+
+} // namespace hsh::core::locale
+
 export namespace hsh::core::locale {
 
+// True unless constant::LOCALE names something other than the C locale, in which case identifiers may contain
+// non-ASCII letters and current() is consulted for them
+constexpr auto is_c_locale() noexcept -> bool {
+  return constant::LOCALE.empty() || constant::LOCALE == "C" || constant::LOCALE == "POSIX";
+}
+
+// The configured locale, constructed once
 auto current() noexcept -> std::locale const&;
 
-bool is_alpha(char c) noexcept;
-bool is_digit(char c) noexcept;
-bool is_alnum(char c) noexcept;
-bool is_space(char c) noexcept;
-bool is_upper(char c) noexcept;
-bool is_lower(char c) noexcept;
-char to_upper(char c) noexcept;
-char to_lower(char c) noexcept;
-bool is_alpha_u(char c) noexcept;
-bool is_alnum_u(char c) noexcept;
+// Byte classification in the C locale, used by the lexer and expanders for every character
+constexpr bool is_alpha(char c) noexcept {
+  return has(c, ALPHA);
+}
+constexpr bool is_digit(char c) noexcept {
+  return has(c, DIGIT);
+}
+constexpr bool is_alnum(char c) noexcept {
+  return has(c, ALPHA | DIGIT);
+}
+constexpr bool is_space(char c) noexcept {
+  return has(c, SPACE);
+}
+constexpr bool is_upper(char c) noexcept {
+  return has(c, UPPER);
+}
+constexpr bool is_lower(char c) noexcept {
+  return has(c, LOWER);
+}
+constexpr char to_upper(char c) noexcept {
+  return is_lower(c) ? static_cast<char>(c - 'a' + 'A') : c;
+}
+constexpr char to_lower(char c) noexcept {
+  return is_upper(c) ? static_cast<char>(c - 'A' + 'a') : c;
+}
+constexpr bool is_alpha_u(char c) noexcept {
+  return has(c, ALPHA | UNDER);
+}
+constexpr bool is_alnum_u(char c) noexcept {
+  return has(c, ALPHA | DIGIT | UNDER);
+}
+
+// Decodes the UTF-8 sequence at the start of text into its code point and length, length is 0 if it is malformed
+auto decode_utf8(std::string_view text) noexcept -> std::pair<char32_t, size_t>;
+
+// End of the identifier starting at start, or start if there is none. Outside the C locale, multibyte letters of the
+// configured locale are accepted as well.
+auto identifier_end(std::string_view text, size_t start) noexcept -> size_t;
 
 } // namespace hsh::core::locale
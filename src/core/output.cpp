@@ -0,0 +1,88 @@
+module;
+
+#include <cerrno>
+#include <expected>
+#include <string>
+#include <string_view>
+
+#include <unistd.h>
+
+module hsh.core.output;
+
+import hsh.core.syscall;
+
+namespace hsh::core {
+
+OutputBuffer::OutputBuffer(int fd, Flush flush, OutputBuffer* ahead)
+    : fd_(fd), flush_(flush), ahead_(ahead) {
+  data_.reserve(CAPACITY);
+}
+
+OutputBuffer::~OutputBuffer() {
+  [[maybe_unused]] auto _ = flush();
+}
+
+auto OutputBuffer::write(std::string_view text) -> syscall::Result<void> {
+  size_t start = begin_write();
+  data_.append(text);
+  return end_write(start);
+}
+
+auto OutputBuffer::flush() -> syscall::Result<void> {
+  if (ahead_ != nullptr) {
+    [[maybe_unused]] auto _ = ahead_->flush();
+  }
+
+  std::string_view pending = data_;
+  while (!pending.empty()) {
+    auto written = syscall::write_fd(fd_, pending);
+    if (!written) {
+      if (written.error() == EINTR) {
+        continue;
+      }
+      data_.clear();
+      return std::unexpected(written.error());
+    }
+    pending.remove_prefix(*written);
+  }
+  data_.clear();
+  return {};
+}
+
+auto OutputBuffer::empty() const noexcept -> bool {
+  return data_.empty();
+}
+
+auto OutputBuffer::begin_write() -> size_t {
+  // The descriptor may have been redirected since the last flush
+  if (data_.empty() && flush_ == Flush::WhenFull) {
+    terminal_ = isatty(fd_) == 1;
+  }
+  return data_.size();
+}
+
+auto OutputBuffer::end_write(size_t start) -> syscall::Result<void> {
+  bool per_line = flush_ == Flush::PerLine || terminal_;
+  if (data_.size() >= CAPACITY || (per_line && std::string_view{data_}.substr(start).contains('\n'))) {
+    return flush();
+  }
+  return {};
+}
+
+auto standard_output() -> OutputBuffer& {
+  static OutputBuffer buffer{STDOUT_FILENO};
+  return buffer;
+}
+
+auto standard_error() -> OutputBuffer& {
+  static OutputBuffer buffer{STDERR_FILENO, OutputBuffer::Flush::PerLine, &standard_output()};
+  return buffer;
+}
+
+auto flush_output() -> syscall::Result<void> {
+  auto output = standard_output().flush();
+  auto error  = standard_error().flush();
+  return output ? error : output;
+}
+
+} // namespace hsh::core
@@ -0,0 +1,81 @@
+module;
+
+#include <cstdint>
+#include <format>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <utility>
+
+export module hsh.core.output;
+
+import hsh.core.syscall;
+
+export namespace hsh::core {
+
+// Output of the shell to one of the standard descriptors. Text is collected and written in batches, so a loop of echos
+// costs one write per buffer instead of one per call. Whoever lets another process see the descriptor, or swaps it for
+// a redirection, calls flush_output() first.
+class OutputBuffer {
+public:
+  enum struct Flush : std::uint8_t {
+    WhenFull, // and at every line while the descriptor is a terminal
+    PerLine,
+  };
+
+private:
+  static constexpr size_t CAPACITY = 16 * 1024;
+
+  int           fd_;
+  Flush         flush_;
+  OutputBuffer* ahead_; // flushed before this one
+  std::string   data_;
+  bool          terminal_ = false; // checked again on the first write after a flush
+
+public:
+  // ahead keeps the order of two buffers whose descriptors may refer to the same file
+  explicit OutputBuffer(int fd, Flush flush = Flush::WhenFull, OutputBuffer* ahead = nullptr);
+  // Static buffers are flushed by exit(), also in a forked child
+  ~OutputBuffer();
+
+  OutputBuffer(OutputBuffer const&)            = delete;
+  OutputBuffer& operator=(OutputBuffer const&) = delete;
+
+  // Errors are those of the writes this caused, which may include text collected earlier
+  auto write(std::string_view text) -> syscall::Result<void>;
+  template<typename... Args>
+  auto print(std::format_string<Args...> format, Args&&... args) -> syscall::Result<void>;
+  template<typename... Args>
+  auto println(std::format_string<Args...> format, Args&&... args) -> syscall::Result<void>;
+
+  // Collected text that could not be written is dropped
+  auto               flush() -> syscall::Result<void>;
+  [[nodiscard]] auto empty() const noexcept -> bool;
+
+private:
+  auto begin_write() -> size_t;
+  auto end_write(size_t start) -> syscall::Result<void>;
+};
+
+template<typename... Args>
+auto OutputBuffer::print(std::format_string<Args...> format, Args&&... args) -> syscall::Result<void> {
+  size_t start = begin_write();
+  std::format_to(std::back_inserter(data_), format, std::forward<Args>(args)...);
+  return end_write(start);
+}
+
+template<typename... Args>
+auto OutputBuffer::println(std::format_string<Args...> format, Args&&... args) -> syscall::Result<void> {
+  size_t start = begin_write();
+  std::format_to(std::back_inserter(data_), format, std::forward<Args>(args)...);
+  data_ += '\n';
+  return end_write(start);
+}
+
+// Everything the shell and its builtins print to fd 1 and fd 2. Diagnostics are written per line, after whatever is
+// pending for fd 1.
+auto standard_output() -> OutputBuffer&;
+auto standard_error() -> OutputBuffer&;
+auto flush_output() -> syscall::Result<void>;
+
+} // namespace hsh::core
@@ -4,6 +4,7 @@ module;
 #include <csignal>
 #include <cstring>
 #include <expected>
+#include <span>
 
 #include <unistd.h>
 
@@ -11,6 +12,15 @@ module hsh.core.signal;
 
 namespace hsh::core {
 
+auto signal::make_set(std::span<Signal const> signals) -> sigset_t {
+  sigset_t set;
+  sigemptyset(&set);
+  for (Signal sig : signals) {
+    sigaddset(&set, static_cast<int>(sig));
+  }
+  return set;
+}
+
 void SignalManager::handle_sigint(int) {
   sigint_received_ = true;
 
@@ -157,6 +167,20 @@ auto SignalManager::unblock_signal(Signal sig) -> signal::Result<void> {
   return {};
 }
 
+auto SignalManager::block_signals(sigset_t const& set) -> signal::Result<void> {
+  if (sigprocmask(SIG_BLOCK, &set, nullptr) == -1) {
+    return std::unexpected(errno);
+  }
+  return {};
+}
+
+auto SignalManager::unblock_signals(sigset_t const& set) -> signal::Result<void> {
+  if (sigprocmask(SIG_UNBLOCK, &set, nullptr) == -1) {
+    return std::unexpected(errno);
+  }
+  return {};
+}
+
 auto SignalManager::ignore_signal(Signal sig) -> signal::Result<void> {
   struct sigaction sa;
   std::memset(&sa, 0, sizeof(sa));
@@ -3,6 +3,7 @@ module;
 #include <atomic>
 #include <csignal>
 #include <expected>
+#include <span>
 
 export module hsh.core.signal;
 
@@ -16,16 +17,23 @@ using Result = std::expected<T, int>;
 } // namespace signal
 
 enum struct Signal {
-  INT  = SIGINT,
-  TERM = SIGTERM,
-  QUIT = SIGQUIT,
-  TSTP = SIGTSTP,
-  CONT = SIGCONT,
-  CHLD = SIGCHLD,
-  TTOU = SIGTTOU,
-  TTIN = SIGTTIN
+  INT   = SIGINT,
+  TERM  = SIGTERM,
+  QUIT  = SIGQUIT,
+  TSTP  = SIGTSTP,
+  CONT  = SIGCONT,
+  CHLD  = SIGCHLD,
+  TTOU  = SIGTTOU,
+  TTIN  = SIGTTIN,
+  WINCH = SIGWINCH
 };
 
+namespace signal {
+
+auto make_set(std::span<Signal const> signals) -> sigset_t;
+
+} // namespace signal
+
 class SignalManager {
   static inline std::atomic<pid_t> foreground_pid_{0};
   static inline std::atomic<bool>  sigint_received_{false};
@@ -62,6 +70,8 @@ public:
 
   auto block_signal(Signal sig) -> signal::Result<void>;
   auto unblock_signal(Signal sig) -> signal::Result<void>;
+  auto block_signals(sigset_t const& set) -> signal::Result<void>;
+  auto unblock_signals(sigset_t const& set) -> signal::Result<void>;
   auto ignore_signal(Signal sig) -> signal::Result<void>;
   auto default_signal(Signal sig) -> signal::Result<void>;
 
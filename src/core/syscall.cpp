@@ -6,6 +6,9 @@ module;
 #include <cstdlib>
 #include <cstring>
 #include <expected>
+#include <format>
+#include <ranges>
+#include <span>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -14,6 +17,8 @@ module;
 #include <fcntl.h>
 #include <pwd.h>
 #include <spawn.h>
+#include <sys/pidfd.h>
+#include <sys/signalfd.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
@@ -22,6 +27,34 @@ module hsh.core.syscall;
 
 namespace hsh::core::syscall {
 
+namespace {
+
+// Runs executables without a #! line, as execvp and posix_spawnp would
+constexpr char const* SCRIPT_SHELL = "/bin/sh";
+
+auto c_argv_of(std::span<std::string const> argv) -> std::vector<char*> {
+  std::vector<char*> c_argv;
+  c_argv.reserve(argv.size() + 1);
+  for (auto const& arg : argv) {
+    c_argv.push_back(const_cast<char*>(arg.c_str()));
+  }
+  c_argv.push_back(nullptr);
+  return c_argv;
+}
+
+// The script at path becomes the first operand of the shell, argv[0] is dropped in favour of the shell's own
+auto script_argv_of(std::string const& path, std::span<std::string const> argv) -> std::vector<char*> {
+  std::vector<char*> c_argv{const_cast<char*>(SCRIPT_SHELL), const_cast<char*>(path.c_str())};
+  c_argv.reserve(argv.size() + 2);
+  for (auto const& arg : argv.subspan(argv.empty() ? 0 : 1)) {
+    c_argv.push_back(const_cast<char*>(arg.c_str()));
+  }
+  c_argv.push_back(nullptr);
+  return c_argv;
+}
+
+} // namespace
+
 auto get_pid() noexcept -> pid_t {
   return getpid();
 }
@@ -42,29 +75,70 @@ auto wait_for_process(pid_t pid) -> Result<ProcessInfo> {
   return ProcessInfo{result_pid, status};
 }
 
+// Searches the shell's own PATH, which is not necessarily the one in the libc environment
+auto find_executable(std::string_view name, std::string_view search_path) -> Result<std::string> {
+  if (name.empty()) {
+    return std::unexpected(ENOENT);
+  }
+  if (name.contains('/')) {
+    return std::string{name};
+  }
+
+  int error = ENOENT;
+  for (auto dir : search_path | std::views::split(':')) {
+    std::string_view directory{dir.begin(), dir.end()};
+    auto candidate = std::format("{}/{}", directory.empty() ? "." : directory, name);
+
+    struct stat info{};
+    if (stat(candidate.c_str(), &info) == -1 || !S_ISREG(info.st_mode)) {
+      continue;
+    }
+    if (access(candidate.c_str(), X_OK) == 0) {
+      return candidate;
+    }
+    error = EACCES;
+  }
+  return std::unexpected(error);
+}
+
 auto spawn_process(
-    std::string const&                program,
-    std::vector<std::string> const&   args,
+    std::string const&                path,
+    std::span<std::string const>      argv,
     char* const*                      env,
     posix_spawn_file_actions_t const* file_actions,
     posix_spawnattr_t const*          attr
 ) -> Result<pid_t> {
-  std::vector<char*> argv;
-  argv.reserve(args.size() + 2);
-  argv.push_back(const_cast<char*>(program.c_str()));
-
-  for (auto const& arg : args) {
-    argv.push_back(const_cast<char*>(arg.c_str()));
+  auto  c_argv = c_argv_of(argv);
+  pid_t pid    = 0;
+  int   result = posix_spawn(&pid, path.c_str(), file_actions, attr, c_argv.data(), env);
+  if (result == ENOEXEC) {
+    c_argv = script_argv_of(path, argv);
+    result = posix_spawn(&pid, SCRIPT_SHELL, file_actions, attr, c_argv.data(), env);
   }
-  argv.push_back(nullptr);
-
-  pid_t pid = 0;
-  if (int result = posix_spawnp(&pid, program.c_str(), file_actions, attr, argv.data(), env)) {
+  if (result != 0) {
     return std::unexpected(result);
   }
   return pid;
 }
 
+auto exec_process(std::string const& path, std::span<std::string const> argv, char* const* env) -> Result<void> {
+  auto     c_argv = c_argv_of(argv);
+  sigset_t mask;
+  sigset_t previous;
+  sigemptyset(&mask);
+  sigprocmask(SIG_SETMASK, &mask, &previous);
+
+  execve(path.c_str(), c_argv.data(), env);
+  if (errno == ENOEXEC) {
+    auto script_argv = script_argv_of(path, argv);
+    execve(SCRIPT_SHELL, script_argv.data(), env);
+    errno = ENOEXEC;
+  }
+  int error = errno;
+  sigprocmask(SIG_SETMASK, &previous, nullptr);
+  return std::unexpected(error);
+}
+
 auto close_fd(int fd) -> Result<void> {
   if (close(fd) == -1) {
     return std::unexpected(errno);
@@ -72,6 +146,13 @@ auto close_fd(int fd) -> Result<void> {
   return {};
 }
 
+auto close_range(unsigned int first, unsigned int last, int flags) -> Result<void> {
+  if (::close_range(first, last, flags) == -1) {
+    return std::unexpected(errno);
+  }
+  return {};
+}
+
 auto create_pipe() -> Result<std::array<int, 2>> {
   std::array<int, 2> fds;
   if (pipe2(fds.data(), O_CLOEXEC) == -1) {
@@ -80,7 +161,7 @@ auto create_pipe() -> Result<std::array<int, 2>> {
   return fds;
 }
 
-auto write_fd(int fd, std::string const& data) -> Result<size_t> {
+auto write_fd(int fd, std::string_view data) -> Result<size_t> {
   ssize_t result = write(fd, data.data(), data.size());
   if (result == -1) {
     return std::unexpected(errno);
@@ -96,6 +177,38 @@ auto read_fd(int fd, char* buffer, size_t size) -> Result<size_t> {
   return static_cast<size_t>(result);
 }
 
+auto read_fd_at(int fd, char* buffer, size_t size, off_t offset) -> Result<size_t> {
+  ssize_t result = pread(fd, buffer, size, offset);
+  if (result == -1) {
+    return std::unexpected(errno);
+  }
+  return static_cast<size_t>(result);
+}
+
+auto seek_fd(int fd, off_t offset, int whence) -> Result<off_t> {
+  off_t result = lseek(fd, offset, whence);
+  if (result == -1) {
+    return std::unexpected(errno);
+  }
+  return result;
+}
+
+auto tee_pipe(int in_fd, int out_fd, size_t size) -> Result<size_t> {
+  ssize_t result = tee(in_fd, out_fd, size, 0);
+  if (result == -1) {
+    return std::unexpected(errno);
+  }
+  return static_cast<size_t>(result);
+}
+
+auto stat_fd(int fd) -> Result<struct stat> {
+  struct stat info{};
+  if (fstat(fd, &info) == -1) {
+    return std::unexpected(errno);
+  }
+  return info;
+}
+
 auto change_directory(std::string const& path) -> Result<void> {
   if (chdir(path.c_str()) == -1) {
     return std::unexpected(errno);
@@ -173,6 +286,35 @@ auto duplicate_fd_to(int old_fd, int new_fd) -> Result<void> {
   return {};
 }
 
+auto set_cloexec(int fd, bool enable) -> Result<void> {
+  int flags = fcntl(fd, F_GETFD);
+  if (flags == -1) {
+    return std::unexpected(errno);
+  }
+  flags = enable ? flags | FD_CLOEXEC : flags & ~FD_CLOEXEC;
+  if (fcntl(fd, F_SETFD, flags) == -1) {
+    return std::unexpected(errno);
+  }
+  return {};
+}
+
+auto open_pidfd(pid_t pid) -> Result<int> {
+  // pidfds are always close-on-exec
+  int fd = pidfd_open(pid, 0);
+  if (fd == -1) {
+    return std::unexpected(errno);
+  }
+  return fd;
+}
+
+auto open_signalfd(sigset_t const& mask) -> Result<int> {
+  int fd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+  if (fd == -1) {
+    return std::unexpected(errno);
+  }
+  return fd;
+}
+
 auto fork_process() -> Result<pid_t> {
   pid_t pid = fork();
   if (pid == -1) {
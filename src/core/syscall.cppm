@@ -1,13 +1,16 @@
 module;
 
 #include <array>
+#include <csignal>
 #include <expected>
+#include <span>
 #include <string>
 #include <string_view>
 #include <vector>
 
 #include <dirent.h>
 #include <spawn.h>
+#include <sys/stat.h>
 
 export module hsh.core.syscall;
 
@@ -24,24 +27,37 @@ struct ProcessInfo {
 auto get_pid() noexcept -> pid_t;
 auto kill_process(pid_t pid, int signal) -> Result<void>;
 auto wait_for_process(pid_t pid) -> Result<ProcessInfo>;
+auto find_executable(std::string_view name, std::string_view search_path) -> Result<std::string>;
 auto spawn_process(
-    std::string const&                program,
-    std::vector<std::string> const&   args,
+    std::string const&                path,
+    std::span<std::string const>      argv,
     char* const*                      env,
     posix_spawn_file_actions_t const* file_actions = nullptr,
     posix_spawnattr_t const*          attr         = nullptr
 ) -> Result<pid_t>;
+// Replaces the calling process, only returns if that failed. Signals the shell blocks are unblocked first, as
+// spawn_process callers do through the spawn attributes. Both run a file without a #! line with /bin/sh.
+auto exec_process(std::string const& path, std::span<std::string const> argv, char* const* env) -> Result<void>;
 
 auto close_fd(int fd) -> Result<void>;
+auto close_range(unsigned int first, unsigned int last, int flags = 0) -> Result<void>;
 auto create_pipe() -> Result<std::array<int, 2>>;
-auto write_fd(int fd, std::string const& data) -> Result<size_t>;
+auto write_fd(int fd, std::string_view data) -> Result<size_t>;
 auto read_fd(int fd, char* buffer, size_t size) -> Result<size_t>;
+auto read_fd_at(int fd, char* buffer, size_t size, off_t offset) -> Result<size_t>;
+auto seek_fd(int fd, off_t offset, int whence) -> Result<off_t>;
+// Copies up to size bytes from one pipe into another without consuming them
+auto tee_pipe(int in_fd, int out_fd, size_t size) -> Result<size_t>;
+auto stat_fd(int fd) -> Result<struct stat>;
 auto change_directory(std::string const& path) -> Result<void>;
 auto get_current_directory() -> Result<std::string>;
 auto open_file(std::string const& path, int flags, mode_t mode = 0) -> Result<int>;
 auto duplicate_fd(int fd) -> Result<int>;
 auto duplicate_fd_to(int old_fd, int new_fd) -> Result<void>;
+auto set_cloexec(int fd, bool enable) -> Result<void>;
 auto fork_process() -> Result<pid_t>;
+auto open_pidfd(pid_t pid) -> Result<int>;
+auto open_signalfd(sigset_t const& mask) -> Result<int>;
 
 struct UserInfo {
   std::string name_;
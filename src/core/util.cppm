@@ -1,11 +1,15 @@
 module;
 
+#include <chrono>
 #include <format>
 #include <ranges>
 #include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 
+#include <sys/time.h>
+
 export module hsh.core.util;
 
 export namespace hsh::core::util {
@@ -56,6 +60,35 @@ template<std::ranges::input_range Range, typename CharT = char>
   return formatted;
 }
 
+// A timeval from rusage or gettimeofday as a chrono duration
+[[nodiscard]] constexpr auto to_duration(timeval const& time) noexcept -> std::chrono::microseconds {
+  return std::chrono::seconds{time.tv_sec} + std::chrono::microseconds{time.tv_usec};
+}
+
+// 0m0.000s, as printed by time and times
+[[nodiscard]] inline auto format_duration(std::chrono::microseconds duration) -> std::string {
+  auto minutes = std::chrono::duration_cast<std::chrono::minutes>(duration);
+  auto seconds = std::chrono::duration<double>(duration - minutes);
+  return std::format("{}m{:.3f}s", minutes.count(), seconds.count());
+}
+
+// Runs a callable when the scope it guards is left, on every return path
+template<typename Function>
+class ScopeExit {
+  Function function_;
+
+public:
+  explicit ScopeExit(Function function) : function_(std::move(function)) {}
+  ~ScopeExit() {
+    function_();
+  }
+
+  ScopeExit(ScopeExit const&)            = delete;
+  ScopeExit& operator=(ScopeExit const&) = delete;
+  ScopeExit(ScopeExit&&)                 = delete;
+  ScopeExit& operator=(ScopeExit&&)      = delete;
+};
+
 } // namespace hsh::core::util
 
 template<typename Iterator, typename Sentinel, typename CharT>
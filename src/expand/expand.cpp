@@ -1,5 +1,6 @@
 module;
 
+#include <iterator>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -8,6 +9,8 @@ module hsh.expand;
 
 import hsh.core;
 import hsh.context;
+import hsh.lexer;
+import hsh.parser;
 import hsh.expand.brace;
 import hsh.expand.pathname;
 import hsh.expand.tilde;
@@ -32,13 +35,9 @@ auto expand_pathname(std::string_view word) -> std::vector<std::string> {
   return pathname::expand_pathname(word);
 }
 
-auto expand(std::string_view word, context::Context& context) -> std::vector<std::string> {
-  // Step 1: Tilde expansion (applies to each word before other expansions)
-  std::string tilde_expanded = expand_tilde(word, context);
-
-  // Step 2: Variable expansion (applies to the tilde-expanded word)
-  std::string variable_expanded = expand_variables(tilde_expanded, context);
+namespace {
 
+auto expand_fields(std::string_view variable_expanded, context::Context& context) -> std::vector<std::string> {
   // Step 3: Arithmetic expansion (applies to the variable-expanded word)
   std::string arithmetic_expanded = expand_arithmetic(variable_expanded, context);
 
@@ -59,4 +58,88 @@ auto expand(std::string_view word, context::Context& context) -> std::vector<std
   return pathname_expanded;
 }
 
+// Resolved words have no tilde prefix, and every '$' is one of the references
+auto substitute_references(parser::Word const& word, context::Context& context) -> std::string {
+  std::string_view text = word.text_;
+  std::string      variable_expanded;
+  variable_expanded.reserve(text.size());
+
+  size_t pos = 0;
+  for (auto const& reference : word.references_) {
+    variable_expanded.append(text.substr(pos, reference.offset_ - pos));
+    if (auto value = context.get_variable(reference.symbol_)) {
+      variable_expanded.append(*value);
+    }
+    pos = reference.offset_ + reference.length_;
+  }
+  variable_expanded.append(text.substr(pos));
+  return variable_expanded;
+}
+
+} // namespace
+
+auto expand(std::string_view word, context::Context& context) -> std::vector<std::string> {
+  // Step 1: Tilde expansion (applies to each word before other expansions)
+  std::string tilde_expanded = expand_tilde(word, context);
+
+  // Step 2: Variable expansion (applies to the tilde-expanded word)
+  std::string variable_expanded = expand_variables(tilde_expanded, context);
+
+  return expand_fields(variable_expanded, context);
+}
+
+auto expand(parser::Word const& word, context::Context& context) -> std::vector<std::string> {
+  if (word.splices_positional_) {
+    auto parameters = context.get_positional_parameters();
+    return {parameters.begin(), parameters.end()};
+  }
+  if (!word.resolved_) {
+    return expand(word.text_, context);
+  }
+  return expand_fields(substitute_references(word, context), context);
+}
+
+void expand_into(parser::Word const& word, context::Context& context, std::vector<std::string>& fields) {
+  if (word.splices_positional_) {
+    auto parameters = context.get_positional_parameters();
+    fields.insert(fields.end(), parameters.begin(), parameters.end());
+    return;
+  }
+  auto expanded = expand(word, context);
+  fields.insert(fields.end(), std::make_move_iterator(expanded.begin()), std::make_move_iterator(expanded.end()));
+}
+
+auto expand_word(parser::Word const& word, context::Context& context) -> std::string {
+  if (word.splices_positional_) {
+    std::string joined;
+    for (auto const& parameter : context.get_positional_parameters()) {
+      if (!joined.empty()) {
+        joined += ' ';
+      }
+      joined += parameter;
+    }
+    return joined;
+  }
+
+  bool quoted = word.token_kind_ == lexer::Token::Type::SingleQuoted ||
+                word.token_kind_ == lexer::Token::Type::DoubleQuoted;
+  if (quoted && word.text_.size() >= 2) {
+    std::string_view inner = word.text_.substr(1, word.text_.size() - 2);
+    if (word.token_kind_ == lexer::Token::Type::SingleQuoted) {
+      return std::string(inner);
+    }
+    if (!word.resolved_) {
+      return expand_arithmetic(expand_variables(inner, context), context);
+    }
+  }
+
+  std::string expanded = word.resolved_ ? substitute_references(word, context)
+                                        : expand_variables(expand_tilde(word.text_, context), context);
+  if (quoted && expanded.size() >= 2) {
+    // The references of a resolved word are offsets into the quoted text
+    expanded = expanded.substr(1, expanded.size() - 2);
+  }
+  return expand_arithmetic(expanded, context);
+}
+
 } // namespace hsh::expand
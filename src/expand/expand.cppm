@@ -12,6 +12,7 @@ export import hsh.expand.tilde;
 export import hsh.expand.variable;
 
 import hsh.context;
+import hsh.parser;
 
 export namespace hsh::expand {
 
@@ -20,5 +21,12 @@ auto expand_tilde(std::string_view word, context::Context& context) -> std::stri
 auto expand_arithmetic(std::string_view input, context::Context& context) -> std::string;
 auto expand_pathname(std::string_view word) -> std::vector<std::string>;
 auto expand(std::string_view word, context::Context& context) -> std::vector<std::string>;
+// Same as above, but substitutes the references the parser already resolved without rescanning the word
+auto expand(parser::Word const& word, context::Context& context) -> std::vector<std::string>;
+// Appends the fields of word to fields, "$@" is spliced in without joining the positional parameters
+void expand_into(parser::Word const& word, context::Context& context, std::vector<std::string>& fields);
+// Expands word into one field without brace or pathname expansion, as needed for the operands of [[ ]]. A fully quoted
+// word loses its quotes, a single quoted one is not expanded at all.
+auto expand_word(parser::Word const& word, context::Context& context) -> std::string;
 
 } // namespace hsh::expand
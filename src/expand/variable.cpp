@@ -1,6 +1,8 @@
 module;
 
 #include <algorithm>
+#include <charconv>
+#include <span>
 #include <string>
 #include <string_view>
 
@@ -21,8 +23,8 @@ auto parse_simple_var(std::string_view str, size_t pos, context::Context& contex
     return {"$", 1};
   }
 
-  std::string var_name(str.substr(start, end - start));
-  auto        var_value = context.get_variable(var_name);
+  std::string_view var_name  = str.substr(start, end - start);
+  auto             var_value = context.get_variable(var_name);
 
   std::string replacement = var_value ? std::string(*var_value) : "";
   size_t      consumed    = end - pos;
@@ -30,6 +32,41 @@ auto parse_simple_var(std::string_view str, size_t pos, context::Context& contex
   return {replacement, consumed};
 }
 
+// ${NAME[i]}, ${NAME[@]} and ${NAME[*]}
+auto expand_subscript(std::string_view content, size_t open, context::Context& context) -> std::string {
+  std::string_view name      = content.substr(0, open);
+  std::string_view subscript = content.substr(open + 1, content.size() - open - 2);
+  bool const       all       = subscript == "@" || subscript == "*";
+
+  auto values = context.get_array(name);
+  if (!values) {
+    // A scalar behaves like an array with a single element
+    if (all || subscript == "0") {
+      auto value = context.get_variable(name);
+      return value ? std::string{*value} : "";
+    }
+    return "";
+  }
+
+  if (all) {
+    std::string result;
+    for (size_t i = 0; i < values->size(); ++i) {
+      if (i > 0) {
+        result += ' ';
+      }
+      result += (*values)[i];
+    }
+    return result;
+  }
+
+  size_t index = 0;
+  if (auto [ptr, ec] = std::from_chars(subscript.data(), subscript.data() + subscript.size(), index);
+      ec == std::errc{} && ptr == subscript.data() + subscript.size() && index < values->size()) {
+    return (*values)[index];
+  }
+  return "";
+}
+
 auto parse_braced_var(std::string_view str, size_t pos, context::Context& context) -> std::pair<std::string, size_t> {
   size_t start       = pos + 2;
   size_t brace_count = 1;
@@ -50,6 +87,10 @@ auto parse_braced_var(std::string_view str, size_t pos, context::Context& contex
 
   std::string braced_content(str.substr(start, end - start - 1));
 
+  if (size_t open = braced_content.find('['); open != std::string::npos && braced_content.ends_with(']')) {
+    return {expand_subscript(braced_content, open, context), end - pos};
+  }
+
   auto [var_name, default_value] = parse_var_with_default(braced_content);
 
   if (var_name.empty()) {
@@ -75,7 +116,7 @@ constexpr auto is_special_parameter_char(char c) noexcept -> bool {
   return c == '?' || c == '$' || c == '!' || c == '#' || c == '*' || c == '@' || c == '0';
 }
 
-constexpr auto is_valid_var_name(std::string_view var_name) noexcept -> bool {
+auto is_valid_var_name(std::string_view var_name) noexcept -> bool {
   if (var_name.empty()) {
     return false;
   }
@@ -88,17 +129,7 @@ constexpr auto is_valid_var_name(std::string_view var_name) noexcept -> bool {
     return true;
   }
 
-  if (!core::locale::is_alpha_u(var_name[0])) {
-    return false;
-  }
-
-  for (size_t i = 1; i < var_name.size(); ++i) {
-    if (!core::locale::is_alnum_u(var_name[i])) {
-      return false;
-    }
-  }
-
-  return true;
+  return core::locale::identifier_end(var_name, 0) == var_name.size();
 }
 
 auto find_var_name_end(std::string_view str, size_t start) -> size_t {
@@ -122,10 +153,7 @@ auto find_var_name_end(std::string_view str, size_t start) -> size_t {
     return end;
   }
 
-  while (end < str.size() && core::locale::is_alnum_u(str[end])) {
-    ++end;
-  }
-  return end;
+  return core::locale::identifier_end(str, start);
 }
 
 
@@ -1,9 +1,15 @@
 module;
 
+#include <map>
 #include <optional>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
+#include <sys/types.h>
+
 export module hsh.job;
 
 import hsh.core;
@@ -16,30 +22,81 @@ enum struct JobStatus {
   Done
 };
 
+struct Process {
+  pid_t pid_;
+  int   exit_status_ = 0;
+  bool  done_        = false;
+};
+
 struct Job {
-  int         job_id_;
-  pid_t       pid_;
-  JobStatus   status_;
-  std::string command_;
+  int                  job_id_;
+  pid_t                pgid_;
+  std::vector<Process> processes_;
+  JobStatus            status_;
+  std::string          command_;
 
-  Job(int job_id, pid_t pid, std::string command)
-      : job_id_(job_id), pid_(pid), status_(JobStatus::Running), command_(std::move(command)) {}
+  Job(int job_id, std::vector<pid_t> const& pids, std::string command);
+
+  [[nodiscard]] auto is_done() const noexcept -> bool;
+  // status of the last process, as for a foreground pipeline
+  [[nodiscard]] auto exit_status() const noexcept -> int;
 };
 
 class JobManager {
-  std::vector<Job> jobs_;
-  int              next_job_id_ = 1;
+  std::map<int, Job>             jobs_;       // ordered by job id, the last one is the current job
+  std::unordered_map<pid_t, int> job_by_pid_; // every member of a job in the table to its job id
+  std::unordered_map<pid_t, int> unwaited_;   // exit statuses of reported jobs that nobody waited for yet
+  std::unordered_set<pid_t>      helpers_;    // process substitution children, reaped silently
+  int                            next_job_id_ = 1;
+  bool                           unreported_  = false; // a wait left jobs finished that nobody was told about
+
+  // Every tracked child has a pidfd registered in epoll_fd_, so reaping only touches children that exited. The ones
+  // whose pidfd could not be registered are waited for by pid in the sweep.
+  core::FileDescriptor                            epoll_fd_;
+  std::unordered_map<pid_t, core::FileDescriptor> pidfds_;
+  std::unordered_set<pid_t>                       untracked_;
 
 public:
+  JobManager();
+
   auto add_job(pid_t pid, std::string const& command) -> int;
-  void remove_job(pid_t pid);
-  void update_job_status(pid_t pid, JobStatus status);
+  auto add_job(std::vector<pid_t> const& pids, std::string const& command) -> int;
+  void remove_job(int job_id);
+  void update_job_status(int job_id, JobStatus status);
+  void update_process(pid_t pid, int exit_status);
+  auto find_job(pid_t pid) -> Job*;
+  auto get_job(int job_id) -> Job*;
+  auto current_job() -> Job*;
+  // The exit status of a member of a job that finished and was reported before it was waited for, handed out once
+  auto take_unwaited(pid_t pid) -> std::optional<int>;
+  // A new background job replaces $!, the statuses kept for the previous ones are dropped
+  void forget_unwaited();
+  // Records the children that exited, then removes and returns every finished job
   auto check_background_jobs() -> std::vector<Job>;
-  auto process_completed_pid(pid_t pid) -> std::optional<Job>;
+  // Blocks until a tracked child exits and records it like check_background_jobs(), but finished jobs are kept for the
+  // caller. ECHILD if nothing is left to wait for, EINTR if a signal came first.
+  auto wait_for_exit() -> core::syscall::Result<void>;
+
+  void track_helper(pid_t pid);
+  void reap_helpers();
 
-  auto get_jobs(this auto&& self) -> decltype(auto) {
-    return self.jobs_;
+  // Readable whenever a tracked child has exited
+  [[nodiscard]] auto event_fd() const noexcept -> int {
+    return epoll_fd_.get();
   }
+
+  // Jobs ordered by job id
+  auto get_jobs() const -> std::vector<Job const*>;
+
+private:
+  void track(pid_t pid);
+  void untrack(pid_t pid);
+  auto collect_exited() -> std::vector<std::pair<pid_t, int>>;
+  // True if a job finished with them
+  auto record_exited(std::vector<std::pair<pid_t, int>> const& exited) -> bool;
+  // Stops and continues never make a pidfd readable, each tracked child is asked for them with waitid. Children
+  // without a pidfd are reaped there as well.
+  auto sweep_changed() -> bool;
 };
 
 } // namespace hsh::job
@@ -1,10 +1,18 @@
 module;
 
 #include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <expected>
 #include <optional>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
+#include <sys/epoll.h>
 #include <sys/wait.h>
 
 module hsh.job;
@@ -13,58 +21,334 @@ import hsh.core;
 
 namespace hsh::job {
 
+namespace {
+
+auto exit_status_of(siginfo_t const& info) noexcept -> int {
+  return info.si_code == CLD_EXITED ? info.si_status : 128 + info.si_status;
+}
+
+} // namespace
+
+Job::Job(int job_id, std::vector<pid_t> const& pids, std::string command)
+    : job_id_(job_id), pgid_(pids.front()), status_(JobStatus::Running), command_(std::move(command)) {
+  processes_.reserve(pids.size());
+  for (pid_t pid : pids) {
+    processes_.push_back(Process{pid});
+  }
+}
+
+auto Job::is_done() const noexcept -> bool {
+  return std::ranges::all_of(processes_, &Process::done_);
+}
+
+auto Job::exit_status() const noexcept -> int {
+  return processes_.empty() ? 0 : processes_.back().exit_status_;
+}
+
+JobManager::JobManager() : epoll_fd_(epoll_create1(EPOLL_CLOEXEC)) {}
+
 auto JobManager::add_job(pid_t pid, std::string const& command) -> int {
+  return add_job(std::vector<pid_t>{pid}, command);
+}
+
+auto JobManager::add_job(std::vector<pid_t> const& pids, std::string const& command) -> int {
   int job_id = next_job_id_++;
-  jobs_.emplace_back(job_id, pid, command);
+  for (pid_t pid : pids) {
+    // a recycled pid belongs to the new child from now on
+    unwaited_.erase(pid);
+    job_by_pid_.insert_or_assign(pid, job_id);
+    track(pid);
+  }
+  jobs_.try_emplace(job_id, job_id, pids, command);
   return job_id;
 }
 
-void JobManager::remove_job(pid_t pid) {
-  jobs_.erase(std::ranges::remove_if(jobs_, [pid](Job const& job) { return job.pid_ == pid; }).begin(), jobs_.end());
+void JobManager::remove_job(int job_id) {
+  auto it = jobs_.find(job_id);
+  if (it == jobs_.end()) {
+    return;
+  }
+  for (auto const& process : it->second.processes_) {
+    job_by_pid_.erase(process.pid_);
+    if (!process.done_) {
+      untrack(process.pid_);
+    }
+  }
+  jobs_.erase(it);
+
+  // Numbering starts over once there are no jobs left, like other shells do
+  if (jobs_.empty()) {
+    next_job_id_ = 1;
+  }
 }
 
-void JobManager::update_job_status(pid_t pid, JobStatus status) {
-  if (auto it = std::ranges::find_if(jobs_, [pid](Job const& job) { return job.pid_ == pid; }); it != jobs_.end()) {
-    it->status_ = status;
+void JobManager::update_job_status(int job_id, JobStatus status) {
+  if (auto* job = get_job(job_id)) {
+    job->status_ = status;
   }
 }
 
+void JobManager::update_process(pid_t pid, int exit_status) {
+  auto index = job_by_pid_.find(pid);
+  if (index == job_by_pid_.end()) {
+    return;
+  }
+  auto* job = get_job(index->second);
+  untrack(pid);
+  if (job == nullptr) {
+    return;
+  }
+
+  // The first status recorded for a member is its real one
+  if (auto process = std::ranges::find(job->processes_, pid, &Process::pid_);
+      process != job->processes_.end() && !process->done_) {
+    process->exit_status_ = exit_status;
+    process->done_        = true;
+  }
+  if (job->is_done()) {
+    job->status_ = JobStatus::Done;
+  }
+}
+
+auto JobManager::find_job(pid_t pid) -> Job* {
+  if (auto it = job_by_pid_.find(pid); it != job_by_pid_.end()) {
+    return get_job(it->second);
+  }
+  return nullptr;
+}
+
+auto JobManager::get_job(int job_id) -> Job* {
+  if (auto it = jobs_.find(job_id); it != jobs_.end()) {
+    return &it->second;
+  }
+  return nullptr;
+}
+
+auto JobManager::current_job() -> Job* {
+  return jobs_.empty() ? nullptr : &jobs_.rbegin()->second;
+}
+
+auto JobManager::take_unwaited(pid_t pid) -> std::optional<int> {
+  auto it = unwaited_.find(pid);
+  if (it == unwaited_.end()) {
+    return std::nullopt;
+  }
+  int status = it->second;
+  unwaited_.erase(it);
+  return status;
+}
+
+void JobManager::forget_unwaited() {
+  unwaited_.clear();
+}
+
+auto JobManager::get_jobs() const -> std::vector<Job const*> {
+  std::vector<Job const*> result;
+  result.reserve(jobs_.size());
+  for (auto const& [job_id, job] : jobs_) {
+    result.push_back(&job);
+  }
+  return result;
+}
+
 auto JobManager::check_background_jobs() -> std::vector<Job> {
+  // Jobs a wait left finished are reported here as well
+  bool finished = record_exited(collect_exited());
+  finished      = sweep_changed() || finished;
+  if (!std::exchange(unreported_, false) && !finished) {
+    return {};
+  }
+
   std::vector<Job> completed_jobs;
+  for (auto const* job : get_jobs()) {
+    if (job->status_ == JobStatus::Done) {
+      completed_jobs.push_back(*job);
+    }
+  }
+  for (auto const& job : completed_jobs) {
+    // wait can still ask for them, by pid, until $! moves on
+    for (auto const& process : job.processes_) {
+      unwaited_.insert_or_assign(process.pid_, process.exit_status_);
+    }
+    remove_job(job.job_id_);
+  }
+  return completed_jobs;
+}
 
-  for (auto& job : jobs_) {
-    if (job.status_ != JobStatus::Running) {
-      continue;
+auto JobManager::wait_for_exit() -> core::syscall::Result<void> {
+  if (pidfds_.empty() && untracked_.empty()) {
+    return std::unexpected(ECHILD);
+  }
+
+  if (untracked_.empty()) {
+    // Sleeps on the pidfds until one of them becomes readable, nothing is polled
+    epoll_event event{};
+    if (epoll_wait(epoll_fd_.get(), &event, 1, -1) == -1) {
+      return std::unexpected(errno);
+    }
+  } else {
+    // An untracked child only shows up in waitid, which is asked to leave it for the sweep below
+    siginfo_t info{};
+    if (waitid(P_ALL, 0, &info, WEXITED | WNOWAIT) == -1) {
+      return std::unexpected(errno);
+    }
+  }
+
+  bool finished = record_exited(collect_exited());
+  finished      = sweep_changed() || finished;
+  unreported_   = finished || unreported_;
+  return {};
+}
+
+void JobManager::track_helper(pid_t pid) {
+  helpers_.insert(pid);
+  track(pid);
+}
+
+void JobManager::reap_helpers() {
+  std::erase_if(helpers_, [this](pid_t pid) {
+    auto it = pidfds_.find(pid);
+    if (it == pidfds_.end()) {
+      int status = 0;
+      // no pidfd, fall back to the pid itself
+      if (waitpid(pid, &status, WNOHANG) == 0) {
+        return false;
+      }
+      untracked_.erase(pid);
+      return true;
     }
 
-    int status;
-    if (pid_t result = waitpid(job.pid_, &status, WNOHANG); result == job.pid_) {
-      job.status_ = JobStatus::Done;
-      completed_jobs.push_back(job);
-    } else if (result == 0) {
-      continue;
-    } else if (result == -1) {
-      job.status_ = JobStatus::Done;
-      completed_jobs.push_back(job);
+    siginfo_t info{};
+    int       result = waitid(P_PIDFD, static_cast<id_t>(it->second.get()), &info, WEXITED | WNOHANG);
+    if (result == -1 || info.si_pid != 0) {
+      pidfds_.erase(it);
+      return true;
     }
+    return false;
+  });
+}
+
+void JobManager::track(pid_t pid) {
+  auto result = core::syscall::open_pidfd(pid);
+  if (!result) {
+    untracked_.insert(pid);
+    return;
   }
+  core::FileDescriptor pidfd{*result};
 
-  for (auto const& completed : completed_jobs) {
-    remove_job(completed.pid_);
+  epoll_event event{};
+  event.events   = EPOLLIN;
+  event.data.u64 = static_cast<std::uint64_t>(pid);
+  if (epoll_ctl(epoll_fd_.get(), EPOLL_CTL_ADD, pidfd.get(), &event) == -1) {
+    untracked_.insert(pid);
+    return;
   }
 
-  return completed_jobs;
+  pidfds_.insert_or_assign(pid, std::move(pidfd));
+}
+
+void JobManager::untrack(pid_t pid) {
+  // closing the last reference also removes it from the epoll set
+  pidfds_.erase(pid);
+  untracked_.erase(pid);
+}
+
+auto JobManager::record_exited(std::vector<std::pair<pid_t, int>> const& exited) -> bool {
+  bool finished = false;
+  for (auto [pid, status] : exited) {
+    if (helpers_.erase(pid) > 0) {
+      untrack(pid);
+      continue;
+    }
+    auto* job = find_job(pid);
+    update_process(pid, status);
+    finished = finished || (job != nullptr && job->status_ == JobStatus::Done);
+  }
+  return finished;
 }
 
-auto JobManager::process_completed_pid(pid_t pid) -> std::optional<Job> {
-  if (auto it = std::ranges::find_if(jobs_, [pid](Job const& job) { return job.pid_ == pid; }); it != jobs_.end()) {
-    it->status_       = JobStatus::Done;
-    Job completed_job = *it;
-    jobs_.erase(it);
-    return completed_job;
+auto JobManager::sweep_changed() -> bool {
+  std::vector<std::pair<pid_t, int>> exited;
+  // Only asks about the children this manager tracks, anything else is left to whoever started it
+  auto poll = [&](pid_t pid, Job* job) {
+    // exits make a pidfd readable and are collected there, a child without one is reaped here
+    auto it      = pidfds_.find(pid);
+    bool has_fd  = it != pidfds_.end();
+    auto type    = has_fd ? P_PIDFD : P_PID;
+    auto id      = static_cast<id_t>(has_fd ? it->second.get() : pid);
+    int  options = WSTOPPED | WCONTINUED | WNOHANG | (has_fd ? 0 : WEXITED);
+
+    siginfo_t info{};
+    int       result = 0;
+    while ((result = waitid(type, id, &info, options)) == -1 && errno == EINTR) {}
+    if (result == -1 && !has_fd) {
+      // reaped by someone else, its status is unknown
+      exited.emplace_back(pid, 127);
+      return;
+    }
+    if (result == -1 || info.si_pid == 0) {
+      return;
+    }
+
+    if (info.si_code == CLD_STOPPED || info.si_code == CLD_TRAPPED) {
+      if (job != nullptr) {
+        job->status_ = JobStatus::Stopped;
+      }
+    } else if (info.si_code == CLD_CONTINUED) {
+      if (job != nullptr && job->status_ == JobStatus::Stopped) {
+        job->status_ = JobStatus::Running;
+      }
+    } else {
+      exited.emplace_back(pid, exit_status_of(info));
+    }
+  };
+
+  for (auto const& [pid, pidfd] : pidfds_) {
+    poll(pid, find_job(pid));
+  }
+  for (pid_t pid : untracked_) {
+    poll(pid, find_job(pid));
   }
+  return record_exited(exited);
+}
+
+auto JobManager::collect_exited() -> std::vector<std::pair<pid_t, int>> {
+  std::vector<std::pair<pid_t, int>> exited;
+
+  std::array<epoll_event, 64> events{};
+  int                         ready = 0;
+  do {
+    ready = epoll_wait(epoll_fd_.get(), events.data(), static_cast<int>(events.size()), 0);
+    if (ready == -1 && errno == EINTR) {
+      ready = static_cast<int>(events.size());
+      continue;
+    }
+
+    for (int i = 0; i < ready; ++i) {
+      auto pid = static_cast<pid_t>(events[static_cast<size_t>(i)].data.u64);
+      auto it  = pidfds_.find(pid);
+      if (it == pidfds_.end()) {
+        continue;
+      }
+
+      // A pidfd refers to exactly this child, so a recycled pid can never be reaped by mistake
+      siginfo_t info{};
+      if (waitid(P_PIDFD, static_cast<id_t>(it->second.get()), &info, WEXITED | WNOHANG) == -1) {
+        // already collected elsewhere (ECHILD), the real status is lost
+        exited.emplace_back(pid, 127);
+        pidfds_.erase(it);
+        continue;
+      }
+      if (info.si_pid == 0) {
+        continue;
+      }
+
+      exited.emplace_back(pid, exit_status_of(info));
+      pidfds_.erase(it);
+    }
+  } while (ready == static_cast<int>(events.size()));
 
-  return std::nullopt;
+  return exited;
 }
 
 } // namespace hsh::job
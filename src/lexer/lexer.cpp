@@ -36,6 +36,55 @@ void Lexer::skip() noexcept {
   }
 }
 
+auto Lexer::next_regex() noexcept -> Token {
+  if (cached_token_) {
+    return next();
+  }
+  skip_whitespace();
+
+  auto start_pos = pos_;
+  int  depth     = 0;
+  while (!at_end()) {
+    char c = current_char();
+    if (depth == 0 && core::locale::is_space(c)) {
+      break;
+    }
+    if (c == '\\') {
+      advance(2);
+      continue;
+    }
+    if (c == '\'' || c == '"') {
+      advance();
+      while (!at_end() && current_char() != c) {
+        advance(c == '"' && current_char() == '\\' ? 2 : 1);
+      }
+      advance();
+      continue;
+    }
+    if (c == '(') {
+      depth++;
+    } else if (c == ')') {
+      if (depth == 0) {
+        break;
+      }
+      depth--;
+    }
+    advance();
+  }
+
+  auto text = src_.substr(start_pos, pos_ - start_pos);
+  // A fully quoted pattern keeps its quote kind, it is matched literally
+  auto kind = Token::Type::Word;
+  if (text.size() >= 2 && text.front() == text.back() && text.find(text.front(), 1) == text.size() - 1) {
+    if (text.front() == '\'') {
+      kind = Token::Type::SingleQuoted;
+    } else if (text.front() == '"') {
+      kind = Token::Type::DoubleQuoted;
+    }
+  }
+  return make_token(kind, text);
+}
+
 auto Lexer::remaining() const noexcept -> std::string_view {
   return src_.substr(pos_);
 }
@@ -118,6 +167,11 @@ auto Lexer::match_operator() noexcept -> std::optional<Token> {
           return std::nullopt;
         }
       }
+      // Brace expansion never has a blank after the opening brace, so this opens a group such as a function body
+      if (core::locale::is_space(peek_char())) {
+        advance();
+        return make_token(Token::Type::LeftBrace, src_.substr(start_pos, 1));
+      }
       size_t peek_pos  = start_pos + 1;
       bool   has_comma = false;
       bool   has_range = false;
@@ -148,14 +202,26 @@ auto Lexer::match_operator() noexcept -> std::optional<Token> {
     }
     case '[': {
       advance();
+      // [[ and ]] only delimit a conditional expression when they stand alone
+      if (current_char() == '[' && ends_bracket(peek_char())) {
+        advance();
+        return make_token(Token::Type::DoubleLeftBracket, src_.substr(start_pos, 2));
+      }
       return make_token(Token::Type::LeftBracket, src_.substr(start_pos, 1));
     }
     case ']': {
       advance();
+      if (current_char() == ']' && ends_bracket(peek_char())) {
+        advance();
+        return make_token(Token::Type::DoubleRightBracket, src_.substr(start_pos, 2));
+      }
       return make_token(Token::Type::RightBracket, src_.substr(start_pos, 1));
     }
     case '<': {
       advance();
+      if (current_char() == '(') {
+        return match_process_substitution(Token::Type::ProcessSubstIn, start_pos);
+      }
       if (current_char() == '<') {
         advance();
         return make_token(Token::Type::LessLess, src_.substr(start_pos, 2));
@@ -172,6 +238,9 @@ auto Lexer::match_operator() noexcept -> std::optional<Token> {
     }
     case '>': {
       advance();
+      if (current_char() == '(') {
+        return match_process_substitution(Token::Type::ProcessSubstOut, start_pos);
+      }
       if (current_char() == '>') {
         advance();
         return make_token(Token::Type::Append, src_.substr(start_pos, 2));
@@ -408,6 +477,35 @@ auto Lexer::match_assignment() noexcept -> std::optional<Token> {
   return make_token(Token::Type::Assignment, src_.substr(start_pos, pos_ - start_pos));
 }
 
+auto Lexer::match_process_substitution(Token::Type kind, size_t start_pos) noexcept -> Token {
+  // <(...) or >(...) process substitution, current_char() is the opening '('
+  advance();
+  int paren_count = 1;
+  while (!at_end() && paren_count > 0) {
+    char ch = current_char();
+    // Parentheses that are quoted or escaped do not count
+    if (ch == '\\') {
+      advance(2);
+      continue;
+    }
+    if (ch == '\'' || ch == '"') {
+      advance();
+      while (!at_end() && current_char() != ch) {
+        advance(ch == '"' && current_char() == '\\' ? 2 : 1);
+      }
+      advance();
+      continue;
+    }
+    if (ch == '(') {
+      paren_count++;
+    } else if (ch == ')') {
+      paren_count--;
+    }
+    advance();
+  }
+  return make_token(kind, src_.substr(start_pos, pos_ - start_pos));
+}
+
 void Lexer::advance(size_t count) noexcept {
   for (size_t i = 0; i < count && pos_ < src_.size(); ++i) {
     if (src_[pos_] == '\n') {
@@ -444,6 +542,7 @@ constexpr auto Lexer::is_word_char(char c) noexcept -> bool {
          c == '_' ||
          c == '#' ||
          c == '!' ||
+         c == '=' ||
          c == '@';
 }
 
@@ -464,6 +563,10 @@ constexpr auto Lexer::is_operator_char(char c) noexcept -> bool {
          c == '\t';
 }
 
+constexpr auto Lexer::ends_bracket(char c) noexcept -> bool {
+  return c == '\0' || core::locale::is_space(c) || c == ';' || c == '&' || c == '|' || c == ')';
+}
+
 constexpr auto Lexer::classify_word(std::string_view word) noexcept -> Token::Type {
   if (word == "if") {
     return Token::Type::If;
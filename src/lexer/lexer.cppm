@@ -19,15 +19,17 @@ struct Token {
     Whitespace,
 
     // Operators and punctuation
-    Pipe,         // |
-    Ampersand,    // &
-    Semicolon,    // ;
-    LeftParen,    // (
-    RightParen,   // )
-    LeftBrace,    // {
-    RightBrace,   // }
-    LeftBracket,  // [
-    RightBracket, // ]
+    Pipe,               // |
+    Ampersand,          // &
+    Semicolon,          // ;
+    LeftParen,          // (
+    RightParen,         // )
+    LeftBrace,          // {
+    RightBrace,         // }
+    LeftBracket,        // [
+    RightBracket,       // ]
+    DoubleLeftBracket,  // [[
+    DoubleRightBracket, // ]]
 
     // Redirection operators
     Less,        // <
@@ -47,12 +49,14 @@ struct Token {
     Background, // & (when used for background)
 
     // Words and literals
-    Word,         // Unquoted word
-    SingleQuoted, // 'string'
-    DoubleQuoted, // "string"
-    DollarParen,  // $(...)
-    DollarBrace,  // ${...}
-    Backtick,     // `...`
+    Word,            // Unquoted word
+    SingleQuoted,    // 'string'
+    DoubleQuoted,    // "string"
+    DollarParen,     // $(...)
+    DollarBrace,     // ${...}
+    Backtick,        // `...`
+    ProcessSubstIn,  // <(...)
+    ProcessSubstOut, // >(...)
 
     // Numbers (for redirection file descriptors)
     Number,
@@ -100,6 +104,8 @@ public:
   [[nodiscard]] auto next() noexcept -> Token;
   [[nodiscard]] auto peek() noexcept -> Token;
   void               skip() noexcept;
+  // The right operand of =~ as one word, regex characters such as ( | ^ do not end it
+  [[nodiscard]] auto next_regex() noexcept -> Token;
 
   [[nodiscard]] auto remaining() const noexcept -> std::string_view;
   [[nodiscard]] auto at_end() const noexcept -> bool;
@@ -112,12 +118,14 @@ private:
   [[nodiscard]] auto match_number() noexcept -> std::optional<Token>;
   [[nodiscard]] auto match_comment() noexcept -> std::optional<Token>;
   [[nodiscard]] auto match_assignment() noexcept -> std::optional<Token>;
+  [[nodiscard]] auto match_process_substitution(Token::Type kind, size_t start_pos) noexcept -> Token;
 
   void                                advance(size_t count = 1) noexcept;
   [[nodiscard]] auto                  current_char() const noexcept -> char;
   [[nodiscard]] auto                  peek_char(size_t offset = 1) const noexcept -> char;
   [[nodiscard]] static constexpr auto is_word_char(char c) noexcept -> bool;
   [[nodiscard]] static constexpr auto is_operator_char(char c) noexcept -> bool;
+  [[nodiscard]] static constexpr auto ends_bracket(char c) noexcept -> bool;
   [[nodiscard]] static constexpr auto classify_word(std::string_view word) noexcept -> Token::Type;
   void                                skip_whitespace() noexcept;
 
@@ -2,13 +2,62 @@ module;
 
 #include <memory>
 #include <optional>
+#include <string_view>
+#include <utility>
 
 module hsh.parser.ast;
 
+import hsh.core;
+import hsh.context.symbol;
+
 namespace hsh::parser {
 
+namespace {
+
+// Name of a `$NAME` or `${NAME}` starting at pos, empty for anything the expander has to interpret itself
+auto simple_reference(std::string_view text, size_t pos) -> std::pair<std::string_view, size_t> {
+  bool   braced = pos + 1 < text.size() && text[pos + 1] == '{';
+  size_t start  = pos + (braced ? 2 : 1);
+  size_t end    = core::locale::identifier_end(text, start);
+  if (end == start) {
+    return {};
+  }
+  if (braced) {
+    if (end >= text.size() || text[end] != '}') {
+      return {};
+    }
+    return {text.substr(start, end - start), end + 1 - pos};
+  }
+  return {text.substr(start, end - start), end - pos};
+}
+
+} // namespace
+
 Word::Word(std::string_view text, lexer::Token::Type kind)
-    : text_(text), token_kind_(kind) {}
+    : text_(text), token_kind_(kind) {
+  // Unquoted, $@ is split like any other expansion
+  if (text == "\"$@\"" || text == "\"${@}\"") {
+    splices_positional_ = true;
+    return;
+  }
+
+  // Tilde prefixes and escaped dollars are left to the general expansion path
+  if (text.starts_with('~') || text.contains("\\$")) {
+    return;
+  }
+
+  auto& symbols = context::SymbolTable::instance();
+  for (size_t pos = text.find('$'); pos != std::string_view::npos; pos = text.find('$', pos)) {
+    auto [name, length] = simple_reference(text, pos);
+    if (name.empty()) {
+      references_.clear();
+      return;
+    }
+    references_.push_back({pos, length, symbols.intern(name)});
+    pos += length;
+  }
+  resolved_ = true;
+}
 
 auto Word::type() const noexcept -> Type {
   return Type::Word;
@@ -18,6 +67,11 @@ auto Word::clone() const -> std::unique_ptr<ASTNode> {
   return std::make_unique<Word>(text_, token_kind_);
 }
 
+auto Word::is_literal() const noexcept -> bool {
+  return token_kind_ == lexer::Token::Type::Word && !text_.empty() &&
+         text_.find_first_of("$`\\'\"*?[{~") == std::string_view::npos;
+}
+
 auto Word::from_token(lexer::Token const& token) -> std::unique_ptr<Word> {
   return std::make_unique<Word>(token.text_, token.kind_);
 }
@@ -63,6 +117,7 @@ auto Command::clone() const -> std::unique_ptr<ASTNode> {
   for (auto const& assign : assignments_) {
     cmd->assignments_.push_back(std::unique_ptr<Assignment>(static_cast<Assignment*>(assign->clone().release())));
   }
+  cmd->builtin_ = builtin_;
   return cmd;
 }
 
@@ -73,6 +128,7 @@ auto Pipeline::type() const noexcept -> Type {
 auto Pipeline::clone() const -> std::unique_ptr<ASTNode> {
   auto pipeline         = std::make_unique<Pipeline>();
   pipeline->background_ = background_;
+  pipeline->timed_      = timed_;
   for (auto const& cmd : commands_) {
     pipeline->commands_.push_back(cmd->clone());
   }
@@ -137,6 +193,39 @@ auto LogicalExpression::clone() const -> std::unique_ptr<ASTNode> {
   return std::make_unique<LogicalExpression>(left_->clone(), operator_, right_->clone());
 }
 
+TestExpression::TestExpression(Kind kind)
+    : kind_(kind) {}
+
+auto TestExpression::type() const noexcept -> Type {
+  return Type::TestExpression;
+}
+
+auto TestExpression::clone() const -> std::unique_ptr<ASTNode> {
+  auto expression       = std::make_unique<TestExpression>(kind_);
+  expression->operator_ = operator_;
+  for (auto const& operand : operands_) {
+    expression->operands_.push_back(std::unique_ptr<Word>(static_cast<Word*>(operand->clone().release())));
+  }
+  if (left_) {
+    expression->left_ = std::unique_ptr<TestExpression>(static_cast<TestExpression*>(left_->clone().release()));
+  }
+  if (right_) {
+    expression->right_ = std::unique_ptr<TestExpression>(static_cast<TestExpression*>(right_->clone().release()));
+  }
+  return expression;
+}
+
+FunctionDefinition::FunctionDefinition(std::string_view name, std::shared_ptr<CompoundStatement const> body)
+    : name_(name), body_(std::move(body)) {}
+
+auto FunctionDefinition::type() const noexcept -> Type {
+  return Type::FunctionDefinition;
+}
+
+auto FunctionDefinition::clone() const -> std::unique_ptr<ASTNode> {
+  return std::make_unique<FunctionDefinition>(name_, body_);
+}
+
 auto ConditionalStatement::clone() const -> std::unique_ptr<ASTNode> {
   auto cond        = std::make_unique<ConditionalStatement>();
   cond->condition_ = std::unique_ptr<Pipeline>(static_cast<Pipeline*>(condition_->clone().release()));
@@ -175,6 +264,10 @@ auto LoopStatement::clone() const -> std::unique_ptr<ASTNode> {
 
   loop->body_ = std::unique_ptr<CompoundStatement>(static_cast<CompoundStatement*>(body_->clone().release()));
 
+  for (auto const& redir : redirections_) {
+    loop->redirections_.push_back(std::unique_ptr<Redirection>(static_cast<Redirection*>(redir->clone().release())));
+  }
+
   return loop;
 }
 
@@ -8,6 +8,9 @@ module;
 export module hsh.parser.ast;
 
 import hsh.lexer;
+import hsh.builtin.condition;
+import hsh.builtin.table;
+import hsh.context.symbol;
 
 export namespace hsh::parser {
 
@@ -23,6 +26,8 @@ struct ConditionalStatement;
 struct LoopStatement;
 struct CaseStatement;
 struct Subshell;
+struct TestExpression;
+struct FunctionDefinition;
 
 // AST Node Base Class
 struct ASTNode {
@@ -40,22 +45,36 @@ struct ASTNode {
     CompoundStatement,
     CaseStatement,
     Subshell,
-    LogicalExpression
+    LogicalExpression,
+    TestExpression,
+    FunctionDefinition
   };
 
   [[nodiscard]] virtual auto type() const noexcept -> Type             = 0;
   [[nodiscard]] virtual auto clone() const -> std::unique_ptr<ASTNode> = 0;
 };
 
+// A `$NAME` or `${NAME}` inside a word, resolved to its interned symbol when the word is parsed
+struct VariableReference {
+  size_t          offset_; // position of the '$' in the word
+  size_t          length_;
+  context::Symbol symbol_;
+};
+
 // Word node for shell words (literals, variables, expansions)
 struct Word final : ASTNode {
-  std::string_view   text_;
-  lexer::Token::Type token_kind_;
+  std::string_view               text_;
+  lexer::Token::Type             token_kind_;
+  std::vector<VariableReference> references_;
+  bool                           resolved_           = false; // references_ covers every '$' of the word
+  bool                           splices_positional_ = false; // "$@", one field per positional parameter
 
   explicit Word(std::string_view text, lexer::Token::Type kind = lexer::Token::Type::Word);
 
   [[nodiscard]] auto type() const noexcept -> Type override;
   [[nodiscard]] auto clone() const -> std::unique_ptr<ASTNode> override;
+  // Nothing in the text is expanded or removed, it is the only field of the word
+  [[nodiscard]] auto is_literal() const noexcept -> bool;
 
   [[nodiscard]] static auto from_token(lexer::Token const& token) -> std::unique_ptr<Word>;
 };
@@ -98,6 +117,7 @@ struct Command final : ASTNode {
   std::vector<std::unique_ptr<Word>>        words_;
   std::vector<std::unique_ptr<Redirection>> redirections_;
   std::vector<std::unique_ptr<Assignment>>  assignments_;
+  builtin::BuiltinIndex                     builtin_ = builtin::NOT_BUILTIN; // set if the name is a literal builtin
 
   [[nodiscard]] auto type() const noexcept -> Type override;
   [[nodiscard]] auto clone() const -> std::unique_ptr<ASTNode> override;
@@ -107,6 +127,7 @@ struct Command final : ASTNode {
 struct Pipeline final : ASTNode {
   std::vector<std::unique_ptr<ASTNode>> commands_;
   bool                                  background_ = false;
+  bool                                  timed_      = false; // preceded by the time reserved word
 
   [[nodiscard]] auto type() const noexcept -> Type override;
   [[nodiscard]] auto clone() const -> std::unique_ptr<ASTNode> override;
@@ -139,11 +160,12 @@ struct LoopStatement final : ASTNode {
     Until
   };
 
-  Kind                               kind_;
-  std::unique_ptr<Word>              variable_;
-  std::vector<std::unique_ptr<Word>> items_;
-  std::unique_ptr<Pipeline>          condition_;
-  std::unique_ptr<CompoundStatement> body_;
+  Kind                                      kind_;
+  std::unique_ptr<Word>                     variable_;
+  std::vector<std::unique_ptr<Word>>        items_;
+  std::unique_ptr<Pipeline>                 condition_;
+  std::unique_ptr<CompoundStatement>        body_;
+  std::vector<std::unique_ptr<Redirection>> redirections_; // after done, apply to the whole loop
 
   [[nodiscard]] auto type() const noexcept -> Type override;
   [[nodiscard]] auto clone() const -> std::unique_ptr<ASTNode> override;
@@ -193,4 +215,39 @@ struct LogicalExpression final : ASTNode {
   [[nodiscard]] auto clone() const -> std::unique_ptr<ASTNode> override;
 };
 
+// Conditional expression ([[ ... ]]). Operators are resolved when parsed, operands are expanded without field splitting
+// or pathname expansion.
+struct TestExpression final : ASTNode {
+  enum struct Kind {
+    Unary,  // operator_ operands_[0]
+    Binary, // operands_[0] operator_ operands_[1]
+    Not,    // ! left_
+    And,    // left_ && right_
+    Or      // left_ || right_
+  };
+
+  Kind                               kind_;
+  builtin::TestOperator              operator_ = builtin::TestOperator::NonEmptyString;
+  std::vector<std::unique_ptr<Word>> operands_;
+  std::unique_ptr<TestExpression>    left_;
+  std::unique_ptr<TestExpression>    right_;
+
+  explicit TestExpression(Kind kind);
+
+  [[nodiscard]] auto type() const noexcept -> Type override;
+  [[nodiscard]] auto clone() const -> std::unique_ptr<ASTNode> override;
+};
+
+// Function definition (name() { ... } or function name { ... }). The body is shared rather than owned, so the function
+// table and every call use the parsed statements as they are.
+struct FunctionDefinition final : ASTNode {
+  std::string_view                         name_;
+  std::shared_ptr<CompoundStatement const> body_;
+
+  FunctionDefinition(std::string_view name, std::shared_ptr<CompoundStatement const> body);
+
+  [[nodiscard]] auto type() const noexcept -> Type override;
+  [[nodiscard]] auto clone() const -> std::unique_ptr<ASTNode> override;
+};
+
 } // namespace hsh::parser
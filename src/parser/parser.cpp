@@ -6,14 +6,47 @@ module;
 #include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 module hsh.parser;
 
+import hsh.builtin.condition;
+import hsh.builtin.table;
 import hsh.lexer;
 
 namespace hsh::parser {
 
+namespace {
+
+// A command name that no expansion can change is resolved to its builtin once, here
+auto literal_builtin(Word const& word) -> builtin::BuiltinIndex {
+  if (word.token_kind_ == lexer::Token::Type::LeftBracket) {
+    return builtin::find_builtin(word.text_);
+  }
+  return word.is_literal() ? builtin::find_builtin(word.text_) : builtin::NOT_BUILTIN;
+}
+
+// `time` is only reserved where a command starts, anywhere else it is an ordinary word
+auto is_time_keyword(lexer::Token const& token) noexcept -> bool {
+  return token.kind_ == lexer::Token::Type::Word && token.text_ == "time";
+}
+
+// Tokens that can stand for an operand inside [[ ]]
+constexpr auto is_test_operand(lexer::Token::Type kind) noexcept -> bool {
+  return kind == lexer::Token::Type::Word ||
+         kind == lexer::Token::Type::SingleQuoted ||
+         kind == lexer::Token::Type::DoubleQuoted ||
+         kind == lexer::Token::Type::DollarParen ||
+         kind == lexer::Token::Type::DollarBrace ||
+         kind == lexer::Token::Type::Backtick ||
+         kind == lexer::Token::Type::Number ||
+         kind == lexer::Token::Type::LeftBracket ||
+         kind == lexer::Token::Type::RightBracket;
+}
+
+} // namespace
+
 Parser::Parser(std::string_view src)
     : lexer_(src) {
   current_token_ = lexer_.next();
@@ -59,6 +92,16 @@ auto Parser::parse_statement() -> ParseResult<ASTNode> {
     case lexer::Token::Type::Assignment: {
       return parse_assignment();
     }
+    case lexer::Token::Type::Function: {
+      return parse_function();
+    }
+    case lexer::Token::Type::Word: {
+      // A command name is never followed by '(', so this can only be `name() { ... }` or `time (...)`
+      if (!is_time_keyword(current_token_) && peek().kind_ == lexer::Token::Type::LeftParen) {
+        return parse_function();
+      }
+      return parse_logical_expression();
+    }
     default: {
       return parse_logical_expression();
     }
@@ -68,6 +111,18 @@ auto Parser::parse_statement() -> ParseResult<ASTNode> {
 auto Parser::parse_pipeline() -> ParseResult<Pipeline> {
   auto pipeline = std::make_unique<Pipeline>();
 
+  if (is_time_keyword(current_token_)) {
+    pipeline->timed_ = true;
+    advance();
+
+    // A bare `time` reports the (zero) cost of an empty pipeline
+    if (current_token_.kind_ == lexer::Token::Type::EndOfFile ||
+        current_token_.kind_ == lexer::Token::Type::NewLine ||
+        current_token_.kind_ == lexer::Token::Type::Semicolon) {
+      return std::move(pipeline);
+    }
+  }
+
   auto elem = parse_pipeline_element();
   if (!elem) {
     return std::unexpected(elem.error());
@@ -96,6 +151,14 @@ auto Parser::parse_pipeline() -> ParseResult<Pipeline> {
 }
 
 auto Parser::parse_pipeline_element() -> ParseResult<ASTNode> {
+  if (current_token_.kind_ == lexer::Token::Type::DoubleLeftBracket) {
+    auto test_result = parse_test_expression();
+    if (!test_result) {
+      return std::unexpected(test_result.error());
+    }
+    return std::unique_ptr<ASTNode>(test_result->release());
+  }
+
   if (current_token_.kind_ == lexer::Token::Type::LeftParen) {
     auto subshell_result = parse_subshell();
     if (!subshell_result) {
@@ -118,7 +181,8 @@ auto Parser::parse_pipeline_or_subshell() -> ParseResult<ASTNode> {
   }
 
   // If the pipeline contains only a single subshell, return the subshell directly
-  if (auto& pipeline = pipeline_result.value(); pipeline->commands_.size() == 1 && !pipeline->background_) {
+  if (auto& pipeline = pipeline_result.value();
+      pipeline->commands_.size() == 1 && !pipeline->background_ && !pipeline->timed_) {
     if (pipeline->commands_[0]->type() == ASTNode::Type::Subshell) {
       return std::move(pipeline->commands_[0]);
     }
@@ -175,6 +239,8 @@ auto Parser::parse_command() -> ParseResult<Command> {
       case lexer::Token::Type::DollarParen:
       case lexer::Token::Type::DollarBrace:
       case lexer::Token::Type::Backtick:
+      case lexer::Token::Type::ProcessSubstIn:
+      case lexer::Token::Type::ProcessSubstOut:
       case lexer::Token::Type::LeftBracket:
       case lexer::Token::Type::RightBracket: {
         auto word_result = parse_word();
@@ -187,6 +253,12 @@ auto Parser::parse_command() -> ParseResult<Command> {
       }
 
       case lexer::Token::Type::Assignment: {
+        // Only words in front of the command name are assignments, `export X=1` and `local X=1` get them as arguments
+        if (has_words) {
+          command->words_.push_back(Word::from_token(current_token_));
+          advance();
+          break;
+        }
         auto assign_result = parse_assignment();
         if (!assign_result) {
           return std::unexpected(assign_result.error());
@@ -245,6 +317,9 @@ auto Parser::parse_command() -> ParseResult<Command> {
         if (!has_words && command->assignments_.empty()) {
           return std::unexpected(make_error("Expected command or assignment"));
         }
+        if (has_words) {
+          command->builtin_ = literal_builtin(*command->words_[0]);
+        }
         return std::move(command);
     }
   }
@@ -257,6 +332,8 @@ auto Parser::parse_word() -> ParseResult<Word> {
       current_token_.kind_ == lexer::Token::Type::DollarParen ||
       current_token_.kind_ == lexer::Token::Type::DollarBrace ||
       current_token_.kind_ == lexer::Token::Type::Backtick ||
+      current_token_.kind_ == lexer::Token::Type::ProcessSubstIn ||
+      current_token_.kind_ == lexer::Token::Type::ProcessSubstOut ||
       current_token_.kind_ == lexer::Token::Type::Number ||
       current_token_.kind_ == lexer::Token::Type::LeftBracket ||
       current_token_.kind_ == lexer::Token::Type::RightBracket) {
@@ -291,6 +368,23 @@ auto Parser::parse_assignment() -> ParseResult<Assignment> {
   return std::move(assignment);
 }
 
+auto Parser::at_redirection() noexcept -> bool {
+  auto is_operator = [](lexer::Token::Type kind) {
+    return kind == lexer::Token::Type::Less || kind == lexer::Token::Type::Greater ||
+           kind == lexer::Token::Type::Append || kind == lexer::Token::Type::LessAnd ||
+           kind == lexer::Token::Type::GreaterAnd || kind == lexer::Token::Type::LessGreater;
+  };
+  if (is_operator(current_token_.kind_)) {
+    return true;
+  }
+  if (current_token_.kind_ != lexer::Token::Type::Number) {
+    return false;
+  }
+  auto next_token = peek();
+  return is_operator(next_token.kind_) && current_token_.line_ == next_token.line_ &&
+         current_token_.column_ + current_token_.text_.size() == next_token.column_;
+}
+
 auto Parser::parse_redirection() -> ParseResult<Redirection> {
   std::optional<int> fd;
 
@@ -566,6 +660,14 @@ auto Parser::parse_loop() -> ParseResult<LoopStatement> {
     return std::unexpected(make_error("Expected 'done' to close loop"));
   }
 
+  while (at_redirection()) {
+    auto redir_result = parse_redirection();
+    if (!redir_result) {
+      return std::unexpected(redir_result.error());
+    }
+    loop->redirections_.push_back(std::move(redir_result.value()));
+  }
+
   loop->body_ = std::move(body);
   return std::move(loop);
 }
@@ -690,6 +792,209 @@ auto Parser::parse_subshell() -> ParseResult<Subshell> {
   return std::make_unique<Subshell>(std::move(body));
 }
 
+auto Parser::parse_function() -> ParseResult<FunctionDefinition> {
+  bool keyword = consume(lexer::Token::Type::Function);
+
+  if (current_token_.kind_ != lexer::Token::Type::Word) {
+    return std::unexpected(make_error("Expected function name"));
+  }
+  auto name = current_token_.text_;
+  advance();
+
+  // The parentheses may be left out after the function keyword
+  if (consume(lexer::Token::Type::LeftParen)) {
+    if (!consume(lexer::Token::Type::RightParen)) {
+      return std::unexpected(make_error("Expected ')' after function name"));
+    }
+  } else if (!keyword) {
+    return std::unexpected(make_error("Expected '()' after function name"));
+  }
+
+  skip_newlines();
+
+  if (!consume(lexer::Token::Type::LeftBrace)) {
+    return std::unexpected(make_error("Expected '{' to start function body"));
+  }
+
+  skip_newlines();
+
+  auto body = std::make_shared<CompoundStatement>();
+
+  while (current_token_.kind_ != lexer::Token::Type::RightBrace &&
+         current_token_.kind_ != lexer::Token::Type::EndOfFile) {
+    auto stmt_result = parse_statement();
+    if (!stmt_result) {
+      return std::unexpected(stmt_result.error());
+    }
+
+    body->statements_.push_back(std::move(stmt_result.value()));
+    skip_newlines();
+
+    if (current_token_.kind_ == lexer::Token::Type::Semicolon || current_token_.kind_ == lexer::Token::Type::NewLine) {
+      advance();
+      skip_newlines();
+    }
+  }
+
+  if (!consume(lexer::Token::Type::RightBrace)) {
+    return std::unexpected(make_error("Expected '}' to close function body"));
+  }
+
+  return std::make_unique<FunctionDefinition>(name, std::move(body));
+}
+
+auto Parser::parse_test_expression() -> ParseResult<TestExpression> {
+  if (!consume(lexer::Token::Type::DoubleLeftBracket)) {
+    return std::unexpected(make_error("Expected '[[' to start conditional expression"));
+  }
+
+  auto expression = parse_test_or();
+  if (!expression) {
+    return expression;
+  }
+
+  if (!consume(lexer::Token::Type::DoubleRightBracket)) {
+    return std::unexpected(make_error("Expected ']]' to close conditional expression"));
+  }
+
+  return expression;
+}
+
+auto Parser::parse_test_or() -> ParseResult<TestExpression> {
+  auto left = parse_test_and();
+  while (left && current_token_.kind_ == lexer::Token::Type::OrOr) {
+    advance();
+    skip_newlines();
+
+    auto right = parse_test_and();
+    if (!right) {
+      return right;
+    }
+
+    auto expression    = std::make_unique<TestExpression>(TestExpression::Kind::Or);
+    expression->left_  = std::move(left.value());
+    expression->right_ = std::move(right.value());
+    left               = std::move(expression);
+  }
+  return left;
+}
+
+auto Parser::parse_test_and() -> ParseResult<TestExpression> {
+  auto left = parse_test_primary();
+  while (left && current_token_.kind_ == lexer::Token::Type::AndAnd) {
+    advance();
+    skip_newlines();
+
+    auto right = parse_test_primary();
+    if (!right) {
+      return right;
+    }
+
+    auto expression    = std::make_unique<TestExpression>(TestExpression::Kind::And);
+    expression->left_  = std::move(left.value());
+    expression->right_ = std::move(right.value());
+    left               = std::move(expression);
+  }
+  return left;
+}
+
+auto Parser::parse_test_primary() -> ParseResult<TestExpression> {
+  if (current_token_.kind_ == lexer::Token::Type::Word && current_token_.text_ == "!") {
+    advance();
+
+    auto operand = parse_test_primary();
+    if (!operand) {
+      return operand;
+    }
+
+    auto expression   = std::make_unique<TestExpression>(TestExpression::Kind::Not);
+    expression->left_ = std::move(operand.value());
+    return std::move(expression);
+  }
+
+  if (current_token_.kind_ == lexer::Token::Type::LeftParen) {
+    advance();
+
+    auto inner = parse_test_or();
+    if (!inner) {
+      return inner;
+    }
+    if (!consume(lexer::Token::Type::RightParen)) {
+      return std::unexpected(make_error("Expected ')' in conditional expression"));
+    }
+    return inner;
+  }
+
+  if (!is_test_operand(current_token_.kind_)) {
+    return std::unexpected(make_error("Expected operand in conditional expression"));
+  }
+
+  // `-f x` is a unary test, but `-f = x` compares the string "-f"
+  if (current_token_.kind_ == lexer::Token::Type::Word) {
+    if (auto op = builtin::find_unary_operator(current_token_.text_)) {
+      auto next = peek();
+      if (is_test_operand(next.kind_) &&
+          (next.kind_ != lexer::Token::Type::Word || !builtin::find_binary_operator(next.text_))) {
+        advance();
+
+        auto operand = parse_word();
+        if (!operand) {
+          return std::unexpected(operand.error());
+        }
+
+        auto expression       = std::make_unique<TestExpression>(TestExpression::Kind::Unary);
+        expression->operator_ = *op;
+        expression->operands_.push_back(std::move(operand.value()));
+        return std::move(expression);
+      }
+    }
+  }
+
+  auto left = parse_word();
+  if (!left) {
+    return std::unexpected(left.error());
+  }
+
+  std::optional<builtin::TestOperator> op;
+  if (current_token_.kind_ == lexer::Token::Type::Word) {
+    op = builtin::find_binary_operator(current_token_.text_);
+  } else if (current_token_.kind_ == lexer::Token::Type::Less) {
+    op = builtin::TestOperator::StringLess;
+  } else if (current_token_.kind_ == lexer::Token::Type::Greater) {
+    op = builtin::TestOperator::StringGreater;
+  }
+
+  if (!op) {
+    // A lone operand is true if it is not empty
+    auto expression = std::make_unique<TestExpression>(TestExpression::Kind::Unary);
+    expression->operands_.push_back(std::move(left.value()));
+    return std::move(expression);
+  }
+
+  auto expression       = std::make_unique<TestExpression>(TestExpression::Kind::Binary);
+  expression->operator_ = *op;
+  expression->operands_.push_back(std::move(left.value()));
+
+  if (*op == builtin::TestOperator::Matches) {
+    // The pattern is read raw, so its parentheses and bars are not taken as operators
+    expression->operands_.push_back(Word::from_token(lexer_.next_regex()));
+    advance();
+    return std::move(expression);
+  }
+
+  advance();
+  if (!is_test_operand(current_token_.kind_)) {
+    return std::unexpected(make_error("Expected operand after binary operator"));
+  }
+
+  auto right = parse_word();
+  if (!right) {
+    return std::unexpected(right.error());
+  }
+  expression->operands_.push_back(std::move(right.value()));
+  return std::move(expression);
+}
+
 void Parser::advance() noexcept {
   current_token_ = lexer_.next();
 }
@@ -40,6 +40,8 @@ public:
   [[nodiscard]] auto parse_loop() -> ParseResult<LoopStatement>;
   [[nodiscard]] auto parse_case() -> ParseResult<CaseStatement>;
   [[nodiscard]] auto parse_subshell() -> ParseResult<Subshell>;
+  [[nodiscard]] auto parse_test_expression() -> ParseResult<TestExpression>;
+  [[nodiscard]] auto parse_function() -> ParseResult<FunctionDefinition>;
 
   void               advance() noexcept;
   [[nodiscard]] auto peek() noexcept -> lexer::Token;
@@ -49,6 +51,12 @@ public:
 
 private:
   [[nodiscard]] auto make_error(std::string_view message) const -> std::string;
+  // A redirection operator, or a descriptor number written directly in front of one
+  [[nodiscard]] auto at_redirection() noexcept -> bool;
+  // Operands and operators inside [[ ]], || binds looser than &&, which binds looser than !
+  [[nodiscard]] auto parse_test_or() -> ParseResult<TestExpression>;
+  [[nodiscard]] auto parse_test_and() -> ParseResult<TestExpression>;
+  [[nodiscard]] auto parse_test_primary() -> ParseResult<TestExpression>;
 };
 
 } // namespace hsh::parser
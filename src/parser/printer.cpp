@@ -65,6 +65,14 @@ void ASTPrinter::print(ASTNode const& node) {
       print_logical_expression(static_cast<LogicalExpression const&>(node));
       break;
     }
+    case ASTNode::Type::TestExpression: {
+      print_test_expression(static_cast<TestExpression const&>(node));
+      break;
+    }
+    case ASTNode::Type::FunctionDefinition: {
+      print_function(static_cast<FunctionDefinition const&>(node));
+      break;
+    }
   }
 }
 
@@ -175,6 +183,10 @@ void ASTPrinter::print_pipeline(Pipeline const& pipeline) {
     print_indented("Background: true");
   }
 
+  if (pipeline.timed_) {
+    print_indented("Timed: true");
+  }
+
   print_indented("Commands:");
   indent_level_++;
   for (auto const& cmd : pipeline.commands_) {
@@ -346,4 +358,45 @@ void ASTPrinter::print_logical_expression(LogicalExpression const& logical_expr)
   indent_level_--;
 }
 
+void ASTPrinter::print_test_expression(TestExpression const& test_expr) {
+  switch (test_expr.kind_) {
+    case TestExpression::Kind::Unary:
+    case TestExpression::Kind::Binary: {
+      print_indented(std::format("TestExpression: operator {}", static_cast<int>(test_expr.operator_)));
+      indent_level_++;
+      for (auto const& operand : test_expr.operands_) {
+        print(*operand);
+      }
+      indent_level_--;
+      return;
+    }
+    case TestExpression::Kind::Not: {
+      print_indented("TestExpression: !");
+      break;
+    }
+    case TestExpression::Kind::And: {
+      print_indented("TestExpression: &&");
+      break;
+    }
+    case TestExpression::Kind::Or: {
+      print_indented("TestExpression: ||");
+      break;
+    }
+  }
+
+  indent_level_++;
+  print(*test_expr.left_);
+  if (test_expr.right_) {
+    print(*test_expr.right_);
+  }
+  indent_level_--;
+}
+
+void ASTPrinter::print_function(FunctionDefinition const& function) {
+  print_indented(std::format("FunctionDefinition: {}", function.name_));
+  indent_level_++;
+  print(*function.body_);
+  indent_level_--;
+}
+
 } // namespace hsh::parser
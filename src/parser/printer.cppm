@@ -29,6 +29,8 @@ private:
   void print_compound(CompoundStatement const& compound);
   void print_subshell(Subshell const& subshell);
   void print_logical_expression(LogicalExpression const& logical_expr);
+  void print_test_expression(TestExpression const& test_expr);
+  void print_function(FunctionDefinition const& function);
 };
 
 } // namespace hsh::parser
@@ -1,20 +1,20 @@
 module;
 
-#include <coroutine>
-#include <generator>
-#include <iostream>
 #include <print>
 #include <string>
 #include <string_view>
 #include <vector>
 
+#include <sys/ioctl.h>
+#include <unistd.h>
+
 module hsh.shell.app;
 
+import hsh.shell.event_loop;
 import hsh.shell.prompt;
 import hsh.shell.runner;
 import hsh.core;
 import hsh.cli;
-import hsh.builtin;
 import hsh.parser;
 
 namespace hsh::shell {
@@ -27,14 +27,6 @@ auto print_ast(std::string_view line) -> void {
   }
 }
 
-auto read_lines() -> std::generator<std::string> {
-  // TODO: non-blocking readline
-  std::string line;
-  while (std::getline(std::cin, line)) {
-    co_yield line;
-  }
-}
-
 } // namespace
 
 auto App::run(int argc, char const** argv) -> int {
@@ -86,7 +78,6 @@ auto App::initialize_shell(int argc, char const** argv) -> void {
   context_.set_shell_pid(core::syscall::get_pid());
   context_.set_script_name(argv[0]);
 
-  builtin::register_all_builtins();
   if (is_interactive_) {
     if (auto result = core::SignalManager::instance().install_handlers(); !result) {
       std::println(stderr, "Warning: Failed to install signal handlers");
@@ -95,43 +86,63 @@ auto App::initialize_shell(int argc, char const** argv) -> void {
 }
 
 auto App::run_interactive() -> int {
+  // Finished jobs are only reported to a user at a terminal, a script collects them with wait
+  EventLoop loop(STDIN_FILENO, is_interactive_ ? job_manager_.event_fd() : -1, is_interactive_);
+
   if (is_interactive_) {
+    update_window_size();
     runner_.check_background_jobs();
     print_prompt();
   }
 
-  for (auto const& line : read_lines()) {
-    if (verbose_) {
-      print_ast(line);
-    }
+  for (bool running = true; running;) {
+    auto event = loop.next();
 
-    if (line.empty()) {
-      if (is_interactive_) {
-        runner_.check_background_jobs();
+    switch (event.type_) {
+      case Event::Type::EndOfInput: running = false; break;
+      case Event::Type::Interrupt:
+        context_.set_exit_status(130);
+        std::println(stderr);
         print_prompt();
-      }
-      continue;
+        break;
+      case Event::Type::JobChanged:
+        // Notify right away instead of waiting for the next line
+        if (runner_.check_background_jobs(is_interactive_) > 0) {
+          print_prompt();
+        }
+        break;
+      case Event::Type::Resize: update_window_size(); break;
+      case Event::Type::Line: running = run_line(event.line_); break;
     }
+  }
 
-    if (line == "exit") {
-      break;
-    }
+  if (is_interactive_ && verbose_) {
+    std::println("Goodbye!");
+  }
+
+  return 0;
+}
+
+auto App::run_line(std::string const& line) -> bool {
+  if (verbose_) {
+    print_ast(line);
+  }
 
+  if (line == "exit") {
+    return false;
+  }
+
+  if (!line.empty()) {
     if (auto exec_result = runner_.run(line); !exec_result.success_) {
       std::println(stderr, "Error: {}", exec_result.error_message_);
     }
-
-    if (is_interactive_) {
-      runner_.check_background_jobs();
-      print_prompt();
-    }
   }
 
-  if (is_interactive_ && verbose_) {
-    std::println("Goodbye!");
+  if (is_interactive_) {
+    runner_.check_background_jobs();
+    print_prompt();
   }
-
-  return 0;
+  return true;
 }
 
 auto App::run_command(std::string_view command) -> int {
@@ -139,12 +150,23 @@ auto App::run_command(std::string_view command) -> int {
     print_ast(command);
   }
 
-  if (auto exec_result = runner_.run(command); !exec_result.success_) {
+  // Nothing runs after the command, so its last external command replaces the shell
+  auto exec_result = runner_.run(command, true);
+  if (!exec_result.success_) {
     std::println(stderr, "Error: {}", exec_result.error_message_);
-    return 1;
+    return exec_result.exit_status_ != 0 ? exec_result.exit_status_ : 1;
   }
 
-  return 0;
+  return exec_result.exit_status_;
+}
+
+auto App::update_window_size() -> void {
+  winsize size{};
+  if (ioctl(STDIN_FILENO, TIOCGWINSZ, &size) == -1) {
+    return;
+  }
+  context_.set_variable("COLUMNS", std::to_string(size.ws_col));
+  context_.set_variable("LINES", std::to_string(size.ws_row));
 }
 
 auto App::print_prompt() -> void {
@@ -1,6 +1,6 @@
 module;
 
-#include <iostream>
+#include <string>
 #include <string_view>
 
 #include <unistd.h>
@@ -29,7 +29,9 @@ public:
 private:
   auto initialize_shell(int argc, char const** argv) -> void;
   auto run_interactive() -> int;
+  auto run_line(std::string const& line) -> bool;
   auto run_command(std::string_view command) -> int;
+  auto update_window_size() -> void;
   auto print_prompt() -> void;
 };
 
@@ -0,0 +1,156 @@
+module;
+
+#include <array>
+#include <cerrno>
+#include <csignal>
+#include <optional>
+#include <string>
+
+#include <poll.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
+
+module hsh.shell.event_loop;
+
+import hsh.core;
+
+namespace hsh::shell {
+
+namespace {
+
+constexpr std::array<core::Signal, 4> LOOP_SIGNALS{
+    core::Signal::CHLD, core::Signal::INT, core::Signal::TSTP, core::Signal::WINCH
+};
+
+constexpr size_t READ_CHUNK = 4096;
+
+} // namespace
+
+EventLoop::EventLoop(int input_fd, int job_fd, bool handle_signals)
+    : input_fd_(input_fd), job_fd_(job_fd), signals_(core::signal::make_set(LOOP_SIGNALS)) {
+  if (!handle_signals) {
+    return;
+  }
+  if (auto fd = core::syscall::open_signalfd(signals_)) {
+    signal_fd_.reset(*fd);
+  }
+}
+
+EventLoop::~EventLoop() {
+  if (signal_fd_.valid()) {
+    [[maybe_unused]] auto _ = core::SignalManager::instance().unblock_signals(signals_);
+  }
+}
+
+auto EventLoop::next() -> Event {
+  if (signal_fd_.valid()) {
+    // Pending signals stay queued on the signalfd instead of interrupting the handlers
+    [[maybe_unused]] auto _ = core::SignalManager::instance().block_signals(signals_);
+  }
+
+  // Whatever the event, commands run with the signals unblocked again
+  core::util::ScopeExit release{[this] {
+    if (signal_fd_.valid()) {
+      [[maybe_unused]] auto _ = core::SignalManager::instance().unblock_signals(signals_);
+    }
+  }};
+
+  while (true) {
+    if (auto line = take_line()) {
+      return Event{Event::Type::Line, std::move(*line)};
+    }
+    if (end_of_input_) {
+      return Event{Event::Type::EndOfInput, {}};
+    }
+
+    // poll skips negative fds, so a missing signalfd or job fd is simply never ready
+    std::array<pollfd, 3> fds{{
+        {.fd = input_fd_, .events = POLLIN, .revents = 0},
+        {.fd = signal_fd_.get(), .events = POLLIN, .revents = 0},
+        {.fd = job_fd_, .events = POLLIN, .revents = 0},
+    }};
+    if (poll(fds.data(), fds.size(), -1) == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      end_of_input_ = true;
+      continue;
+    }
+
+    if ((fds[1].revents & POLLIN) != 0) {
+      if (auto type = read_signals()) {
+        return Event{*type, {}};
+      }
+    }
+    if ((fds[2].revents & POLLIN) != 0) {
+      return Event{Event::Type::JobChanged, {}};
+    }
+    if ((fds[0].revents & (POLLIN | POLLHUP | POLLERR)) != 0) {
+      read_input();
+    }
+  }
+}
+
+auto EventLoop::take_line() -> std::optional<std::string> {
+  size_t newline = buffer_.find('\n');
+  if (newline == std::string::npos) {
+    if (!end_of_input_ || buffer_.empty()) {
+      return std::nullopt;
+    }
+    // An unterminated last line is still a line
+    newline = buffer_.size();
+  }
+
+  std::string line = buffer_.substr(0, newline);
+  buffer_.erase(0, newline + 1);
+  return line;
+}
+
+auto EventLoop::read_signals() -> std::optional<Event::Type> {
+  std::optional<Event::Type> result;
+
+  signalfd_siginfo info{};
+  while (read(signal_fd_.get(), &info, sizeof(info)) == sizeof(info)) {
+    switch (static_cast<int>(info.ssi_signo)) {
+      case SIGINT:
+        // The terminal already flushed its own queue, drop what was buffered here too
+        buffer_.clear();
+        result = Event::Type::Interrupt;
+        break;
+      case SIGWINCH:
+        if (result != Event::Type::Interrupt) {
+          result = Event::Type::Resize;
+        }
+        break;
+      case SIGCHLD:
+        if (!result) {
+          result = Event::Type::JobChanged;
+        }
+        break;
+      default:
+        // SIGTSTP at the prompt has nothing to stop
+        break;
+    }
+  }
+
+  return result;
+}
+
+auto EventLoop::read_input() -> void {
+  std::array<char, READ_CHUNK> chunk{};
+
+  auto result = core::syscall::read_fd(input_fd_, chunk.data(), chunk.size());
+  if (!result) {
+    if (result.error() != EINTR && result.error() != EAGAIN) {
+      end_of_input_ = true;
+    }
+    return;
+  }
+  if (*result == 0) {
+    end_of_input_ = true;
+    return;
+  }
+  buffer_.append(chunk.data(), *result);
+}
+
+} // namespace hsh::shell
@@ -0,0 +1,54 @@
+module;
+
+#include <csignal>
+#include <optional>
+#include <string>
+
+export module hsh.shell.event_loop;
+
+import hsh.core;
+
+export namespace hsh::shell {
+
+struct Event {
+  enum struct Type {
+    Line,       // a complete line of input
+    EndOfInput, // input closed, any unterminated line was returned before
+    Interrupt,  // SIGINT at the prompt, the pending input is discarded
+    JobChanged, // a child exited or changed state
+    Resize,     // the terminal window changed size
+  };
+
+  Type        type_;
+  std::string line_;
+};
+
+// Waits on the input fd, a signalfd and the job manager's pidfd set at once. Signals routed through the signalfd are
+// only blocked while the shell is idle, commands run with the handlers installed by SignalManager.
+class EventLoop {
+  int                  input_fd_;
+  int                  job_fd_;
+  core::FileDescriptor signal_fd_;
+  sigset_t             signals_;
+  std::string          buffer_;
+  bool                 end_of_input_ = false;
+
+public:
+  EventLoop(int input_fd, int job_fd, bool handle_signals);
+  ~EventLoop();
+
+  EventLoop(EventLoop const&)            = delete;
+  EventLoop& operator=(EventLoop const&) = delete;
+  EventLoop(EventLoop&&)                 = delete;
+  EventLoop& operator=(EventLoop&&)      = delete;
+
+  // Blocks without spinning until the next event is available
+  auto next() -> Event;
+
+private:
+  auto take_line() -> std::optional<std::string>;
+  auto read_signals() -> std::optional<Event::Type>;
+  auto read_input() -> void;
+};
+
+} // namespace hsh::shell
@@ -1,16 +1,26 @@
 module;
 
-#include <array>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
 #include <expected>
 #include <format>
+#include <functional>
 #include <memory>
-#include <print>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 
 #include <cerrno>
+#include <csignal>
 #include <cstring>
 #include <fcntl.h>
+#include <spawn.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
@@ -19,6 +29,7 @@ module hsh.shell.runner;
 
 import hsh.core;
 import hsh.expand;
+import hsh.lexer;
 import hsh.parser;
 import hsh.builtin;
 
@@ -26,14 +37,226 @@ namespace hsh::shell {
 
 namespace {
 
-constexpr auto build_argv(std::span<std::string const> args) -> std::vector<char*> {
-  std::vector<char*> argv;
-  argv.reserve(args.size() + 1);
-  for (auto const& arg : args) {
-    argv.push_back(const_cast<char*>(arg.c_str()));
+// posix_spawn attributes and file actions for one child, released on scope exit
+class SpawnRequest {
+  posix_spawn_file_actions_t actions_{};
+  posix_spawnattr_t          attr_{};
+
+public:
+  explicit SpawnRequest(pid_t pgid) noexcept {
+    posix_spawn_file_actions_init(&actions_);
+    posix_spawnattr_init(&attr_);
+
+    // Same signals the shell changes, see SignalManager::reset_handlers
+    sigset_t defaults;
+    sigemptyset(&defaults);
+    for (int sig : {SIGINT, SIGCHLD, SIGTSTP, SIGTTOU, SIGTTIN, SIGQUIT}) {
+      sigaddset(&defaults, sig);
+    }
+    sigset_t mask;
+    sigemptyset(&mask);
+
+    posix_spawnattr_setpgroup(&attr_, pgid);
+    posix_spawnattr_setsigdefault(&attr_, &defaults);
+    posix_spawnattr_setsigmask(&attr_, &mask);
+    posix_spawnattr_setflags(&attr_, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK);
+  }
+  ~SpawnRequest() noexcept {
+    posix_spawn_file_actions_destroy(&actions_);
+    posix_spawnattr_destroy(&attr_);
+  }
+
+  SpawnRequest(SpawnRequest const&)            = delete;
+  SpawnRequest& operator=(SpawnRequest const&) = delete;
+
+  void dup_to(int fd, int target_fd) noexcept {
+    posix_spawn_file_actions_adddup2(&actions_, fd, target_fd);
+  }
+
+  [[nodiscard]] auto actions() const noexcept -> posix_spawn_file_actions_t const* {
+    return &actions_;
+  }
+  [[nodiscard]] auto attr() const noexcept -> posix_spawnattr_t const* {
+    return &attr_;
+  }
+};
+
+// PATH as the command will see it, including a `PATH=... command` assignment
+auto search_path(std::span<std::pair<std::string, std::string> const> assignments, context::Context& context)
+    -> std::string_view {
+  for (auto const& [name, value] : assignments | std::views::reverse) {
+    if (name == "PATH") {
+      return value;
+    }
+  }
+  return context.get_variable("PATH").value_or("/bin:/usr/bin");
+}
+
+// Launch an external command directly, without a copy of the shell in between
+auto spawn_external(
+    std::span<std::string const>                          argv,
+    std::span<std::pair<int, core::FileDescriptor> const> redirections,
+    pid_t                                                 pgid,
+    int                                                   stdin_fd,
+    int                                                   stdout_fd,
+    std::span<std::pair<std::string, std::string> const>  assignments,
+    context::Context&                                     context
+) -> core::syscall::Result<pid_t> {
+  auto path = core::syscall::find_executable(argv[0], search_path(assignments, context));
+  if (!path) {
+    return std::unexpected(path.error());
+  }
+
+  // Whatever the shell printed so far comes before the output of the command
+  [[maybe_unused]] auto _ = core::flush_output();
+
+  SpawnRequest request{pgid};
+  if (stdin_fd != -1) {
+    request.dup_to(stdin_fd, STDIN_FILENO);
+  }
+  if (stdout_fd != -1) {
+    request.dup_to(stdout_fd, STDOUT_FILENO);
+  }
+  // Redirections come after the pipe ends so that they take precedence
+  for (auto const& [target_fd, fd] : redirections) {
+    request.dup_to(fd.get(), target_fd);
+  }
+
+  // Only a command with its own assignments needs a block of its own
+  core::env::Block environment;
+  if (!assignments.empty()) {
+    environment = core::env::envp_with(assignments);
+  }
+  auto envp = assignments.empty() ? core::env::envp() : environment.envp();
+
+  return core::syscall::spawn_process(*path, argv, envp, request.actions(), request.attr());
+}
+
+constexpr auto decode_exit_status(int status) noexcept -> int {
+  if (WIFEXITED(status)) {
+    return WEXITSTATUS(status);
+  }
+  if (WIFSIGNALED(status)) {
+    return 128 + WTERMSIG(status);
+  }
+  return 1;
+}
+
+constexpr auto spawn_error_status(int error) noexcept -> int {
+  return error == ENOENT ? 127 : 126;
+}
+
+auto describe_stage(parser::ASTNode const& stage) -> std::string {
+  if (stage.type() != parser::ASTNode::Type::Command) {
+    return "(...)";
+  }
+  auto const& cmd = static_cast<parser::Command const&>(stage);
+
+  std::string description;
+  for (size_t i = 0; i < cmd.words_.size(); ++i) {
+    if (i > 0) {
+      description += ' ';
+    }
+    description += cmd.words_[i]->text_;
+  }
+  return description;
+}
+
+auto describe_pipeline(parser::Pipeline const& pipeline) -> std::string {
+  std::string description;
+  for (auto const& stage : pipeline.commands_) {
+    if (!description.empty()) {
+      description += " | ";
+    }
+    description += describe_stage(*stage);
+  }
+  return description;
+}
+
+// Deeper recursion is reported instead of running out of stack. Every call goes through several execute_ast frames,
+// a few KiB of stack in a debug build, so this stays well inside the default 8 MiB.
+constexpr size_t MAX_FUNCTION_DEPTH = 256;
+
+auto is_process_substitution(parser::Word const& word) noexcept -> bool {
+  return word.token_kind_ == lexer::Token::Type::ProcessSubstIn ||
+         word.token_kind_ == lexer::Token::Type::ProcessSubstOut;
+}
+
+// Escapes every character that is special in an extended regular expression
+auto escape_regex(std::string_view text) -> std::string {
+  std::string escaped;
+  escaped.reserve(text.size());
+  for (char c : text) {
+    if (std::string_view{"\\^$.|?*+()[]{}"}.contains(c)) {
+      escaped += '\\';
+    }
+    escaped += c;
+  }
+  return escaped;
+}
+
+// The regular expression the right operand of =~ stands for. Quoted parts and escaped characters match themselves,
+// variables are expanded everywhere but in single quotes.
+auto regex_of(std::string_view operand, context::Context& context) -> std::string {
+  std::string regex;
+  std::string unquoted;
+  auto        flush = [&] {
+    regex += expand::expand_variables(unquoted, context);
+    unquoted.clear();
+  };
+
+  for (size_t pos = 0; pos < operand.size();) {
+    char c = operand[pos];
+    if (c == '\\' && pos + 1 < operand.size()) {
+      flush();
+      regex += escape_regex(operand.substr(pos + 1, 1));
+      pos += 2;
+      continue;
+    }
+    if (c != '\'' && c != '"') {
+      unquoted += c;
+      ++pos;
+      continue;
+    }
+
+    flush();
+    std::string quoted;
+    for (++pos; pos < operand.size() && operand[pos] != c; ++pos) {
+      // Inside double quotes a backslash only escapes what would be special there, \$ is left to the expansion
+      bool escaped = c == '"' && operand[pos] == '\\' && pos + 1 < operand.size();
+      if (escaped && std::string_view{"\"\\`"}.contains(operand[pos + 1])) {
+        ++pos;
+      }
+      quoted += operand[pos];
+    }
+    ++pos;
+    regex += escape_regex(c == '"' ? expand::expand_variables(quoted, context) : quoted);
+  }
+  flush();
+  return regex;
+}
+
+// The command that runs last in node if it runs at all, nothing can follow it. Only commands and pipelines are looked
+// into, whatever may run a command more than once is not.
+auto final_command(parser::ASTNode const& node) -> parser::ASTNode const* {
+  switch (node.type()) {
+    case parser::ASTNode::Type::CompoundStatement: {
+      auto const& compound = static_cast<parser::CompoundStatement const&>(node);
+      return compound.statements_.empty() ? nullptr : final_command(*compound.statements_.back());
+    }
+    case parser::ASTNode::Type::LogicalExpression: {
+      return final_command(*static_cast<parser::LogicalExpression const&>(node).right_);
+    }
+    case parser::ASTNode::Type::Pipeline: {
+      auto const& pipeline = static_cast<parser::Pipeline const&>(node);
+      if (pipeline.background_ || pipeline.timed_ || pipeline.commands_.empty()) {
+        return nullptr;
+      }
+      return pipeline.commands_.size() == 1 ? final_command(*pipeline.commands_[0]) : &node;
+    }
+    case parser::ASTNode::Type::Command: return &node;
+    default:                             return nullptr;
   }
-  argv.push_back(nullptr);
-  return argv;
 }
 
 } // namespace
@@ -41,17 +264,26 @@ constexpr auto build_argv(std::span<std::string const> args) -> std::vector<char
 Runner::Runner(context::Context& context, job::JobManager& job_manager)
     : context_(context), job_manager_(job_manager) {}
 
-auto Runner::run(std::string_view input) -> ExecutionResult {
+auto Runner::run(std::string_view input, bool last) -> ExecutionResult {
   if (input.empty()) {
     return ExecutionResult{0, "", true};
   }
 
-  auto result = parse_input(input);
+  // Functions defined here outlive the call, so the words of their bodies point into a copy of the input
+  auto source = std::make_shared<std::string const>(input);
+  auto result = parse_input(*source);
   if (!result) {
     return ExecutionResult{1, std::format("Parse error: {}", result.error()), false};
   }
 
-  return execute_ast(**result);
+  auto previous  = std::exchange(source_, std::move(source));
+  auto tail      = std::exchange(exec_tail_, last ? final_command(**result) : nullptr);
+  auto execution = execute_ast(**result);
+  exec_tail_     = tail;
+  source_        = std::move(previous);
+
+  [[maybe_unused]] auto _ = core::flush_output();
+  return execution;
 }
 
 auto Runner::parse_input(std::string_view input) -> Result<std::unique_ptr<parser::ASTNode>> {
@@ -65,37 +297,28 @@ auto Runner::parse_input(std::string_view input) -> Result<std::unique_ptr<parse
   return std::unique_ptr<parser::ASTNode>(compound_result->release());
 }
 
-void Runner::check_background_jobs() const {
-  // Check if SIGCHLD was received
-  if (core::SignalManager::instance().check_sigchld()) {
-    pid_t pid = 0;
-    int   status = 0;
-
-    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
-      if (WIFSTOPPED(status)) {
-        // Process was stopped (SIGTSTP)
-        if (auto job = job_manager_.get().process_completed_pid(pid)) {
-          job_manager_.get().add_job(pid, job->command_);
-          job_manager_.get().update_job_status(pid, job::JobStatus::Stopped);
-          std::println("[{}]  + stopped     {}", job->job_id_, job->command_);
-        }
-      } else {
-        // Process completed
-        if (auto job = job_manager_.get().process_completed_pid(pid)) {
-          std::println("[{}]  + done       {}", job->job_id_, job->command_);
-        }
-      }
-    }
+auto Runner::check_background_jobs(bool asynchronous) const -> size_t {
+  // Only jobs whose pidfd became readable are looked at, see JobManager
+  auto done = job_manager_.get().check_background_jobs();
+  if (done.empty()) {
+    return 0;
   }
 
-  // Also check jobs tracked by job manager
-  for (auto const& job : job_manager_.get().check_background_jobs()) {
-    std::println("[{}]  + done       {}", job.job_id_, job.command_);
+  auto& output = core::standard_output();
+  if (asynchronous) {
+    output.write("\n");
+  }
+  for (auto const& job : done) {
+    output.println("[{}]  + done       {}", job.job_id_, job.command_);
   }
+  [[maybe_unused]] auto _ = core::flush_output();
+  return done.size();
 }
 
 auto Runner::execute_subshell(parser::CompoundStatement const& body) -> ExecutionResult {
-  pid_t pid = fork();
+  // Flushed first, the child would write its copy of the buffered output a second time
+  [[maybe_unused]] auto _ = core::flush_output();
+  pid_t                 pid = fork();
 
   if (pid == -1) {
     return ExecutionResult{1, std::format("Failed to fork for subshell: {}", std::strerror(errno)), false};
@@ -111,6 +334,9 @@ auto Runner::execute_subshell(parser::CompoundStatement const& body) -> Executio
 
     auto   subshell_context = context_.get().create_scope();
     Runner subshell_runner(subshell_context, job_manager_);
+    subshell_runner.functions_ = functions_;
+    // The child exits after the body, so its last command can take its place
+    subshell_runner.exec_tail_ = final_command(body);
 
     int exit_status = 0;
 
@@ -128,8 +354,9 @@ auto Runner::execute_subshell(parser::CompoundStatement const& body) -> Executio
   // Set foreground process and wait
   core::SignalManager::instance().set_foreground_process(pid);
 
-  int status = 0;
-  if (waitpid(pid, &status, 0) == -1) {
+  int    status = 0;
+  rusage usage{};
+  if (wait4(pid, &status, 0, &usage) == -1) {
     if (errno == EINTR) {
       core::SignalManager::instance().set_foreground_process(0);
       context_.get().set_exit_status(130);
@@ -140,6 +367,7 @@ auto Runner::execute_subshell(parser::CompoundStatement const& body) -> Executio
   }
 
   core::SignalManager::instance().set_foreground_process(0);
+  record_usage(pid, 0, usage);
 
   if (WIFSIGNALED(status)) {
     int sig = WTERMSIG(status);
@@ -153,13 +381,312 @@ auto Runner::execute_subshell(parser::CompoundStatement const& body) -> Executio
   return ExecutionResult{exit_status, "", true};
 }
 
+auto Runner::expand_process_substitution(parser::Word const& word, std::vector<core::FileDescriptor>& fds)
+    -> Result<std::string> {
+  bool const       is_input = word.token_kind_ == lexer::Token::Type::ProcessSubstIn;
+  std::string_view inner    = word.text_.substr(2);
+  if (inner.ends_with(')')) {
+    inner.remove_suffix(1);
+  }
+
+  auto pipe_result = core::make_pipe();
+  if (!pipe_result) {
+    return std::unexpected(pipe_result.error());
+  }
+  auto& [read_end, write_end] = *pipe_result;
+
+  [[maybe_unused]] auto _   = core::flush_output();
+  pid_t                 pid = fork();
+  if (pid == -1) {
+    return std::unexpected(std::format("Failed to fork for process substitution: {}", std::strerror(errno)));
+  }
+
+  if (pid == 0) {
+    // Child process - run the inner list with the pipe as stdout (<(...)) or stdin (>(...))
+    [[maybe_unused]] auto _ = core::SignalManager::instance().reset_handlers();
+
+    fds.clear();
+    if (is_input) {
+      dup2(write_end.get(), STDOUT_FILENO);
+    } else {
+      dup2(read_end.get(), STDIN_FILENO);
+    }
+    read_end.reset();
+    write_end.reset();
+
+    auto result = run(inner, true);
+    std::exit(result.exit_status_);
+  }
+
+  job_manager_.get().track_helper(pid);
+
+  // Keep our end open and inheritable until the outer command has finished
+  auto& kept = is_input ? read_end : write_end;
+  if (auto result = core::syscall::set_cloexec(kept.get(), false); !result) {
+    return std::unexpected(std::format("Failed to set up process substitution: {}", std::strerror(result.error())));
+  }
+
+  auto path = std::format("/dev/fd/{}", kept.get());
+  fds.push_back(std::move(kept));
+  return path;
+}
+
+auto Runner::launch_pipeline(parser::Pipeline const& pipeline, core::FileDescriptor* tail_stdin)
+    -> Result<std::vector<PipelineProcess>> {
+  auto const& commands = pipeline.commands_;
+  size_t      launched = tail_stdin != nullptr ? commands.size() - 1 : commands.size();
+
+  std::vector<PipelineProcess> processes;
+  processes.reserve(commands.size());
+
+  // All stages share the process group of the first one, so the pipeline is one job
+  pid_t pgid = 0;
+
+  // Nothing buffered may be duplicated into the forked stages
+  [[maybe_unused]] auto _ = core::flush_output();
+
+  // Pipes are created lazily between adjacent stages, so the shell never holds more than
+  // one pipe at a time and each stage costs a constant number of syscalls
+  core::FileDescriptor stage_stdin;
+  std::string          failure;
+
+  for (size_t i = 0; i < launched; ++i) {
+    core::FileDescriptor stage_stdout;
+    core::FileDescriptor next_stdin;
+
+    if (i + 1 < commands.size()) {
+      auto pipe_result = core::make_pipe();
+      if (!pipe_result) {
+        failure = std::move(pipe_result.error());
+        break;
+      }
+      next_stdin   = std::move(pipe_result->first);
+      stage_stdout = std::move(pipe_result->second);
+    }
+
+    // Plain external commands are spawned directly, everything else runs in a forked shell that expands its words once
+    if (is_external_stage(*commands[i])) {
+      auto const& cmd     = static_cast<parser::Command const&>(*commands[i]);
+      auto        process = spawn_stage(cmd, pgid, stage_stdin.get(), stage_stdout.get());
+      if (!process) {
+        failure = std::move(process.error());
+        break;
+      }
+      if (pgid == 0 && process->pid_ != -1) {
+        pgid = process->pid_;
+      }
+      processes.push_back(*process);
+      stage_stdin = std::move(next_stdin);
+      continue;
+    }
+
+    pid_t pid = fork();
+
+    if (pid == -1) {
+      failure = std::format("Failed to fork for pipeline: {}", std::strerror(errno));
+      break;
+    }
+
+    if (pid == 0) {
+      // Child process - reset signal handlers
+      [[maybe_unused]] auto _ = core::SignalManager::instance().reset_handlers();
+
+      // Set process group
+      if (setpgid(0, pgid) == -1) {
+        // Non-fatal
+      }
+
+      if (stage_stdin.valid()) {
+        dup2(stage_stdin.get(), STDIN_FILENO);
+      }
+      if (stage_stdout.valid()) {
+        dup2(stage_stdout.get(), STDOUT_FILENO);
+      }
+
+      // Only our own two ends (and the next stage's read end) are open here
+      stage_stdin.reset();
+      stage_stdout.reset();
+      next_stdin.reset();
+
+      // Whatever else the shell holds must not leak into the commands we exec. Redirections are meant for fds 0-9 and
+      // the shell keeps its own at 10 and above (see redirect_in_place), so only those are marked.
+      [[maybe_unused]] auto __ = core::syscall::close_range(10, ~0U, CLOSE_RANGE_CLOEXEC);
+
+      auto result = execute_ast(*commands[i]);
+      std::exit(result.exit_status_);
+    }
+
+    if (pgid == 0) {
+      pgid = pid;
+    }
+    // Also set it from the parent so that there is no race with the child
+    setpgid(pid, pgid);
+
+    processes.push_back(PipelineProcess{pid, 0});
+
+    // Our copies of this stage's ends are closed here, the next stage reads from next_stdin
+    stage_stdin = std::move(next_stdin);
+  }
+
+  if (!failure.empty()) {
+    // The stages already running belong to a pipeline that is never completed, they are stopped and reaped here
+    stage_stdin.reset();
+    if (pgid != 0) {
+      kill(-pgid, SIGTERM);
+      kill(-pgid, SIGCONT);
+    }
+    for (auto const& process : processes) {
+      if (process.pid_ != -1) {
+        while (waitpid(process.pid_, nullptr, 0) == -1 && errno == EINTR) {}
+      }
+    }
+    return std::unexpected(std::move(failure));
+  }
+
+  if (tail_stdin != nullptr) {
+    *tail_stdin = std::move(stage_stdin);
+  }
+  return processes;
+}
+
+auto Runner::is_external_stage(parser::ASTNode const& stage) const -> bool {
+  if (stage.type() != parser::ASTNode::Type::Command) {
+    return false;
+  }
+  // Classified by the word as written, expanding it here would run its side effects again in a forked stage
+  auto const& cmd = static_cast<parser::Command const&>(stage);
+  if (cmd.words_.empty() || cmd.builtin_ != builtin::NOT_BUILTIN || !cmd.words_[0]->is_literal()) {
+    return false;
+  }
+  auto name = cmd.words_[0]->text_;
+  return !functions_.contains(name) && !builtin::Registry::instance().find(name);
+}
+
+auto Runner::spawn_stage(parser::Command const& cmd, pid_t pgid, int stdin_fd, int stdout_fd)
+    -> Result<PipelineProcess> {
+  // Like a forked stage, the command cannot change the shell: its words are expanded in a scope that is dropped after
+  auto                  scope = context_.get().create_scope();
+  core::util::ScopeExit restore{[this, shell = std::exchange(context_, std::ref(scope))] { context_ = shell; }};
+
+  std::vector<std::string>          argv{std::string{cmd.words_[0]->text_}};
+  std::vector<core::FileDescriptor> substitution_fds;
+  if (auto result = expand_arguments(cmd, argv, substitution_fds); !result) {
+    return std::unexpected(result.error());
+  }
+
+  auto redirections = open_redirections(cmd.redirections_);
+  if (!redirections) {
+    core::standard_error().println("hsh: {}", redirections.error());
+    return PipelineProcess{-1, 1};
+  }
+
+  auto assignments = expand_assignments(cmd);
+  auto pid         = spawn_external(argv, *redirections, pgid, stdin_fd, stdout_fd, assignments, context_);
+  if (!pid) {
+    auto reason = pid.error() == ENOENT ? std::string_view{"command not found"} : std::strerror(pid.error());
+    core::standard_error().println("hsh: {}: {}", argv[0], reason);
+    return PipelineProcess{-1, spawn_error_status(pid.error())};
+  }
+  return PipelineProcess{*pid, 0};
+}
+
+auto Runner::wait_pipeline(std::span<PipelineProcess const> processes) -> Result<PipelineStatus> {
+  PipelineStatus result;
+  auto&          statuses = result.statuses_;
+  statuses.reserve(processes.size());
+
+  pid_t             pgid    = 0;
+  size_t            pending = 0;
+  std::vector<bool> reaped(processes.size(), true);
+  for (auto const& process : processes) {
+    statuses.push_back(process.exit_status_);
+    if (process.pid_ != -1) {
+      pgid = pgid == 0 ? process.pid_ : pgid;
+      reaped[statuses.size() - 1] = false;
+      ++pending;
+    }
+  }
+
+  if (pending == 0) {
+    return result;
+  }
+
+  core::SignalManager::instance().set_foreground_process(pgid);
+
+  // Stages are reaped in the order they exit, so a slow early stage does not hold up the rest
+  while (pending > 0) {
+    int    status = 0;
+    rusage usage{};
+    pid_t  pid = wait4(-pgid, &status, WUNTRACED, &usage);
+    if (pid == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      core::SignalManager::instance().set_foreground_process(0);
+      return std::unexpected(std::format("Failed to wait for pipeline process: {}", std::strerror(errno)));
+    }
+
+    auto it = std::ranges::find(processes, pid, &PipelineProcess::pid_);
+    if (it == processes.end()) {
+      continue;
+    }
+    auto stage = static_cast<size_t>(it - processes.begin());
+
+    // Ctrl-Z reached the whole process group, the stages left are handed back as a stopped job
+    if (WIFSTOPPED(status)) {
+      for (size_t i = 0; i < processes.size(); ++i) {
+        if (!reaped[i]) {
+          result.stopped_.push_back(processes[i].pid_);
+          statuses[i] = 128 + WSTOPSIG(status);
+        }
+      }
+      break;
+    }
+
+    statuses[stage] = decode_exit_status(status);
+    reaped[stage]   = true;
+    record_usage(pid, stage, usage);
+    --pending;
+  }
+
+  core::SignalManager::instance().set_foreground_process(0);
+  return result;
+}
+
+auto Runner::execute_background(parser::Pipeline const& pipeline) -> ExecutionResult {
+  auto processes = launch_pipeline(pipeline);
+  if (!processes) {
+    return ExecutionResult{1, processes.error(), false};
+  }
+
+  std::vector<pid_t> pids;
+  for (auto const& process : *processes) {
+    if (process.pid_ != -1) {
+      pids.push_back(process.pid_);
+    }
+  }
+
+  if (pids.empty()) {
+    int exit_status = processes->back().exit_status_;
+    context_.get().set_exit_status(exit_status);
+    return ExecutionResult{exit_status, "", true};
+  }
+
+  pid_t last_pid = pids.back();
+  job_manager_.get().forget_unwaited();
+  job_manager_.get().add_job(std::move(pids), describe_pipeline(pipeline));
+  context_.get().set_last_background_pid(last_pid);
+
+  context_.get().set_exit_status(0);
+  return ExecutionResult{0, "", true};
+}
 
 auto Runner::execute_ast(parser::ASTNode const& node) -> ExecutionResult {
   switch (node.type()) {
     case parser::ASTNode::Type::Assignment: {
       auto const& assignment = static_cast<parser::Assignment const&>(node);
 
-      auto        expanded_items = expand::expand(assignment.value_->text_, context_);
+      auto        expanded_items = expand::expand(*assignment.value_, context_);
       std::string value          = expanded_items.empty() ? "" : expanded_items[0];
 
       context_.get().set_variable(assignment.name_->text_, std::move(value));
@@ -171,7 +698,7 @@ auto Runner::execute_ast(parser::ASTNode const& node) -> ExecutionResult {
       auto const& conditional = static_cast<parser::ConditionalStatement const&>(node);
 
       auto result = execute_ast(*conditional.condition_);
-      if (!result.success_) {
+      if (!result.success_ || context_.get().returning()) {
         return result;
       }
 
@@ -210,7 +737,7 @@ auto Runner::execute_ast(parser::ASTNode const& node) -> ExecutionResult {
 
       for (auto const& statement : compound.statements_) {
         auto result = execute_ast(*statement);
-        if (!result.success_) {
+        if (!result.success_ || context_.get().returning()) {
           return result;
         }
         exit_status = result.exit_status_;
@@ -222,447 +749,746 @@ auto Runner::execute_ast(parser::ASTNode const& node) -> ExecutionResult {
 
     case parser::ASTNode::Type::LoopStatement: {
       auto const& loop = static_cast<parser::LoopStatement const&>(node);
+      if (loop.redirections_.empty()) {
+        return execute_loop(loop);
+      }
 
-      if (loop.kind_ == parser::LoopStatement::Kind::For) {
-        if (!loop.variable_ || !loop.body_) {
-          return ExecutionResult{1, "Invalid for loop structure", false};
-        }
-
-        std::string name{loop.variable_->text_};
-        auto        original = context_.get().get_variable(name);
-
-        int exit_status = 0;
-
-        for (auto const& item_word : loop.items_) {
-          for (auto const& item : expand::expand(item_word->text_, context_)) {
-            context_.get().set_variable(name, item);
-
-            auto body_result = execute_ast(*loop.body_);
-            if (!body_result.success_) {
-              if (original) {
-                context_.get().set_variable(name, *original);
-              }
-              return body_result;
-            }
+      // The loop runs in the shell, so its redirections stay in place until done
+      auto saved = redirect_in_place(loop.redirections_);
+      if (!saved) {
+        core::standard_error().println("hsh: {}", saved.error());
+        context_.get().set_exit_status(1);
+        return ExecutionResult{1, "", true};
+      }
+      auto result = execute_loop(loop);
+      restore_in_place(*saved);
+      return result;
+    }
 
-            exit_status = body_result.exit_status_;
-          }
-        }
+    case parser::ASTNode::Type::Command: {
+      auto const& cmd = static_cast<parser::Command const&>(node);
 
-        if (original) {
-          context_.get().set_variable(name, *original);
+      // Assignments without a command change the shell, otherwise they only apply to that command
+      auto assignments = expand_assignments(cmd);
+      if (cmd.words_.empty()) {
+        for (auto& [name, value] : assignments) {
+          context_.get().set_variable(std::move(name), std::move(value));
         }
-
-        context_.get().set_exit_status(exit_status);
-        return ExecutionResult{exit_status, "", true};
+        context_.get().set_exit_status(0);
+        return ExecutionResult{0, "", true};
       }
 
-      if (loop.kind_ == parser::LoopStatement::Kind::While) {
-        if (!loop.condition_ || !loop.body_) {
-          return ExecutionResult{1, "Invalid while loop structure", false};
+      // Every field is kept, the command word itself may be "$@"
+      std::vector<std::string>          argv = expand::expand(*cmd.words_[0], context_);
+      std::vector<core::FileDescriptor> substitution_fds;
+      if (auto expanded = expand_arguments(cmd, argv, substitution_fds); !expanded) {
+        return ExecutionResult{1, expanded.error(), false};
+      }
+      // Every word expanded to nothing, which leaves the same as a command of only assignments
+      if (argv.empty()) {
+        for (auto& [name, value] : assignments) {
+          context_.get().set_variable(std::move(name), std::move(value));
         }
+        context_.get().set_exit_status(0);
+        return ExecutionResult{0, "", true};
+      }
 
-        int exit_status = 0;
-
-        while (true) {
-          auto condition_result = execute_ast(*loop.condition_);
-          if (!condition_result.success_) {
-            return condition_result;
-          }
+      // Functions take precedence over builtins of the same name
+      auto const* function = functions_.empty() ? nullptr : functions_.get(argv[0]);
+      auto        builtin  = function != nullptr ? builtin::Handle{} : resolve_builtin(cmd, argv[0]);
+      // An external command nothing follows takes the place of the shell instead of being waited for
+      if (&node == exec_tail_ && function == nullptr && !builtin && substitution_fds.empty() && may_replace_shell()) {
+        return exec_in_place(argv, cmd.redirections_, assignments);
+      }
+      auto result = function != nullptr ? call_function(*function, argv, cmd.redirections_, assignments)
+                                        : execute_command(argv, cmd.redirections_, builtin, assignments);
+      context_.get().set_array("PIPESTATUS", {std::to_string(result.exit_status_)});
+      if (!substitution_fds.empty()) {
+        // close our pipe ends first so >(...) readers see EOF
+        substitution_fds.clear();
+        job_manager_.get().reap_helpers();
+      }
+      return result;
+    }
 
-          if (condition_result.exit_status_ != 0) {
-            break;
-          }
+    case parser::ASTNode::Type::Pipeline: {
+      auto const& pipeline_ast = static_cast<parser::Pipeline const&>(node);
+      if (pipeline_ast.timed_ && !pipeline_ast.background_) {
+        return execute_timed(pipeline_ast);
+      }
+      return execute_pipeline(pipeline_ast);
+    }
 
-          auto body_result = execute_ast(*loop.body_);
-          if (!body_result.success_) {
-            return body_result;
-          }
+    case parser::ASTNode::Type::LogicalExpression: {
+      auto const& logical = static_cast<parser::LogicalExpression const&>(node);
 
-          exit_status = body_result.exit_status_;
-        }
+      auto left_result = execute_ast(*logical.left_);
+      if (!left_result.success_ || context_.get().returning()) {
+        return left_result;
+      }
 
-        context_.get().set_exit_status(exit_status);
-        return ExecutionResult{exit_status, "", true};
+      bool should_execute_right = false;
+      if (logical.operator_ == parser::LogicalExpression::Operator::And) {
+        should_execute_right = left_result.exit_status_ == 0;
+      } else {
+        should_execute_right = left_result.exit_status_ != 0;
       }
 
-      if (loop.kind_ == parser::LoopStatement::Kind::Until) {
-        if (!loop.condition_ || !loop.body_) {
-          return ExecutionResult{1, "Invalid until loop structure", false};
-        }
+      if (should_execute_right) {
+        return execute_ast(*logical.right_);
+      }
+      return left_result;
+    }
 
-        int exit_status = 0;
+    case parser::ASTNode::Type::TestExpression: {
+      builtin::StatCache cache;
+      auto               result = evaluate_test(static_cast<parser::TestExpression const&>(node), cache);
+      if (!result) {
+        core::standard_error().println("hsh: {}", result.error());
+      }
 
-        while (true) {
-          auto condition_result = execute_ast(*loop.condition_);
-          if (!condition_result.success_) {
-            return condition_result;
-          }
+      int exit_status = !result ? 2 : *result ? 0 : 1;
+      context_.get().set_exit_status(exit_status);
+      return ExecutionResult{exit_status, "", true};
+    }
 
-          if (condition_result.exit_status_ == 0) {
-            break;
-          }
+    case parser::ASTNode::Type::FunctionDefinition: {
+      auto const& definition = static_cast<parser::FunctionDefinition const&>(node);
+      functions_.insert_or_assign(std::string{definition.name_}, Function{source_, definition.body_});
+      context_.get().set_exit_status(0);
+      return ExecutionResult{0, "", true};
+    }
 
-          auto body_result = execute_ast(*loop.body_);
-          if (!body_result.success_) {
-            return body_result;
-          }
+    default: {
+      return ExecutionResult{1, std::format("Unsupported AST node type: {}", static_cast<int>(node.type())), false};
+    }
+  }
+}
 
-          exit_status = body_result.exit_status_;
-        }
+auto Runner::execute_pipeline(parser::Pipeline const& pipeline) -> ExecutionResult {
+  if (pipeline.commands_.empty()) {
+    context_.get().set_exit_status(0);
+    return ExecutionResult{0, "", true};
+  }
 
-        context_.get().set_exit_status(exit_status);
-        return ExecutionResult{exit_status, "", true};
-      }
+  if (pipeline.background_) {
+    return execute_background(pipeline);
+  }
 
-      return ExecutionResult{1, "Unsupported loop type in direct execution", false};
-    }
+  if (pipeline.commands_.size() == 1) {
+    return execute_ast(*pipeline.commands_[0]);
+  }
 
-    case parser::ASTNode::Type::Command: {
-      auto const& cmd = static_cast<parser::Command const&>(node);
+  // The last stage of the final pipeline runs in the shell, so an external one can replace it. With pipefail the shell
+  // still has to see the status of the other stages.
+  bool in_place = &pipeline == exec_tail_ && may_replace_shell() && !context_.get().get_option("pipefail");
 
-      for (auto const& assignment : cmd.assignments_) {
-        auto        expanded_values = expand::expand(assignment->value_->text_, context_);
-        std::string value           = expanded_values.empty() ? "" : expanded_values[0];
-        context_.get().set_variable(assignment->name_->text_, std::move(value));
-      }
+  core::FileDescriptor tail_stdin;
+  auto                 processes = launch_pipeline(pipeline, in_place ? &tail_stdin : nullptr);
+  if (!processes) {
+    return ExecutionResult{1, processes.error(), false};
+  }
+  if (in_place) {
+    auto tail = execute_tail_stage(*pipeline.commands_.back(), std::move(tail_stdin));
+    processes->push_back(PipelineProcess{-1, tail.exit_status_});
+  }
 
-      if (cmd.words_.empty()) {
-        context_.get().set_exit_status(0);
-        return ExecutionResult{0, "", true};
-      }
+  auto waited = wait_pipeline(*processes);
+  if (!waited) {
+    return ExecutionResult{1, waited.error(), false};
+  }
+  if (!waited->stopped_.empty()) {
+    auto description = describe_pipeline(pipeline);
+    int  job_id      = job_manager_.get().add_job(waited->stopped_, description);
+    job_manager_.get().update_job_status(job_id, job::JobStatus::Stopped);
+    core::standard_output().println("[{}]  + stopped     {}", job_id, description);
+    context_.get().set_exit_status(148); // 128 + SIGTSTP(20)
+    return ExecutionResult{148, "", true};
+  }
+  auto const& statuses = waited->statuses_;
 
-      auto command_words = expand::expand(cmd.words_[0]->text_, context_);
-      if (command_words.empty()) {
-        return ExecutionResult{1, "Command expansion resulted in empty list", false};
+  std::vector<std::string> pipestatus;
+  pipestatus.reserve(statuses.size());
+  for (int status : statuses) {
+    pipestatus.push_back(std::to_string(status));
+  }
+  context_.get().set_array("PIPESTATUS", std::move(pipestatus));
+
+  int exit_status = statuses.back();
+  if (context_.get().get_option("pipefail")) {
+    // The rightmost stage that failed, or 0 if all of them succeeded
+    exit_status = 0;
+    for (int status : statuses | std::views::reverse) {
+      if (status != 0) {
+        exit_status = status;
+        break;
       }
+    }
+  }
 
-      std::string const&       command_name = command_words[0];
-      std::vector<std::string> argv;
-      argv.push_back(command_name);
-
-      for (size_t i = 1; i < cmd.words_.size(); ++i) {
-        for (auto&& arg : expand::expand(cmd.words_[i]->text_, context_)) {
-          argv.push_back(arg);
-        }
-      }
+  context_.get().set_exit_status(exit_status);
+  return ExecutionResult{exit_status, "", true};
+}
 
-      return execute_command(argv, cmd.redirections_);
+auto Runner::execute_tail_stage(parser::ASTNode const& stage, core::FileDescriptor stdin_fd) -> ExecutionResult {
+  core::FileDescriptor saved{fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 10)};
+  dup2(stdin_fd.get(), STDIN_FILENO);
+  stdin_fd.reset();
+
+  // Only reached if the stage did not replace the shell
+  core::util::ScopeExit restore{[this, &saved, tail = std::exchange(exec_tail_, &stage)] {
+    exec_tail_ = tail;
+    if (saved.valid()) {
+      dup2(saved.get(), STDIN_FILENO);
+    } else {
+      close(STDIN_FILENO);
     }
+  }};
+  return execute_ast(stage);
+}
 
-    case parser::ASTNode::Type::Pipeline: {
-      auto const& pipeline_ast = static_cast<parser::Pipeline const&>(node);
+auto Runner::execute_timed(parser::Pipeline const& pipeline) -> ExecutionResult {
+  std::vector<ChildUsage> usage;
+  auto*                   outer_usage = std::exchange(child_usage_, &usage);
+
+  rusage self_before{};
+  rusage children_before{};
+  getrusage(RUSAGE_SELF, &self_before);
+  getrusage(RUSAGE_CHILDREN, &children_before);
+  auto start = std::chrono::steady_clock::now();
+
+  auto result = execute_pipeline(pipeline);
+
+  auto   real = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+  rusage self_after{};
+  rusage children_after{};
+  getrusage(RUSAGE_SELF, &self_after);
+  getrusage(RUSAGE_CHILDREN, &children_after);
+
+  child_usage_ = outer_usage;
+
+  auto user = core::util::to_duration(self_after.ru_utime) - core::util::to_duration(self_before.ru_utime) +
+              core::util::to_duration(children_after.ru_utime) - core::util::to_duration(children_before.ru_utime);
+  auto sys = core::util::to_duration(self_after.ru_stime) - core::util::to_duration(self_before.ru_stime) +
+             core::util::to_duration(children_after.ru_stime) - core::util::to_duration(children_before.ru_stime);
+
+  std::string report = std::format(
+      "\nreal\t{}\nuser\t{}\nsys\t{}\n",
+      core::util::format_duration(real),
+      core::util::format_duration(user),
+      core::util::format_duration(sys)
+  );
+
+  // Per-stage usage as reported by wait4, in pipeline order
+  std::ranges::stable_sort(usage, {}, &ChildUsage::stage_);
+  for (auto const& [pid, stage, child] : usage) {
+    report += std::format(
+        "stage {} [{}] {}: maxrss {}k, majflt {}, nvcsw {}, nivcsw {}\n",
+        stage + 1,
+        pid,
+        stage < pipeline.commands_.size() ? describe_stage(*pipeline.commands_[stage]) : "",
+        child.ru_maxrss,
+        child.ru_majflt,
+        child.ru_nvcsw,
+        child.ru_nivcsw
+    );
+  }
 
-      if (pipeline_ast.commands_.empty()) {
-        context_.get().set_exit_status(0);
-        return ExecutionResult{0, "", true};
-      }
+  core::standard_error().write(report);
+  return result;
+}
 
-      if (pipeline_ast.commands_.size() == 1) {
-        return execute_ast(*pipeline_ast.commands_[0]);
-      }
+void Runner::record_usage(pid_t pid, size_t stage, rusage const& usage) {
+  if (child_usage_ != nullptr) {
+    child_usage_->push_back(ChildUsage{pid, stage, usage});
+  }
+}
 
-      std::vector<std::array<int, 2>> pipes;
-      pipes.resize(pipeline_ast.commands_.size() - 1);
+auto Runner::execute_loop(parser::LoopStatement const& loop) -> ExecutionResult {
+  if (loop.kind_ == parser::LoopStatement::Kind::For) {
+    if (!loop.variable_ || !loop.body_) {
+      return ExecutionResult{1, "Invalid for loop structure", false};
+    }
 
-      for (auto& pipe_fds : pipes) {
-        if (pipe2(pipe_fds.data(), O_CLOEXEC) == -1) {
-          return ExecutionResult{1, std::format("Failed to create pipe: {}", std::strerror(errno)), false};
-        }
-      }
+    std::string name{loop.variable_->text_};
+    // Copied, views returned by get_variable do not survive assignments
+    std::optional<std::string> original;
+    if (auto value = context_.get().get_variable(name)) {
+      original.emplace(*value);
+    }
 
-      std::vector<pid_t> pids;
-      pids.reserve(pipeline_ast.commands_.size());
+    int exit_status = 0;
 
-      for (size_t i = 0; i < pipeline_ast.commands_.size(); ++i) {
-        pid_t pid = fork();
+    for (auto const& item_word : loop.items_) {
+      for (auto const& item : expand::expand(*item_word, context_)) {
+        context_.get().set_variable(name, item);
 
-        if (pid == -1) {
-          for (auto const& pipe_fds : pipes) {
-            close(pipe_fds[0]);
-            close(pipe_fds[1]);
+        auto body_result = execute_ast(*loop.body_);
+        if (!body_result.success_ || context_.get().returning()) {
+          if (original) {
+            context_.get().set_variable(name, *original);
           }
-          return ExecutionResult{1, std::format("Failed to fork for pipeline: {}", std::strerror(errno)), false};
+          return body_result;
         }
 
-        if (pid == 0) {
-          // Child process - reset signal handlers
-          [[maybe_unused]] auto _ = core::SignalManager::instance().reset_handlers();
+        exit_status = body_result.exit_status_;
+      }
+    }
 
-          // Set process group
-          if (setpgid(0, 0) == -1) {
-            // Non-fatal
-          }
+    if (original) {
+      context_.get().set_variable(name, *original);
+    }
 
-          if (i > 0) {
-            dup2(pipes[i - 1][0], STDIN_FILENO);
-          }
+    context_.get().set_exit_status(exit_status);
+    return ExecutionResult{exit_status, "", true};
+  }
 
-          if (i < pipeline_ast.commands_.size() - 1) {
-            dup2(pipes[i][1], STDOUT_FILENO);
-          }
+  if (loop.kind_ == parser::LoopStatement::Kind::While) {
+    if (!loop.condition_ || !loop.body_) {
+      return ExecutionResult{1, "Invalid while loop structure", false};
+    }
 
-          for (auto const& pipe_fds : pipes) {
-            close(pipe_fds[0]);
-            close(pipe_fds[1]);
-          }
+    int exit_status = 0;
 
-          auto result = execute_ast(*pipeline_ast.commands_[i]);
-          std::exit(result.exit_status_);
-        }
+    while (true) {
+      auto condition_result = execute_ast(*loop.condition_);
+      if (!condition_result.success_ || context_.get().returning()) {
+        return condition_result;
+      }
 
-        pids.push_back(pid);
+      if (condition_result.exit_status_ != 0) {
+        break;
       }
 
-      for (auto const& pipe_fds : pipes) {
-        close(pipe_fds[0]);
-        close(pipe_fds[1]);
+      auto body_result = execute_ast(*loop.body_);
+      if (!body_result.success_ || context_.get().returning()) {
+        return body_result;
       }
 
-      int last_exit_status = 0;
-      for (size_t i = 0; i < pids.size(); ++i) {
-        int status = 0;
-        if (waitpid(pids[i], &status, 0) == -1) {
-          return ExecutionResult{1, std::format("Failed to wait for pipeline process: {}", std::strerror(errno)), false};
-        }
+      exit_status = body_result.exit_status_;
+    }
 
-        if (i == pids.size() - 1) {
-          last_exit_status = WIFEXITED(status) ? WEXITSTATUS(status) : 1;
-        }
-      }
+    context_.get().set_exit_status(exit_status);
+    return ExecutionResult{exit_status, "", true};
+  }
 
-      context_.get().set_exit_status(last_exit_status);
-      return ExecutionResult{last_exit_status, "", true};
+  if (loop.kind_ == parser::LoopStatement::Kind::Until) {
+    if (!loop.condition_ || !loop.body_) {
+      return ExecutionResult{1, "Invalid until loop structure", false};
     }
 
-    case parser::ASTNode::Type::LogicalExpression: {
-      auto const& logical = static_cast<parser::LogicalExpression const&>(node);
+    int exit_status = 0;
 
-      auto left_result = execute_ast(*logical.left_);
-      if (!left_result.success_) {
-        return left_result;
+    while (true) {
+      auto condition_result = execute_ast(*loop.condition_);
+      if (!condition_result.success_ || context_.get().returning()) {
+        return condition_result;
       }
 
-      bool should_execute_right = false;
-      if (logical.operator_ == parser::LogicalExpression::Operator::And) {
-        should_execute_right = left_result.exit_status_ == 0;
-      } else {
-        should_execute_right = left_result.exit_status_ != 0;
+      if (condition_result.exit_status_ == 0) {
+        break;
       }
 
-      if (should_execute_right) {
-        return execute_ast(*logical.right_);
+      auto body_result = execute_ast(*loop.body_);
+      if (!body_result.success_ || context_.get().returning()) {
+        return body_result;
       }
-      return left_result;
+
+      exit_status = body_result.exit_status_;
     }
 
-    default: {
-      return ExecutionResult{1, std::format("Unsupported AST node type: {}", static_cast<int>(node.type())), false};
+    context_.get().set_exit_status(exit_status);
+    return ExecutionResult{exit_status, "", true};
+  }
+
+  return ExecutionResult{1, "Unsupported loop type in direct execution", false};
+}
+
+auto Runner::evaluate_test(parser::TestExpression const& expression, builtin::StatCache& cache) -> Result<bool> {
+  switch (expression.kind_) {
+    case parser::TestExpression::Kind::Not: {
+      auto result = evaluate_test(*expression.left_, cache);
+      if (!result) {
+        return result;
+      }
+      return !*result;
+    }
+    case parser::TestExpression::Kind::And: {
+      auto left = evaluate_test(*expression.left_, cache);
+      if (!left || !*left) {
+        return left;
+      }
+      return evaluate_test(*expression.right_, cache);
     }
+    case parser::TestExpression::Kind::Or: {
+      auto left = evaluate_test(*expression.left_, cache);
+      if (!left || *left) {
+        return left;
+      }
+      return evaluate_test(*expression.right_, cache);
+    }
+    case parser::TestExpression::Kind::Unary: {
+      auto operand = expand::expand_word(*expression.operands_[0], context_);
+      return builtin::test_unary(expression.operator_, operand, cache, context_);
+    }
+    case parser::TestExpression::Kind::Binary: break;
+  }
+
+  auto const& pattern = *expression.operands_[1];
+  auto        left    = expand::expand_word(*expression.operands_[0], context_);
+  if (expression.operator_ == builtin::TestOperator::Matches) {
+    std::vector<std::string> groups;
+    auto                     matched = builtin::match_regex(regex_of(pattern.text_, context_), left, groups);
+    if (matched && *matched) {
+      context_.get().set_array("BASH_REMATCH", std::move(groups));
+    }
+    return matched;
+  }
+
+  auto right = expand::expand_word(pattern, context_);
+  // A quoted right operand is taken literally instead of as a pattern
+  bool literal = pattern.token_kind_ == lexer::Token::Type::SingleQuoted ||
+                 pattern.token_kind_ == lexer::Token::Type::DoubleQuoted;
+
+  switch (expression.operator_) {
+    case builtin::TestOperator::StringEqual:
+    case builtin::TestOperator::StringNotEqual: {
+      bool equal = literal ? left == right : expand::pathname::match_pattern(right, left);
+      return equal == (expression.operator_ == builtin::TestOperator::StringEqual);
+    }
+    default: return builtin::test_binary(expression.operator_, left, right, cache);
   }
 }
 
+auto Runner::resolve_builtin(parser::Command const& cmd, std::string const& name) -> builtin::Handle {
+  if (cmd.builtin_ != builtin::NOT_BUILTIN) {
+    return builtin::Registry::get(cmd.builtin_);
+  }
+  return builtin::Registry::instance().find(name);
+}
+
 auto Runner::execute_command(
     std::vector<std::string> const&                          argv,
-    std::vector<std::unique_ptr<parser::Redirection>> const& redirections
+    std::vector<std::unique_ptr<parser::Redirection>> const& redirections,
+    builtin::Handle                                          builtin,
+    std::span<std::pair<std::string, std::string> const>     assignments
 ) -> ExecutionResult {
   if (argv.empty()) {
     return ExecutionResult{1, "Empty command", false};
   }
 
-  if (builtin::Registry::instance().is_builtin(argv[0])) {
-    if (!redirections.empty()) {
-      return execute_with_redirections(argv, redirections, true);
-    }
+  if (!builtin) {
+    return execute_external_command(argv, redirections, assignments);
+  }
+
+  // A builtin runs in the shell, so its assignments are set for the call and undone afterwards
+  std::vector<std::pair<std::string, std::optional<std::string>>> saved;
+  saved.reserve(assignments.size());
+  for (auto const& [name, value] : assignments) {
+    auto previous = context_.get().get_variable(name);
+    saved.emplace_back(name, previous ? std::optional<std::string>{*previous} : std::nullopt);
+    context_.get().set_variable(name, value);
+  }
 
-    int exit_status = builtin::Registry::instance().execute_builtin(
-        argv[0],
+  ExecutionResult result{0, "", true};
+  if (argv.size() == 1 && builtin.is(builtin::builtin_exec)) {
+    // `exec 3>file` keeps its redirections for the rest of the shell
+    auto kept   = redirect_in_place(redirections);
+    int  status = kept ? 0 : 1;
+    if (!kept) {
+      core::standard_error().println("hsh: {}", kept.error());
+    }
+    context_.get().set_exit_status(status);
+    result = ExecutionResult{status, "", true};
+  } else if (!redirections.empty()) {
+    result = execute_builtin_with_redirections(argv, redirections, builtin);
+  } else {
+    int exit_status = builtin(
         std::span{argv.data() + 1, argv.size() - 1}, // remove command name
         context_,
         job_manager_
     );
     context_.get().set_exit_status(exit_status);
-
-    return ExecutionResult{exit_status, "", true};
+    result = ExecutionResult{exit_status, "", true};
   }
 
-  if (!redirections.empty()) {
-    return execute_with_redirections(argv, redirections, false);
+  for (auto& [name, value] : saved | std::views::reverse) {
+    if (value) {
+      context_.get().set_variable(std::move(name), std::move(*value));
+    } else {
+      context_.get().unset_variable(name);
+    }
   }
-
-  return execute_external_command(argv);
+  return result;
 }
 
-auto Runner::execute_with_redirections(
+auto Runner::call_function(
+    Function                                                 function,
     std::vector<std::string> const&                          argv,
     std::vector<std::unique_ptr<parser::Redirection>> const& redirections,
-    bool                                                     is_builtin
+    std::span<std::pair<std::string, std::string> const>     assignments
 ) -> ExecutionResult {
-  pid_t pid = fork();
-  if (pid == -1) {
-    return ExecutionResult{1, std::format("Failed to fork: {}", std::strerror(errno)), false};
+  auto& context = context_.get();
+  if (context.frame_depth() >= MAX_FUNCTION_DEPTH) {
+    core::standard_error().println(
+        "hsh: {}: maximum function nesting level exceeded ({})", argv[0], MAX_FUNCTION_DEPTH
+    );
+    context.set_exit_status(1);
+    return ExecutionResult{1, "", true};
   }
 
-  if (pid == 0) {
-    // Child process - reset signal handlers to defaults
-    [[maybe_unused]] auto _ = core::SignalManager::instance().reset_handlers();
-
-    // Set process group for job control
-    if (setpgid(0, 0) == -1) {
-      // Non-fatal, continue
+  // Like a loop, the body runs in the shell with the redirections of the call in place
+  std::vector<std::pair<int, core::FileDescriptor>> saved;
+  if (!redirections.empty()) {
+    auto redirected = redirect_in_place(redirections);
+    if (!redirected) {
+      core::standard_error().println("hsh: {}", redirected.error());
+      context.set_exit_status(1);
+      return ExecutionResult{1, "", true};
     }
+    saved = std::move(*redirected);
+  }
 
-    for (auto const& redir : redirections) {
-      auto expanded = expand::expand(redir->target_->text_, context_);
-      if (expanded.empty()) {
-        std::println(stderr, "hsh: ambiguous redirect");
-        std::exit(1);
-      }
-      std::string const& filename = expanded[0];
-
-      int fd = 0;
-      int target_fd = redir->fd_.value_or(redir->kind_ == parser::Redirection::Kind::Input ? 0 : 1);
-
-      switch (redir->kind_) {
-        case parser::Redirection::Kind::Input: {
-          fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
-          if (fd == -1) {
-            std::println(stderr, "hsh: {}: {}", filename, std::strerror(errno));
-            std::exit(1);
-          }
-          if (dup2(fd, target_fd) == -1) {
-            std::exit(1);
-          }
-          close(fd);
-          break;
-        }
+  // The body is executed where it is, only the positional parameters and locals are swapped. Assignments in front of
+  // the call are locals of the frame, exported to the commands the body runs as they would be for an external command.
+  context.push_frame({argv.begin() + 1, argv.end()});
+  for (auto const& [name, value] : assignments) {
+    context.declare_local(name);
+    context.export_variable(name, value);
+  }
+  auto result = execute_ast(*function.body_);
+  context.pop_frame();
 
-        case parser::Redirection::Kind::Output: {
-          fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
-          if (fd == -1) {
-            std::println(stderr, "hsh: {}: {}", filename, std::strerror(errno));
-            std::exit(1);
-          }
-          if (dup2(fd, target_fd) == -1) {
-            std::exit(1);
-          }
-          close(fd);
-          break;
-        }
+  if (!saved.empty()) {
+    restore_in_place(saved);
+  }
+  context.set_exit_status(result.exit_status_);
+  return result;
+}
 
-        case parser::Redirection::Kind::Append: {
-          fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
-          if (fd == -1) {
-            std::println(stderr, "hsh: {}: {}", filename, std::strerror(errno));
-            std::exit(1);
-          }
-          if (dup2(fd, target_fd) == -1) {
-            std::exit(1);
-          }
-          close(fd);
-          break;
-        }
+auto Runner::expand_assignments(parser::Command const& cmd) -> std::vector<std::pair<std::string, std::string>> {
+  std::vector<std::pair<std::string, std::string>> assignments;
+  assignments.reserve(cmd.assignments_.size());
+  for (auto const& assignment : cmd.assignments_) {
+    auto expanded_values = expand::expand(*assignment->value_, context_);
+    assignments.emplace_back(assignment->name_->text_, expanded_values.empty() ? "" : std::move(expanded_values[0]));
+  }
+  return assignments;
+}
 
-        default: {
-          // TODO: Handle other redirection types
-          break;
-        }
+auto Runner::expand_arguments(
+    parser::Command const&             cmd,
+    std::vector<std::string>&          argv,
+    std::vector<core::FileDescriptor>& substitution_fds
+) -> Result<void> {
+  for (size_t i = 1; i < cmd.words_.size(); ++i) {
+    if (is_process_substitution(*cmd.words_[i])) {
+      auto path = expand_process_substitution(*cmd.words_[i], substitution_fds);
+      if (!path) {
+        return std::unexpected(path.error());
       }
+      argv.push_back(std::move(*path));
+      continue;
     }
+    expand::expand_into(*cmd.words_[i], context_, argv);
+  }
+  return {};
+}
 
-    if (is_builtin) {
-      int exit_status = builtin::Registry::instance().execute_builtin(
-          argv[0],
-          std::span{argv.data() + 1, argv.size() - 1}, // remove command name
-          context_,
-          job_manager_
-      );
-      std::exit(exit_status);
+auto Runner::open_redirections(std::vector<std::unique_ptr<parser::Redirection>> const& redirections)
+    -> Result<std::vector<std::pair<int, core::FileDescriptor>>> {
+  std::vector<std::pair<int, core::FileDescriptor>> opened;
+  opened.reserve(redirections.size());
+
+  for (auto const& redir : redirections) {
+    int flags = 0;
+    switch (redir->kind_) {
+      case parser::Redirection::Kind::Input: {
+        flags = O_RDONLY;
+        break;
+      }
+      case parser::Redirection::Kind::Output: {
+        flags = O_WRONLY | O_CREAT | O_TRUNC;
+        break;
+      }
+      case parser::Redirection::Kind::Append: {
+        flags = O_WRONLY | O_CREAT | O_APPEND;
+        break;
+      }
+      default: {
+        // TODO: Handle other redirection types
+        continue;
+      }
     }
 
-    std::vector<char*> c_argv = build_argv(argv);
-    if (execvp(c_argv[0], c_argv.data()) == -1) {
-      std::println(stderr, "hsh: {}: command not found", argv[0]);
-      std::exit(127);
+    int target_fd = redir->fd_.value_or(redir->kind_ == parser::Redirection::Kind::Input ? 0 : 1);
+
+    // cmd < <(producer) reads straight from the pipe of the substitution
+    if (is_process_substitution(*redir->target_)) {
+      std::vector<core::FileDescriptor> ends;
+      if (auto path = expand_process_substitution(*redir->target_, ends); !path) {
+        return std::unexpected(path.error());
+      }
+      if (auto result = core::syscall::set_cloexec(ends.back().get(), true); !result) {
+        return std::unexpected(std::format("Failed to set up process substitution: {}", std::strerror(result.error())));
+      }
+      opened.emplace_back(target_fd, std::move(ends.back()));
+      continue;
     }
-  }
 
-  // Parent process - set foreground process and wait
-  core::SignalManager::instance().set_foreground_process(pid);
+    auto expanded = expand::expand(*redir->target_, context_);
+    if (expanded.empty()) {
+      return std::unexpected("ambiguous redirect");
+    }
+    std::string const& filename = expanded[0];
 
-  int status = 0;
-  if (waitpid(pid, &status, 0) == -1) {
-    // Check if interrupted by signal
-    if (errno == EINTR) {
-      core::SignalManager::instance().set_foreground_process(0);
-      context_.get().set_exit_status(130); // 128 + SIGINT(2)
-      return ExecutionResult{130, "", true};
+    // Opened close-on-exec, only the dup onto target_fd is inherited
+    core::FileDescriptor fd{open(filename.c_str(), flags | O_CLOEXEC, 0644)};
+    if (!fd.valid()) {
+      return std::unexpected(std::format("{}: {}", filename, std::strerror(errno)));
     }
-    core::SignalManager::instance().set_foreground_process(0);
-    return ExecutionResult{1, std::format("Failed to wait for child: {}", std::strerror(errno)), false};
+    opened.emplace_back(target_fd, std::move(fd));
   }
 
-  core::SignalManager::instance().set_foreground_process(0);
+  return opened;
+}
 
-  // Handle stopped process (Ctrl+Z)
-  // TODO: fix
-  if (WIFSTOPPED(status)) {
-    int job_id = job_manager_.get().add_job(pid, argv[0]);
-    job_manager_.get().update_job_status(pid, job::JobStatus::Stopped);
-    std::println("[{}]  + stopped     {}", job_id, argv[0]);
-    context_.get().set_exit_status(148); // 128 + SIGTSTP(20)
-    return ExecutionResult{148, "", true};
+auto Runner::execute_builtin_with_redirections(
+    std::vector<std::string> const&                          argv,
+    std::vector<std::unique_ptr<parser::Redirection>> const& redirections,
+    builtin::Handle                                          builtin
+) -> ExecutionResult {
+  // Builtins run inside the shell, so the targets are swapped in place and restored afterwards
+  auto saved = redirect_in_place(redirections);
+  if (!saved) {
+    core::standard_error().println("hsh: {}", saved.error());
+    context_.get().set_exit_status(1);
+    return ExecutionResult{1, "", true};
   }
 
-  // Handle signaled process
-  if (WIFSIGNALED(status)) {
-    int sig = WTERMSIG(status);
-    context_.get().set_exit_status(128 + sig);
-    return ExecutionResult{128 + sig, "", true};
+  int exit_status = builtin(
+      std::span{argv.data() + 1, argv.size() - 1}, // remove command name
+      context_,
+      job_manager_
+  );
+
+  // The buffered output belongs to the redirection targets, a failed write is the builtin's failure
+  if (auto flushed = core::flush_output(); !flushed && exit_status == 0) {
+    core::standard_error().println("hsh: {}: write error: {}", argv[0], std::strerror(flushed.error()));
+    exit_status = 1;
   }
+  restore_in_place(*saved);
 
-  int exit_status = WIFEXITED(status) ? WEXITSTATUS(status) : 1;
   context_.get().set_exit_status(exit_status);
+  return ExecutionResult{exit_status, "", true};
+}
 
-  if (!is_builtin && exit_status == 127) {
-    return ExecutionResult{exit_status, std::format("Command not found: {}", argv[0]), false};
+auto Runner::redirect_in_place(std::vector<std::unique_ptr<parser::Redirection>> const& redirections)
+    -> Result<std::vector<std::pair<int, core::FileDescriptor>>> {
+  // Output collected so far still goes to the original descriptors
+  [[maybe_unused]] auto _ = core::flush_output();
+
+  auto opened = open_redirections(redirections);
+  if (!opened) {
+    return std::unexpected(opened.error());
   }
 
-  return ExecutionResult{exit_status, "", true};
+  std::vector<std::pair<int, core::FileDescriptor>> saved;
+  saved.reserve(opened->size());
+  for (auto const& [target_fd, fd] : *opened) {
+    saved.emplace_back(target_fd, core::FileDescriptor{fcntl(target_fd, F_DUPFD_CLOEXEC, 10)});
+    dup2(fd.get(), target_fd);
+  }
+  return saved;
+}
+
+void Runner::restore_in_place(std::vector<std::pair<int, core::FileDescriptor>> const& saved) {
+  [[maybe_unused]] auto _ = core::flush_output();
+
+  // In reverse, so a target redirected twice ends up with its original descriptor
+  for (auto const& [target_fd, fd] : saved | std::views::reverse) {
+    if (fd.valid()) {
+      dup2(fd.get(), target_fd);
+    } else {
+      close(target_fd);
+    }
+  }
 }
 
-auto Runner::execute_external_command(std::vector<std::string> const& argv) -> ExecutionResult {
+auto Runner::execute_external_command(
+    std::vector<std::string> const&                          argv,
+    std::vector<std::unique_ptr<parser::Redirection>> const& redirections,
+    std::span<std::pair<std::string, std::string> const>     assignments
+) -> ExecutionResult {
   if (argv.empty()) {
     return ExecutionResult{1, "Empty command", false};
   }
 
-  std::vector<char*> c_argv = build_argv(argv);
-  pid_t              pid    = fork();
-  if (pid == -1) {
-    return ExecutionResult{1, std::format("Failed to fork: {}", std::strerror(errno)), false};
+  auto opened = open_redirections(redirections);
+  if (!opened) {
+    core::standard_error().println("hsh: {}", opened.error());
+    context_.get().set_exit_status(1);
+    return ExecutionResult{1, "", true};
   }
 
-  if (pid == 0) {
-    // Child process - reset signal handlers to defaults
-    [[maybe_unused]] auto _ = core::SignalManager::instance().reset_handlers();
-
-    // Set process group for job control
-    if (setpgid(0, 0) == -1) {
-      // Non-fatal, continue
-      // TODO
+  auto pid = spawn_external(argv, *opened, 0, -1, -1, assignments, context_);
+  if (!pid) {
+    int exit_status = spawn_error_status(pid.error());
+    context_.get().set_exit_status(exit_status);
+    if (pid.error() == ENOENT) {
+      return ExecutionResult{exit_status, std::format("Command not found: {}", argv[0]), false};
     }
+    return ExecutionResult{exit_status, std::format("{}: {}", argv[0], std::strerror(pid.error())), false};
+  }
 
-    if (execvp(c_argv[0], c_argv.data()) == -1) {
-      std::println(stderr, "hsh: {}: command not found", argv[0]);
-      std::exit(127);
-    }
+  // The child has its own copies now
+  opened->clear();
+
+  return wait_foreground(*pid, argv[0]);
+}
+
+auto Runner::may_replace_shell() const -> bool {
+  // Nobody would be left to wait for the jobs of the shell
+  return job_manager_.get().get_jobs().empty();
+}
+
+auto Runner::exec_in_place(
+    std::vector<std::string> const&                          argv,
+    std::vector<std::unique_ptr<parser::Redirection>> const& redirections,
+    std::span<std::pair<std::string, std::string> const>     assignments
+) -> ExecutionResult {
+  // The redirections only have to be undone if the exec fails
+  auto saved = redirect_in_place(redirections);
+  if (!saved) {
+    core::standard_error().println("hsh: {}", saved.error());
+    context_.get().set_exit_status(1);
+    return ExecutionResult{1, "", true};
+  }
+
+  core::env::Block environment;
+  if (!assignments.empty()) {
+    environment = core::env::envp_with(assignments);
+  }
+  auto envp = assignments.empty() ? core::env::envp() : environment.envp();
+
+  auto replaced = builtin::replace_shell(argv, search_path(assignments, context_), envp);
+  restore_in_place(*saved);
+
+  int exit_status = spawn_error_status(replaced.error());
+  context_.get().set_exit_status(exit_status);
+  if (replaced.error() == ENOENT) {
+    return ExecutionResult{exit_status, std::format("Command not found: {}", argv[0]), false};
   }
+  return ExecutionResult{exit_status, std::format("{}: {}", argv[0], std::strerror(replaced.error())), false};
+}
 
-  // Parent process - set foreground process and wait
+auto Runner::wait_foreground(pid_t pid, std::string const& name) -> ExecutionResult {
   core::SignalManager::instance().set_foreground_process(pid);
 
-  int status = 0;
-  if (waitpid(pid, &status, 0) == -1) {
+  int    status = 0;
+  rusage usage{};
+  // WUNTRACED also returns when the child is stopped, so Ctrl+Z gives the prompt back
+  if (wait4(pid, &status, WUNTRACED, &usage) == -1) {
     // Check if interrupted by signal
     if (errno == EINTR) {
       // Likely interrupted by SIGINT
@@ -678,12 +1504,13 @@ auto Runner::execute_external_command(std::vector<std::string> const& argv) -> E
 
   // Handle stopped process (Ctrl+Z)
   if (WIFSTOPPED(status)) {
-    int job_id = job_manager_.get().add_job(pid, argv[0]);
-    job_manager_.get().update_job_status(pid, job::JobStatus::Stopped);
-    std::println("[{}]  + stopped     {}", job_id, argv[0]);
+    int job_id = job_manager_.get().add_job(pid, name);
+    job_manager_.get().update_job_status(job_id, job::JobStatus::Stopped);
+    core::standard_output().println("[{}]  + stopped     {}", job_id, name);
     context_.get().set_exit_status(148); // 128 + SIGTSTP(20)
     return ExecutionResult{148, "", true};
   }
+  record_usage(pid, 0, usage);
 
   // Handle signaled process
   if (WIFSIGNALED(status)) {
@@ -695,10 +1522,6 @@ auto Runner::execute_external_command(std::vector<std::string> const& argv) -> E
   int exit_status = WIFEXITED(status) ? WEXITSTATUS(status) : 1;
   context_.get().set_exit_status(exit_status);
 
-  if (exit_status == 127) {
-    return ExecutionResult{exit_status, std::format("Command not found: {}", argv[0]), false};
-  }
-
   return ExecutionResult{exit_status, "", true};
 }
 
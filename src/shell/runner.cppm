@@ -2,12 +2,18 @@ module;
 
 #include <functional>
 #include <memory>
+#include <span>
 #include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 
+#include <sys/resource.h>
+#include <sys/types.h>
+
 export module hsh.shell.runner;
 
+import hsh.builtin;
 import hsh.core;
 import hsh.expand;
 import hsh.parser;
@@ -24,38 +30,121 @@ struct ExecutionResult {
   bool        success_;
 };
 
+// A launched pipeline stage
+struct PipelineProcess {
+  pid_t pid_;         // -1 if the stage could not be started
+  int   exit_status_; // status of a stage that could not be started
+};
+
+// Outcome of waiting for a foreground pipeline. If it was stopped, stopped_ holds the members that were not reaped.
+struct PipelineStatus {
+  std::vector<int>   statuses_;
+  std::vector<pid_t> stopped_;
+};
+
+// Resource usage of a reaped foreground child, collected while a `time`d pipeline runs
+struct ChildUsage {
+  pid_t  pid_;
+  size_t stage_;
+  rusage usage_;
+};
+
+// A defined function. The body is the one the parser built, kept alive with the input its words point into.
+struct Function {
+  std::shared_ptr<std::string const>               source_;
+  std::shared_ptr<parser::CompoundStatement const> body_;
+};
+
 class Runner {
   std::reference_wrapper<context::Context> context_;
   std::reference_wrapper<job::JobManager>  job_manager_;
+  std::vector<ChildUsage>*                 child_usage_ = nullptr; // set while a `time`d pipeline runs
+  core::FlatMap<Function>                  functions_;
+  std::shared_ptr<std::string const>       source_;             // input of the innermost run()
+  parser::ASTNode const*                   exec_tail_ = nullptr; // command or pipeline that may replace the shell
 
 public:
   explicit Runner(context::Context& context, job::JobManager& job_manager);
   ~Runner() = default;
 
-  auto run(std::string_view input) -> ExecutionResult;
+  // With last set nothing runs after input, so its final external command may replace the shell
+  auto run(std::string_view input, bool last = false) -> ExecutionResult;
   auto get_context(this auto&& self) noexcept -> decltype(auto) {
     return self.context_.get();
   }
   auto get_job_manager(this auto&& self) noexcept -> decltype(auto) {
     return self.job_manager_.get();
   }
-  void check_background_jobs() const;
+  // Reports finished jobs; asynchronous reports first end the line the prompt is on
+  auto check_background_jobs(bool asynchronous = false) const -> size_t;
 
 private:
   static auto parse_input(std::string_view input) -> Result<std::unique_ptr<parser::ASTNode>>;
 
   auto execute_ast(parser::ASTNode const& node) -> ExecutionResult;
-  auto execute_command(
+  auto execute_loop(parser::LoopStatement const& loop) -> ExecutionResult;
+  // One StatCache is shared by the whole [[ ]] expression
+  auto evaluate_test(parser::TestExpression const& expression, builtin::StatCache& cache) -> Result<bool>;
+  // The builtin cached on the node when its name is a literal, a lookup by the expanded name otherwise
+  static auto resolve_builtin(parser::Command const& cmd, std::string const& name) -> builtin::Handle;
+  auto        execute_command(
       std::vector<std::string> const&                          argv,
-      std::vector<std::unique_ptr<parser::Redirection>> const& redirections
+      std::vector<std::unique_ptr<parser::Redirection>> const& redirections,
+      builtin::Handle                                          builtin,
+      std::span<std::pair<std::string, std::string> const>     assignments = {}
+  ) -> ExecutionResult;
+  auto call_function(
+      Function                                                 function,
+      std::vector<std::string> const&                          argv,
+      std::vector<std::unique_ptr<parser::Redirection>> const& redirections,
+      std::span<std::pair<std::string, std::string> const>     assignments
+  ) -> ExecutionResult;
+  auto execute_external_command(
+      std::vector<std::string> const&                          argv,
+      std::vector<std::unique_ptr<parser::Redirection>> const& redirections,
+      std::span<std::pair<std::string, std::string> const>     assignments
+  ) -> ExecutionResult;
+  auto execute_builtin_with_redirections(
+      std::vector<std::string> const&                          argv,
+      std::vector<std::unique_ptr<parser::Redirection>> const& redirections,
+      builtin::Handle                                          builtin
   ) -> ExecutionResult;
-  auto execute_external_command(std::vector<std::string> const& argv) -> ExecutionResult;
-  auto execute_with_redirections(
+  [[nodiscard]] auto may_replace_shell() const -> bool;
+  // Execs argv in place of the shell, only returns if that failed
+  auto exec_in_place(
       std::vector<std::string> const&                          argv,
       std::vector<std::unique_ptr<parser::Redirection>> const& redirections,
-      bool                                                     is_builtin
+      std::span<std::pair<std::string, std::string> const>     assignments
   ) -> ExecutionResult;
+  auto wait_foreground(pid_t pid, std::string const& name) -> ExecutionResult;
+  auto open_redirections(std::vector<std::unique_ptr<parser::Redirection>> const& redirections)
+      -> Result<std::vector<std::pair<int, core::FileDescriptor>>>;
+  // Swaps the targets of redirections in the shell itself, returning what restore_in_place() needs to undo it
+  auto redirect_in_place(std::vector<std::unique_ptr<parser::Redirection>> const& redirections)
+      -> Result<std::vector<std::pair<int, core::FileDescriptor>>>;
+  void restore_in_place(std::vector<std::pair<int, core::FileDescriptor>> const& saved);
+  auto expand_assignments(parser::Command const& cmd) -> std::vector<std::pair<std::string, std::string>>;
+  auto expand_arguments(
+      parser::Command const&             cmd,
+      std::vector<std::string>&          argv,
+      std::vector<core::FileDescriptor>& substitution_fds
+  ) -> Result<void>;
   auto execute_subshell(parser::CompoundStatement const& body) -> ExecutionResult;
+  auto execute_background(parser::Pipeline const& pipeline) -> ExecutionResult;
+  auto execute_pipeline(parser::Pipeline const& pipeline) -> ExecutionResult;
+  // Runs the last stage of the final pipeline in the shell with stdin_fd as its input
+  auto execute_tail_stage(parser::ASTNode const& stage, core::FileDescriptor stdin_fd) -> ExecutionResult;
+  auto execute_timed(parser::Pipeline const& pipeline) -> ExecutionResult;
+  void record_usage(pid_t pid, size_t stage, rusage const& usage);
+  // With tail_stdin set the last stage is left to the caller, which gets the read end of the pipe into it
+  auto launch_pipeline(parser::Pipeline const& pipeline, core::FileDescriptor* tail_stdin = nullptr)
+      -> Result<std::vector<PipelineProcess>>;
+  auto wait_pipeline(std::span<PipelineProcess const> processes) -> Result<PipelineStatus>;
+  // A command stage that can be spawned without a forked shell: neither a builtin, a function nor a compound
+  auto is_external_stage(parser::ASTNode const& stage) const -> bool;
+  auto spawn_stage(parser::Command const& cmd, pid_t pgid, int stdin_fd, int stdout_fd) -> Result<PipelineProcess>;
+  auto expand_process_substitution(parser::Word const& word, std::vector<core::FileDescriptor>& fds)
+      -> Result<std::string>;
 };
 
 } // namespace hsh::shell
@@ -1,4 +1,5 @@
 export module hsh.shell;
 
+export import hsh.shell.event_loop;
 export import hsh.shell.prompt;
 export import hsh.shell.runner;
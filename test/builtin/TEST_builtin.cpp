@@ -1,10 +1,13 @@
 #include <span>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <gtest/gtest.h>
+#include <unistd.h>
 
 import hsh.builtin;
 import hsh.context;
+import hsh.core;
 import hsh.job;
 
 namespace {
@@ -14,7 +17,6 @@ protected:
   void SetUp() override {
     context_ = std::make_unique<hsh::context::Context>();
     job_manager_ = std::make_unique<hsh::job::JobManager>();
-    hsh::builtin::register_all_builtins();
   }
 
   std::unique_ptr<hsh::context::Context> context_;
@@ -116,6 +118,179 @@ TEST_F(BuiltinTest, ExitTooManyArguments) {
   // EXPECT_EQ(result, 1);
 }
 
+// Set Tests
+TEST_F(BuiltinTest, SetPipefailOption) {
+  std::vector<std::string> enable{"-o", "pipefail"};
+  EXPECT_EQ(hsh::builtin::builtin_set(enable, *context_, *job_manager_), 0);
+  EXPECT_TRUE(context_->get_option("pipefail"));
+
+  std::vector<std::string> disable{"+o", "pipefail"};
+  EXPECT_EQ(hsh::builtin::builtin_set(disable, *context_, *job_manager_), 0);
+  EXPECT_FALSE(context_->get_option("pipefail"));
+}
+
+TEST_F(BuiltinTest, SetInvalidOptionName) {
+  std::vector<std::string> args{"-o", "nonexistent"};
+  EXPECT_EQ(hsh::builtin::builtin_set(args, *context_, *job_manager_), 1);
+}
+
+TEST_F(BuiltinTest, SetReplacesPositionalParameters) {
+  std::vector<std::string> args{"--", "a", "b c", "d"};
+  EXPECT_EQ(hsh::builtin::builtin_set(args, *context_, *job_manager_), 0);
+  EXPECT_EQ(context_->get_positional_count(), 3);
+  EXPECT_EQ(context_->get_variable("2"), "b c");
+
+  std::vector<std::string> clear{"--"};
+  EXPECT_EQ(hsh::builtin::builtin_set(clear, *context_, *job_manager_), 0);
+  EXPECT_EQ(context_->get_variable("#"), "0");
+}
+
+// Shift Tests
+TEST_F(BuiltinTest, ShiftAdvancesTheWindow) {
+  context_->set_positional_parameters({"1", "2", "3", "4"});
+
+  std::vector<std::string> none{};
+  EXPECT_EQ(hsh::builtin::builtin_shift(none, *context_, *job_manager_), 0);
+  EXPECT_EQ(context_->get_variable("1"), "2");
+  EXPECT_EQ(context_->get_variable("#"), "3");
+  EXPECT_EQ(context_->get_variable("@"), "2 3 4");
+
+  std::vector<std::string> two{"2"};
+  EXPECT_EQ(hsh::builtin::builtin_shift(two, *context_, *job_manager_), 0);
+  EXPECT_EQ(context_->get_variable("1"), "4");
+  EXPECT_EQ(context_->get_positional_parameters().size(), 1);
+
+  std::vector<std::string> too_many{"2"};
+  EXPECT_EQ(hsh::builtin::builtin_shift(too_many, *context_, *job_manager_), 1);
+  EXPECT_EQ(context_->get_variable("#"), "1");
+
+  std::vector<std::string> invalid{"x"};
+  EXPECT_EQ(hsh::builtin::builtin_shift(invalid, *context_, *job_manager_), 1);
+}
+
+// Read Tests
+TEST_F(BuiltinTest, ReadLeavesTheRestOfAPipe) {
+  int fds[2];
+  ASSERT_EQ(pipe(fds), 0);
+  std::string input = "one  two three\nsecond line\n";
+  ASSERT_EQ(write(fds[1], input.data(), input.size()), static_cast<ssize_t>(input.size()));
+  close(fds[1]);
+
+  int saved_stdin = dup(STDIN_FILENO);
+  dup2(fds[0], STDIN_FILENO);
+
+  std::vector<std::string> args{"-r", "first", "rest"};
+  EXPECT_EQ(hsh::builtin::builtin_read(args, *context_, *job_manager_), 0);
+  EXPECT_EQ(context_->get_variable("first"), "one");
+  EXPECT_EQ(context_->get_variable("rest"), "two three");
+
+  // Only the first line was consumed
+  char buffer[64];
+  auto remaining = read(STDIN_FILENO, buffer, sizeof(buffer));
+  EXPECT_EQ(std::string(buffer, remaining > 0 ? remaining : 0), "second line\n");
+
+  std::vector<std::string> none{};
+  EXPECT_EQ(hsh::builtin::builtin_read(none, *context_, *job_manager_), 1);
+
+  dup2(saved_stdin, STDIN_FILENO);
+  close(saved_stdin);
+  close(fds[0]);
+}
+
+TEST_F(BuiltinTest, ReadOptions) {
+  int fds[2];
+  ASSERT_EQ(pipe(fds), 0);
+  std::string input = "a:b::c;xyz\\\nnext\n";
+  ASSERT_EQ(write(fds[1], input.data(), input.size()), static_cast<ssize_t>(input.size()));
+  close(fds[1]);
+
+  int saved_stdin = dup(STDIN_FILENO);
+  dup2(fds[0], STDIN_FILENO);
+
+  context_->set_variable("IFS", ":");
+  std::vector<std::string> array{"-d", ";", "-a", "parts"};
+  EXPECT_EQ(hsh::builtin::builtin_read(array, *context_, *job_manager_), 0);
+  auto parts = context_->get_array("parts");
+  ASSERT_TRUE(parts.has_value());
+  EXPECT_EQ(std::vector<std::string>(parts->begin(), parts->end()), (std::vector<std::string>{"a", "b", "", "c"}));
+
+  std::vector<std::string> count{"-n", "2", "short"};
+  EXPECT_EQ(hsh::builtin::builtin_read(count, *context_, *job_manager_), 0);
+  EXPECT_EQ(context_->get_variable("short"), "xy");
+
+  // Without -r the escaped newline joins the next line
+  std::vector<std::string> joined{"line"};
+  EXPECT_EQ(hsh::builtin::builtin_read(joined, *context_, *job_manager_), 0);
+  EXPECT_EQ(context_->get_variable("line"), "znext");
+
+  std::vector<std::string> invalid{"-x"};
+  EXPECT_EQ(hsh::builtin::builtin_read(invalid, *context_, *job_manager_), 2);
+
+  dup2(saved_stdin, STDIN_FILENO);
+  close(saved_stdin);
+  close(fds[0]);
+}
+
+// Printf Tests
+TEST_F(BuiltinTest, PrintfConversions) {
+  std::vector<std::string> numbers{"-v", "out", "[%5d|%-4x|%04o|%.2f|%c]\\n", "42", "255", "8", "3.14159", "word"};
+  EXPECT_EQ(hsh::builtin::builtin_printf(numbers, *context_, *job_manager_), 0);
+  EXPECT_EQ(context_->get_variable("out"), "[   42|ff  |0010|3.14|w]\n");
+
+  // The format is reused until the arguments run out, missing ones are empty
+  std::vector<std::string> reused{"-v", "out", "%s=%s;", "a", "1", "b"};
+  EXPECT_EQ(hsh::builtin::builtin_printf(reused, *context_, *job_manager_), 0);
+  EXPECT_EQ(context_->get_variable("out"), "a=1;b=;");
+
+  std::vector<std::string> escapes{"-v", "out", "%b|%q|%q|%*s", "x\\ty\\0101\\cignored", "it's", "", "3", "r"};
+  EXPECT_EQ(hsh::builtin::builtin_printf(escapes, *context_, *job_manager_), 0);
+  EXPECT_EQ(context_->get_variable("out"), "x\tyA");
+
+  std::vector<std::string> quoted{"-v", "out", "%q %q %d", "it's", "", "'A"};
+  EXPECT_EQ(hsh::builtin::builtin_printf(quoted, *context_, *job_manager_), 0);
+  EXPECT_EQ(context_->get_variable("out"), "'it'\\''s' '' 65");
+
+  // %b keeps NUL bytes, a negative * width left-justifies and a negative * precision is none
+  std::vector<std::string> padded{"-v", "out", "[%4b|%.*s|%*s]", "a\\0b", "-1", "all", "-3", "l"};
+  EXPECT_EQ(hsh::builtin::builtin_printf(padded, *context_, *job_manager_), 0);
+  EXPECT_EQ(context_->get_variable("out"), std::string_view("[ a\0b|all|l  ]", 14));
+
+  std::vector<std::string> invalid{"-v", "out", "%d", "abc"};
+  EXPECT_EQ(hsh::builtin::builtin_printf(invalid, *context_, *job_manager_), 1);
+
+  std::vector<std::string> bad_name{"-v", "1out", "%s", "x"};
+  EXPECT_EQ(hsh::builtin::builtin_printf(bad_name, *context_, *job_manager_), 2);
+
+  std::vector<std::string> usage{};
+  EXPECT_EQ(hsh::builtin::builtin_printf(usage, *context_, *job_manager_), 2);
+}
+
+// Test Tests
+TEST_F(BuiltinTest, TestOperators) {
+  auto test = [&](std::vector<std::string> args) {
+    return hsh::builtin::builtin_test(args, *context_, *job_manager_);
+  };
+
+  EXPECT_EQ(test({}), 1);
+  EXPECT_EQ(test({"-n"}), 0);
+  EXPECT_EQ(test({"-d", "/"}), 0);
+  EXPECT_EQ(test({"-f", "/"}), 1);
+  EXPECT_EQ(test({"!", "-e", "/nonexistent/path"}), 0);
+  EXPECT_EQ(test({"-d", "/", "-a", "-r", "/"}), 0);
+  EXPECT_EQ(test({"abc", "=", "abd", "-o", "2", "-lt", "10"}), 0);
+  EXPECT_EQ(test({"(", "1", "-eq", "2", ")"}), 1);
+  EXPECT_EQ(test({"-f", "=", "-f"}), 0);
+  EXPECT_EQ(test({"x", "-eq", "1"}), 2);
+
+  context_->set_variable("DEFINED", "");
+  EXPECT_EQ(test({"-v", "DEFINED"}), 0);
+
+  std::vector<std::string> bracket{"-z", "", "]"};
+  EXPECT_EQ(hsh::builtin::builtin_bracket(bracket, *context_, *job_manager_), 0);
+  std::vector<std::string> unclosed{"-z", ""};
+  EXPECT_EQ(hsh::builtin::builtin_bracket(unclosed, *context_, *job_manager_), 2);
+}
+
 // Registry Tests
 TEST_F(BuiltinTest, RegistryContainsBuiltins) {
   auto& registry = hsh::builtin::Registry::instance();
@@ -141,4 +316,39 @@ TEST_F(BuiltinTest, RegistryExecuteBuiltin) {
   EXPECT_EQ(result, 127);
 }
 
+TEST_F(BuiltinTest, CompiledTableResolvesEveryName) {
+  static_assert(hsh::builtin::find_builtin("cd") != hsh::builtin::NOT_BUILTIN);
+  static_assert(hsh::builtin::find_builtin("c") == hsh::builtin::NOT_BUILTIN);
+
+  for (size_t i = 0; i < hsh::builtin::NAMES.size(); ++i) {
+    EXPECT_EQ(hsh::builtin::find_builtin(hsh::builtin::NAMES[i]), i) << hsh::builtin::NAMES[i];
+    EXPECT_TRUE(hsh::builtin::Registry::get(static_cast<hsh::builtin::BuiltinIndex>(i)));
+  }
+  EXPECT_FALSE(hsh::builtin::Registry::get(hsh::builtin::NOT_BUILTIN));
+}
+
+TEST_F(BuiltinTest, RuntimeRegisteredBuiltin) {
+  auto&      registry = hsh::builtin::Registry::instance();
+  static int calls    = 0;
+  registry.register_builtin("runtime_builtin", [](auto, auto&, auto&) { return ++calls; });
+  // The registry outlives this test, nothing registered here may leak into the others
+  hsh::core::util::ScopeExit cleanup{[&registry] {
+    registry.unregister_builtin("runtime_builtin");
+    registry.unregister_builtin("pwd");
+  }};
+
+  auto handle = registry.find("runtime_builtin");
+  ASSERT_TRUE(handle);
+  std::vector<std::string> args{};
+  EXPECT_EQ(handle(args, *context_, *job_manager_), 1);
+  EXPECT_EQ(registry.execute_builtin("runtime_builtin", args, *context_, *job_manager_), 2);
+
+  // Compiled-in builtins cannot be shadowed
+  registry.register_builtin("pwd", [](auto, auto&, auto&) { return 42; });
+  EXPECT_EQ(registry.execute_builtin("pwd", args, *context_, *job_manager_), 0);
+
+  registry.unregister_builtin("runtime_builtin");
+  EXPECT_FALSE(registry.find("runtime_builtin"));
+}
+
 } // namespace
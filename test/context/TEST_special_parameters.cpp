@@ -152,3 +152,23 @@ TEST_F(SpecialParametersTest, CacheInvalidation) {
   EXPECT_EQ(context.get_variable("1"), "x");
   EXPECT_EQ(context.get_variable("3"), "z");
 }
+
+TEST_F(SpecialParametersTest, SlotsFollowUpdates) {
+  context.set_positional_parameters({"a", "b"});
+  EXPECT_EQ(context.get_variable("*"), "a b");
+
+  context.set_positional_parameter(3, "c");
+  EXPECT_EQ(context.get_variable("*"), "a b c");
+  EXPECT_EQ(context.get_variable("#"), "3");
+  EXPECT_EQ(context.get_variable("3"), "c");
+
+  context.set_exit_status(-1);
+  EXPECT_EQ(context.get_variable("?"), "-1");
+
+  context.set_last_background_pid(4321);
+  EXPECT_EQ(context.get_variable("!"), "4321");
+
+  // Ordinary names are looked up as variables only
+  context.set_variable("_1", "underscore");
+  EXPECT_EQ(context.get_variable("_1"), "underscore");
+}
@@ -0,0 +1,140 @@
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+import hsh.context;
+
+namespace hsh::context::test {
+
+TEST(VariableStoreTest, ChildSeesParentUntilShadowed) {
+  VariableStore parent;
+  parent.set("A", "1");
+  parent.set("B", "2");
+
+  auto child = parent.child();
+  ASSERT_NE(child.get("A"), nullptr);
+  EXPECT_EQ(*child.get("A"), "1");
+
+  child.set("A", "child");
+  child.unset("B");
+  EXPECT_EQ(*child.get("A"), "child");
+  EXPECT_EQ(child.get("B"), nullptr);
+
+  // The parent never sees what the child changed
+  EXPECT_EQ(*parent.get("A"), "1");
+  EXPECT_EQ(*parent.get("B"), "2");
+}
+
+TEST(VariableStoreTest, ParentWritesDoNotLeakIntoChild) {
+  VariableStore parent;
+  parent.set("X", "before");
+
+  auto child = parent.child();
+  parent.set("X", "after");
+  parent.set("Y", "new");
+
+  EXPECT_EQ(*child.get("X"), "before");
+  EXPECT_EQ(child.get("Y"), nullptr);
+  EXPECT_EQ(*parent.get("X"), "after");
+}
+
+TEST(VariableStoreTest, DeepScopesStayConsistent) {
+  VariableStore root;
+  root.set("DEPTH", "0");
+  root.set_array("LIST", {"a", "b"});
+
+  std::vector<VariableStore> scopes;
+  scopes.push_back(root.child());
+  for (int i = 1; i < 40; ++i) {
+    scopes.back().set("DEPTH", std::to_string(i));
+    scopes.push_back(scopes.back().child());
+  }
+
+  EXPECT_EQ(*scopes.back().get("DEPTH"), "39");
+  auto list = scopes.back().get_array("LIST");
+  ASSERT_TRUE(list.has_value());
+  EXPECT_EQ(list->size(), 2);
+  EXPECT_EQ(*root.get("DEPTH"), "0");
+
+  size_t visible = 0;
+  for (auto const& [name, value] : scopes.back().list()) {
+    EXPECT_EQ(name, "DEPTH");
+    EXPECT_EQ(value, "39");
+    ++visible;
+  }
+  EXPECT_EQ(visible, 1);
+}
+
+TEST(VariableStoreTest, ContextScopesOnlyMergeTheExitStatus) {
+  Context context;
+  context.set_variable("SHARED", "outer");
+  context.set_positional_parameters({"arg"});
+
+  auto scope = context.create_scope();
+  EXPECT_EQ(scope.get_variable("SHARED"), "outer");
+  EXPECT_EQ(scope.get_variable("1"), "arg");
+
+  scope.set_variable("SHARED", "inner");
+  scope.set_exit_status(3);
+  context.merge_scope(scope);
+  EXPECT_EQ(context.get_variable("SHARED"), "outer");
+  EXPECT_EQ(context.get_exit_status(), 3);
+}
+
+TEST(VariableStoreTest, SymbolsAndNamesShareSlots) {
+  auto& symbols = SymbolTable::instance();
+  auto  symbol  = symbols.intern("SLOT_VAR");
+  EXPECT_EQ(symbols.intern("SLOT_VAR"), symbol);
+  EXPECT_EQ(symbols.name(symbol), "SLOT_VAR");
+  EXPECT_FALSE(symbols.find("NEVER_INTERNED_VAR").has_value());
+
+  VariableStore store;
+  store.set(symbol, "by symbol");
+  EXPECT_EQ(*store.get("SLOT_VAR"), "by symbol");
+
+  auto child = store.child();
+  child.unset("SLOT_VAR");
+  EXPECT_EQ(child.get(symbol), nullptr);
+  EXPECT_EQ(*store.get(symbol), "by symbol");
+
+  Context context;
+  context.set_variable("SLOT_VAR", "context");
+  EXPECT_EQ(context.get_variable(symbol), "context");
+}
+
+TEST(VariableStoreTest, FlattenedScopeKeepsItsView) {
+  VariableStore root;
+  root.set("SHARED", "old");
+  root.set("GONE", "1");
+
+  auto scope = root.child();
+  for (int i = 0; i < 40; ++i) {
+    scope = scope.child();
+  }
+  scope.unset("GONE");
+  scope.set("OWN", "scope");
+  root.set("SHARED", "new");
+
+  // The write collapsed the chain, what the scope saw stays the same
+  EXPECT_EQ(*scope.get("SHARED"), "old");
+  EXPECT_EQ(*scope.get("OWN"), "scope");
+  EXPECT_EQ(scope.get("GONE"), nullptr);
+  EXPECT_EQ(*root.get("GONE"), "1");
+}
+
+TEST(VariableStoreTest, ScopesShareAliasesUntilChanged) {
+  Context context;
+  context.set_alias("ll", "ls -l");
+
+  auto scope = context.create_scope();
+  scope.set_alias("la", "ls -a");
+  scope.unset_alias("ll");
+  EXPECT_EQ(context.get_alias("ll"), "ls -l");
+  EXPECT_FALSE(context.get_alias("la").has_value());
+  EXPECT_FALSE(scope.get_alias("ll").has_value());
+
+  context.set_option("pipefail", true);
+  EXPECT_FALSE(scope.get_option("pipefail"));
+}
+
+} // namespace hsh::context::test
@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+import hsh.core;
+
+namespace hsh::core::test {
+
+TEST(FlatMapTest, InsertAndLookup) {
+  FlatMap<std::string> map;
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(map.get("missing"), nullptr);
+
+  map.insert_or_assign("HOME", "/home/user");
+  map.insert_or_assign(std::string{"PATH"}, std::string{"/usr/bin"});
+
+  std::string_view key = "HOME=ignored";
+  auto const*      home = map.get(key.substr(0, 4));
+  ASSERT_NE(home, nullptr);
+  EXPECT_EQ(*home, "/home/user");
+  EXPECT_TRUE(map.contains("PATH"));
+  EXPECT_EQ(map.size(), 2);
+
+  map.insert_or_assign("HOME", "/root");
+  EXPECT_EQ(*map.get("HOME"), "/root");
+  EXPECT_EQ(map.size(), 2);
+}
+
+TEST(FlatMapTest, EraseKeepsProbeChainsIntact) {
+  FlatMap<int> map;
+  for (int i = 0; i < 1000; ++i) {
+    map.insert_or_assign("var" + std::to_string(i), i);
+  }
+  EXPECT_EQ(map.size(), 1000);
+
+  for (int i = 0; i < 1000; i += 2) {
+    EXPECT_TRUE(map.erase("var" + std::to_string(i)));
+  }
+  EXPECT_FALSE(map.erase("var0"));
+  EXPECT_EQ(map.size(), 500);
+
+  for (int i = 0; i < 1000; ++i) {
+    auto const* value = map.get("var" + std::to_string(i));
+    if (i % 2 == 0) {
+      EXPECT_EQ(value, nullptr);
+    } else {
+      ASSERT_NE(value, nullptr);
+      EXPECT_EQ(*value, i);
+    }
+  }
+
+  size_t visited = 0;
+  for (auto const& [name, value] : map) {
+    EXPECT_EQ(name, "var" + std::to_string(value));
+    ++visited;
+  }
+  EXPECT_EQ(visited, 500);
+}
+
+TEST(FlatMapTest, EraseIfAndClear) {
+  FlatMap<std::string> map;
+  map["1"] = "one";
+  map["2"] = "two";
+  map["x"] = "ex";
+
+  EXPECT_EQ(map.erase_if([](auto const& entry) { return entry.first != "x"; }), 2);
+  EXPECT_EQ(map.size(), 1);
+  EXPECT_EQ(*map.get("x"), "ex");
+
+  map.clear();
+  EXPECT_TRUE(map.empty());
+  EXPECT_FALSE(map.contains("x"));
+}
+
+TEST(FlatMapTest, InsertCopiesFromItselfWhileGrowing) {
+  FlatMap<std::string> map;
+  map["A"] = std::string(64, 'a');
+
+  // The first insert may grow the table while the value it copies still lives in it
+  map.insert_or_assign("B", std::string_view{*map.get("A")});
+  for (int i = 0; i < 1000; ++i) {
+    map["var" + std::to_string(i)] = "x";
+  }
+
+  EXPECT_EQ(*map.get("A"), std::string(64, 'a'));
+  EXPECT_EQ(*map.get("B"), std::string(64, 'a'));
+}
+
+} // namespace hsh::core::test
@@ -0,0 +1,48 @@
+#include <gtest/gtest.h>
+
+#include <locale>
+#include <string_view>
+#include <utility>
+
+import hsh.core;
+
+namespace hsh::core::test {
+
+using namespace locale;
+
+static_assert(is_alpha('a') && is_alpha('Z') && !is_alpha('_') && !is_alpha('0'));
+static_assert(is_alpha_u('_') && is_alnum_u('9') && !is_alnum_u('-'));
+static_assert(is_space('\t') && is_space('\v') && !is_space('\0'));
+static_assert(to_upper('q') == 'Q' && to_lower('Q') == 'q' && to_upper('1') == '1');
+
+TEST(LocaleTest, TableMatchesClassicLocale) {
+  for (int i = 0; i < 128; ++i) {
+    auto c = static_cast<char>(i);
+    EXPECT_EQ(is_alpha(c), std::isalpha(c, std::locale::classic())) << i;
+    EXPECT_EQ(is_digit(c), std::isdigit(c, std::locale::classic())) << i;
+    EXPECT_EQ(is_space(c), std::isspace(c, std::locale::classic())) << i;
+    EXPECT_EQ(is_upper(c), std::isupper(c, std::locale::classic())) << i;
+  }
+  for (int i = 128; i < 256; ++i) {
+    EXPECT_FALSE(is_alnum_u(static_cast<char>(i))) << i;
+  }
+}
+
+TEST(LocaleTest, IdentifierEnd) {
+  EXPECT_EQ(identifier_end("_name1-rest", 0), 6);
+  EXPECT_EQ(identifier_end("1abc", 0), 0);
+  EXPECT_EQ(identifier_end("$HOME/", 1), 5);
+  if (is_c_locale()) {
+    EXPECT_EQ(identifier_end("na\xc3\xafve", 0), 2);
+  }
+}
+
+TEST(LocaleTest, DecodeUtf8) {
+  EXPECT_EQ(decode_utf8("A"), (std::pair<char32_t, size_t>{U'A', 1}));
+  EXPECT_EQ(decode_utf8("\xc3\xaf"), (std::pair<char32_t, size_t>{U'ï', 2}));
+  EXPECT_EQ(decode_utf8("\xe2\x82\xac"), (std::pair<char32_t, size_t>{U'€', 3}));
+  EXPECT_EQ(decode_utf8("\xc0\xaf").second, 0); // overlong
+  EXPECT_EQ(decode_utf8("\xe2\x82").second, 0); // truncated
+}
+
+} // namespace hsh::core::test
@@ -0,0 +1,75 @@
+#include <gtest/gtest.h>
+
+#include <array>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+import hsh.core;
+
+namespace hsh::core::test {
+
+namespace {
+
+// Everything currently readable from a non-blocking pipe
+auto drain(int fd) -> std::string {
+  std::string           text;
+  std::array<char, 256> chunk{};
+  ssize_t               count = 0;
+  while ((count = read(fd, chunk.data(), chunk.size())) > 0) {
+    text.append(chunk.data(), static_cast<size_t>(count));
+  }
+  return text;
+}
+
+} // namespace
+
+TEST(OutputBufferTest, WritesInBatches) {
+  auto pipe = make_pipe();
+  ASSERT_TRUE(pipe.has_value());
+  auto& [read_end, write_end] = *pipe;
+  fcntl(read_end.get(), F_SETFL, O_NONBLOCK);
+
+  OutputBuffer output{write_end.get()};
+  EXPECT_TRUE(output.write("hello ").has_value());
+  EXPECT_TRUE(output.println("{} {}", "batched", 42).has_value());
+  EXPECT_FALSE(output.empty());
+  EXPECT_EQ(drain(read_end.get()), "");
+
+  EXPECT_TRUE(output.flush().has_value());
+  EXPECT_TRUE(output.empty());
+  EXPECT_EQ(drain(read_end.get()), "hello batched 42\n");
+
+  // A full buffer is written without being asked to
+  std::string large(20000, 'x');
+  EXPECT_TRUE(output.write(large).has_value());
+  EXPECT_TRUE(output.empty());
+  EXPECT_EQ(drain(read_end.get()), large);
+}
+
+TEST(OutputBufferTest, LinesKeepTheirOrderAcrossBuffers) {
+  auto pipe = make_pipe();
+  ASSERT_TRUE(pipe.has_value());
+  auto& [read_end, write_end] = *pipe;
+  fcntl(read_end.get(), F_SETFL, O_NONBLOCK);
+
+  OutputBuffer output{write_end.get()};
+  OutputBuffer error{write_end.get(), OutputBuffer::Flush::PerLine, &output};
+
+  EXPECT_TRUE(output.write("first\n").has_value());
+  EXPECT_TRUE(error.write("second").has_value());
+  EXPECT_EQ(drain(read_end.get()), "");
+
+  EXPECT_TRUE(error.write(" line\n").has_value());
+  EXPECT_EQ(drain(read_end.get()), "first\nsecond line\n");
+}
+
+TEST(OutputBufferTest, FailedWritesAreDropped) {
+  OutputBuffer output{-1};
+  EXPECT_TRUE(output.write("lost").has_value());
+  EXPECT_FALSE(output.flush().has_value());
+  EXPECT_TRUE(output.empty());
+}
+
+} // namespace hsh::core::test
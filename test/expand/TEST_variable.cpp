@@ -1,9 +1,11 @@
 #include <string>
+#include <vector>
 #include <gtest/gtest.h>
 
 import hsh.expand;
 import hsh.context;
 import hsh.core;
+import hsh.parser;
 
 class VariableExpansionTest : public ::testing::Test {
 protected:
@@ -217,3 +219,25 @@ TEST_F(VariableExpansionTest, MultipleBracedVariables) {
   auto result = hsh::expand::expand_variables("${TEST_VAR} and ${NUM_VAR}", context);
   EXPECT_EQ(result, "test_value and 42");
 }
+
+TEST_F(VariableExpansionTest, ParsedWordsResolveReferencesToSymbols) {
+  hsh::parser::Word word{"pre-${TEST_VAR}-$NUM_VAR.txt"};
+  ASSERT_TRUE(word.resolved_);
+  ASSERT_EQ(word.references_.size(), 2);
+  EXPECT_EQ(word.references_[0].symbol_, hsh::context::SymbolTable::instance().intern("TEST_VAR"));
+  EXPECT_EQ(hsh::expand::expand(word, context), std::vector<std::string>{"pre-test_value-42.txt"});
+
+  context.set_variable("NUM_VAR", "7");
+  EXPECT_EQ(hsh::expand::expand(word, context), std::vector<std::string>{"pre-test_value-7.txt"});
+
+  // Anything beyond plain names is left to the general expansion path
+  hsh::parser::Word special{"$? ${NUM_VAR:-0} \\$TEST_VAR"};
+  EXPECT_FALSE(special.resolved_);
+  EXPECT_EQ(hsh::expand::expand(special, context), hsh::expand::expand(special.text_, context));
+
+  // Only the quoted forms keep every positional parameter a field of its own
+  EXPECT_TRUE(hsh::parser::Word{"\"$@\""}.splices_positional_);
+  EXPECT_TRUE(hsh::parser::Word{"\"${@}\""}.splices_positional_);
+  EXPECT_FALSE(hsh::parser::Word{"$@"}.splices_positional_);
+  EXPECT_FALSE(hsh::parser::Word{"${@}"}.splices_positional_);
+}
@@ -149,6 +149,34 @@ TEST_F(LexerTest, CommandSubstitution) {
   EXPECT_EQ(tokens[2].text_, "`whoami`");
 }
 
+TEST_F(LexerTest, ProcessSubstitution) {
+  auto tokens = tokenize_all("diff <(sort a) >(tee b) < c");
+  auto kinds  = token_kinds(tokens);
+
+  EXPECT_EQ(
+      kinds,
+      (std::vector<Token::Type>{
+          Token::Type::Word, Token::Type::ProcessSubstIn, Token::Type::ProcessSubstOut, Token::Type::Less,
+          Token::Type::Word, Token::Type::EndOfFile
+      })
+  );
+
+  EXPECT_EQ(tokens[1].text_, "<(sort a)");
+  EXPECT_EQ(tokens[2].text_, ">(tee b)");
+
+  // Quoted and escaped parentheses do not end the substitution
+  tokens = tokenize_all("cat <(echo \")\" ')' \\)) < <(true)");
+  kinds  = token_kinds(tokens);
+  EXPECT_EQ(
+      kinds,
+      (std::vector<Token::Type>{
+          Token::Type::Word, Token::Type::ProcessSubstIn, Token::Type::Less, Token::Type::ProcessSubstIn,
+          Token::Type::EndOfFile
+      })
+  );
+  EXPECT_EQ(tokens[1].text_, "<(echo \")\" ')' \\))");
+}
+
 TEST_F(LexerTest, ParameterExpansion) {
   auto tokens = tokenize_all("echo ${HOME} ${PATH:-/usr/bin}");
   auto kinds  = token_kinds(tokens);
@@ -198,6 +226,20 @@ TEST_F(LexerTest, ReservedWords) {
   );
 }
 
+TEST_F(LexerTest, TimeIsLeftToTheParser) {
+  // Only reserved in command position, which the lexer cannot tell
+  auto tokens = tokenize_all("time sleep 1 | cat");
+  auto kinds  = token_kinds(tokens);
+
+  EXPECT_EQ(
+      kinds,
+      (std::vector<Token::Type>{
+          Token::Type::Word, Token::Type::Word, Token::Type::Number, Token::Type::Pipe, Token::Type::Word,
+          Token::Type::EndOfFile
+      })
+  );
+}
+
 TEST_F(LexerTest, ForLoop) {
   auto tokens = tokenize_all("for i in 1 2 3; do echo $i; done");
   auto kinds  = token_kinds(tokens);
@@ -328,6 +370,34 @@ TEST_F(LexerTest, HereDocRedirection) {
   );
 }
 
+TEST_F(LexerTest, DoubleBrackets) {
+  auto tokens = tokenize_all("[[ $a == b ]]; [ x ] a[[1]]");
+  EXPECT_EQ(
+      token_kinds(tokens),
+      (std::vector<Token::Type>{
+          Token::Type::DoubleLeftBracket,
+          Token::Type::Word,
+          Token::Type::Word,
+          Token::Type::Word,
+          Token::Type::DoubleRightBracket,
+          Token::Type::Semicolon,
+          Token::Type::LeftBracket,
+          Token::Type::Word,
+          Token::Type::RightBracket,
+          Token::Type::Word,
+          Token::Type::EndOfFile,
+      })
+  );
+
+  // The pattern after =~ is read as one word
+  Lexer lexer{"=~ ^(a|b)+[0-9]$ ]]"};
+  EXPECT_EQ(lexer.next().text_, "=~");
+  auto regex = lexer.next_regex();
+  EXPECT_EQ(regex.kind_, Token::Type::Word);
+  EXPECT_EQ(regex.text_, "^(a|b)+[0-9]$");
+  EXPECT_EQ(lexer.next().kind_, Token::Type::DoubleRightBracket);
+}
+
 TEST_F(LexerTest, ErrorTokens) {
   auto tokens = tokenize_all("echo @#$%");
 
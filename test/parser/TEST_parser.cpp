@@ -1,6 +1,8 @@
 #include <iostream>
 #include <gtest/gtest.h>
 
+import hsh.builtin.condition;
+import hsh.builtin.table;
 import hsh.lexer;
 import hsh.parser;
 
@@ -92,6 +94,19 @@ TEST_F(ParserTest, CommandSubstitution) {
   EXPECT_EQ(command->words_[2]->token_kind_, lexer::Token::Type::Backtick);
 }
 
+TEST_F(ParserTest, ProcessSubstitution) {
+  auto result = parse_command("diff <(ls a) <(ls b) >out");
+  ASSERT_TRUE(result.has_value());
+
+  auto command = std::move(result.value());
+  ASSERT_EQ(command->words_.size(), 3);
+  EXPECT_EQ(command->words_[1]->text_, "<(ls a)");
+  EXPECT_EQ(command->words_[1]->token_kind_, lexer::Token::Type::ProcessSubstIn);
+  EXPECT_EQ(command->words_[2]->text_, "<(ls b)");
+  ASSERT_EQ(command->redirections_.size(), 1);
+  EXPECT_EQ(command->redirections_[0]->kind_, Redirection::Kind::Output);
+}
+
 TEST_F(ParserTest, SimpleRedirection) {
   auto result = parse_command("echo hello > output.txt");
   ASSERT_TRUE(result.has_value());
@@ -756,6 +771,120 @@ TEST_F(ParserTest, LongPipeline) {
   EXPECT_EQ(static_cast<Command*>(pipeline->commands_[5].get())->words_[0]->text_, "tail");
 }
 
+TEST_F(ParserTest, TimedPipeline) {
+  auto result = parse_pipeline("time sleep 1 | cat");
+  ASSERT_TRUE(result.has_value());
+
+  auto pipeline = std::move(result.value());
+  EXPECT_TRUE(pipeline->timed_);
+  EXPECT_FALSE(pipeline->background_);
+  ASSERT_EQ(pipeline->commands_.size(), 2);
+  EXPECT_EQ(static_cast<Command*>(pipeline->commands_[0].get())->words_[0]->text_, "sleep");
+
+  // Not a reserved word in argument position
+  auto command = parse_command("echo time");
+  ASSERT_TRUE(command.has_value());
+  ASSERT_EQ(command.value()->words_.size(), 2);
+  EXPECT_EQ(command.value()->words_[1]->text_, "time");
+  EXPECT_TRUE(command.value()->words_[1]->is_literal());
+
+  auto loop = parse_input("for w in time; do echo $w; done");
+  ASSERT_TRUE(loop.has_value());
+  auto const* statement = static_cast<LoopStatement*>(loop.value()->statements_[0].get());
+  ASSERT_EQ(statement->items_.size(), 1);
+  EXPECT_EQ(statement->items_[0]->text_, "time");
+
+  EXPECT_TRUE(parse_pipeline("[[ $x == time ]]").has_value());
+  EXPECT_FALSE(parse_pipeline("echo time").value()->timed_);
+}
+
+TEST_F(ParserTest, LiteralBuiltinNamesAreResolved) {
+  auto command = parse_command("cd /tmp");
+  ASSERT_TRUE(command.has_value());
+  EXPECT_EQ(command.value()->builtin_, builtin::find_builtin("cd"));
+  EXPECT_NE(command.value()->builtin_, builtin::NOT_BUILTIN);
+
+  // Names that expansion could change are looked up when the command runs
+  for (auto input : {"ls -l", "$cmd /tmp", "'cd' /tmp", "c? /tmp"}) {
+    auto other = parse_command(input);
+    ASSERT_TRUE(other.has_value()) << input;
+    EXPECT_EQ(other.value()->builtin_, builtin::NOT_BUILTIN) << input;
+  }
+}
+
+TEST_F(ParserTest, TestExpressionResolvesOperators) {
+  auto result = parse_pipeline("[[ -f $file && ( $a == b* || ! -z \"$c\" ) ]]");
+  ASSERT_TRUE(result.has_value()) << result.error();
+  ASSERT_EQ(result.value()->commands_.size(), 1);
+  ASSERT_EQ(result.value()->commands_[0]->type(), ASTNode::Type::TestExpression);
+
+  auto const& root = static_cast<TestExpression const&>(*result.value()->commands_[0]);
+  ASSERT_EQ(root.kind_, TestExpression::Kind::And);
+  EXPECT_EQ(root.left_->kind_, TestExpression::Kind::Unary);
+  EXPECT_EQ(root.left_->operator_, builtin::TestOperator::Regular);
+  EXPECT_EQ(root.left_->operands_[0]->text_, "$file");
+
+  auto const& group = *root.right_;
+  ASSERT_EQ(group.kind_, TestExpression::Kind::Or);
+  EXPECT_EQ(group.left_->kind_, TestExpression::Kind::Binary);
+  EXPECT_EQ(group.left_->operator_, builtin::TestOperator::StringEqual);
+  EXPECT_EQ(group.left_->operands_[1]->text_, "b*");
+  ASSERT_EQ(group.right_->kind_, TestExpression::Kind::Not);
+  EXPECT_EQ(group.right_->left_->operator_, builtin::TestOperator::EmptyString);
+
+  auto regex = parse_pipeline("[[ $x =~ ^(a|b)$ ]]");
+  ASSERT_TRUE(regex.has_value()) << regex.error();
+  auto const& match = static_cast<TestExpression const&>(*regex.value()->commands_[0]);
+  EXPECT_EQ(match.operator_, builtin::TestOperator::Matches);
+  EXPECT_EQ(match.operands_[1]->text_, "^(a|b)$");
+
+  EXPECT_FALSE(parse_pipeline("[[ -f x").has_value());
+
+  // [ is an ordinary command that resolves to the builtin
+  auto bracket = parse_command("[ -f x ]");
+  ASSERT_TRUE(bracket.has_value());
+  EXPECT_EQ(bracket.value()->builtin_, builtin::find_builtin("["));
+}
+
+TEST_F(ParserTest, FunctionDefinitions) {
+  auto result = parse_input("greet() { echo hello $1; echo a,b; }\nfunction quiet { return 1; }; greet x");
+  ASSERT_TRUE(result.has_value()) << result.error();
+
+  auto compound = std::move(result.value());
+  ASSERT_EQ(compound->statements_.size(), 3);
+  ASSERT_EQ(compound->statements_[0]->type(), ASTNode::Type::FunctionDefinition);
+  auto const& greet = static_cast<FunctionDefinition const&>(*compound->statements_[0]);
+  EXPECT_EQ(greet.name_, "greet");
+  ASSERT_EQ(greet.body_->statements_.size(), 2);
+
+  ASSERT_EQ(compound->statements_[1]->type(), ASTNode::Type::FunctionDefinition);
+  auto const& quiet = static_cast<FunctionDefinition const&>(*compound->statements_[1]);
+  EXPECT_EQ(quiet.name_, "quiet");
+
+  // A copy shares the body instead of cloning it
+  auto copy = greet.clone();
+  EXPECT_EQ(static_cast<FunctionDefinition const&>(*copy).body_, greet.body_);
+
+  // Assignments after the command name are arguments
+  auto local = parse_command("local x=1 y");
+  ASSERT_TRUE(local.has_value());
+  EXPECT_EQ(local.value()->words_.size(), 3);
+  EXPECT_TRUE(local.value()->assignments_.empty());
+
+  EXPECT_FALSE(parse_input("broken() { echo never closed").has_value());
+  EXPECT_FALSE(parse_input("broken() echo").has_value());
+}
+
+TEST_F(ParserTest, TimedSubshellIsNotUnwrapped) {
+  auto result = parse_input("time (sleep 1)");
+  ASSERT_TRUE(result.has_value());
+
+  auto compound = std::move(result.value());
+  ASSERT_EQ(compound->statements_.size(), 1);
+  ASSERT_EQ(compound->statements_[0]->type(), ASTNode::Type::Pipeline);
+  EXPECT_TRUE(static_cast<Pipeline*>(compound->statements_[0].get())->timed_);
+}
+
 TEST_F(ParserTest, ErrorHandling) {
   // Test unclosed if statement
   auto result1 = parse_input("if test -f file; then echo hello");
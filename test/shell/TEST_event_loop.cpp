@@ -0,0 +1,70 @@
+#include <string>
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+import hsh.core;
+import hsh.job;
+import hsh.shell;
+
+namespace hsh::shell::test {
+
+class EventLoopTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    auto pipe = core::make_pipe();
+    ASSERT_TRUE(pipe.has_value());
+    read_end_  = std::move(pipe->first);
+    write_end_ = std::move(pipe->second);
+  }
+
+  void write_input(std::string const& data) {
+    ASSERT_TRUE(core::syscall::write_fd(write_end_.get(), data).has_value());
+  }
+
+  core::FileDescriptor read_end_;
+  core::FileDescriptor write_end_;
+};
+
+TEST_F(EventLoopTest, SplitsInputIntoLines) {
+  EventLoop loop(read_end_.get(), -1, false);
+
+  write_input("echo one\necho two\nunterminated");
+  write_end_.reset();
+
+  auto event = loop.next();
+  ASSERT_EQ(event.type_, Event::Type::Line);
+  EXPECT_EQ(event.line_, "echo one");
+
+  event = loop.next();
+  ASSERT_EQ(event.type_, Event::Type::Line);
+  EXPECT_EQ(event.line_, "echo two");
+
+  event = loop.next();
+  ASSERT_EQ(event.type_, Event::Type::Line);
+  EXPECT_EQ(event.line_, "unterminated");
+
+  EXPECT_EQ(loop.next().type_, Event::Type::EndOfInput);
+  EXPECT_EQ(loop.next().type_, Event::Type::EndOfInput);
+}
+
+TEST_F(EventLoopTest, ReportsJobsWithoutInput) {
+  job::JobManager job_manager;
+  EventLoop       loop(read_end_.get(), job_manager.event_fd(), false);
+
+  pid_t pid = fork();
+  ASSERT_NE(pid, -1);
+  if (pid == 0) {
+    _exit(3);
+  }
+  job_manager.add_job(pid, "exit 3");
+
+  // No input is ever written, the exit alone has to wake the loop up
+  EXPECT_EQ(loop.next().type_, Event::Type::JobChanged);
+
+  auto done = job_manager.check_background_jobs();
+  ASSERT_EQ(done.size(), 1);
+  EXPECT_EQ(done[0].exit_status(), 3);
+}
+
+} // namespace hsh::shell::test
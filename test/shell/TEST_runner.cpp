@@ -1,12 +1,22 @@
+#include <chrono>
+#include <csignal>
 #include <cstdio>
+#include <cstdlib>
 #include <fstream>
 #include <string>
 #include <string_view>
+#include <thread>
+#include <vector>
 
+#include <fcntl.h>
 #include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 import hsh.shell;
 import hsh.context;
+import hsh.expand;
 import hsh.job;
 
 namespace hsh::shell::test {
@@ -72,6 +82,12 @@ TEST_F(RunnerTest, NonExistentCommand) {
   EXPECT_FALSE(result.error_message_.empty());
 }
 
+TEST_F(RunnerTest, NonExistentCommandInPipeline) {
+  auto result = runner_->run("echo hello | nonexistent_command_xyz");
+  EXPECT_TRUE(result.success_);
+  EXPECT_EQ(result.exit_status_, 127);
+}
+
 TEST_F(RunnerTest, InvalidSyntax) {
   auto result = runner_->run("echo |");
   EXPECT_FALSE(result.success_);
@@ -299,4 +315,490 @@ TEST_F(RunnerTest, ErrorRedirection) {
   std::remove("/tmp/test_error.txt");
 }
 
+TEST_F(RunnerTest, ProcessSubstitutionInput) {
+  auto result = runner_->run("diff <(echo same) <(echo same)");
+  EXPECT_TRUE(result.success_);
+  EXPECT_EQ(result.exit_status_, 0);
+
+  result = runner_->run("diff <(echo left) <(echo right) > /dev/null");
+  EXPECT_TRUE(result.success_);
+  EXPECT_EQ(result.exit_status_, 1);
+
+  result = runner_->run("diff <(echo \")\") <(echo ')')");
+  EXPECT_EQ(result.exit_status_, 0);
+
+  // A substitution can also be the target of a redirection
+  EXPECT_EQ(runner_->run("grep -q piped < <(echo piped)").exit_status_, 0);
+  EXPECT_EQ(runner_->run("read line < <(echo redirected)").exit_status_, 0);
+  EXPECT_EQ(context_->get_variable("line"), "redirected");
+}
+
+TEST_F(RunnerTest, ScriptWithoutShebangRunsInAShell) {
+  {
+    std::ofstream script("/tmp/test_no_shebang.sh");
+    script << "echo \"$1\" > /tmp/test_no_shebang.txt\nexit 4\n";
+  }
+  chmod("/tmp/test_no_shebang.sh", 0755);
+
+  // Spawned as a command, and exec'd in place of a forked subshell
+  EXPECT_EQ(runner_->run("/tmp/test_no_shebang.sh spawned").exit_status_, 4);
+  EXPECT_EQ(runner_->run("(/tmp/test_no_shebang.sh replaced)").exit_status_, 4);
+
+  std::ifstream file("/tmp/test_no_shebang.txt");
+  std::string   line;
+  std::getline(file, line);
+  EXPECT_EQ(line, "replaced");
+
+  std::remove("/tmp/test_no_shebang.sh");
+  std::remove("/tmp/test_no_shebang.txt");
+}
+
+TEST_F(RunnerTest, ProcessSubstitutionOutput) {
+  auto result = runner_->run("cat <(echo substituted) > /tmp/test_procsub.txt");
+  EXPECT_TRUE(result.success_);
+  EXPECT_EQ(result.exit_status_, 0);
+
+  std::ifstream file("/tmp/test_procsub.txt");
+  EXPECT_TRUE(file.is_open());
+
+  std::string line;
+  EXPECT_TRUE(std::getline(file, line));
+  EXPECT_EQ(line, "substituted");
+  file.close();
+
+  std::remove("/tmp/test_procsub.txt");
+}
+
+TEST_F(RunnerTest, LongPipeline) {
+  auto result = runner_->run(
+      "echo long | cat | cat | cat | cat | cat | cat | cat | cat | cat | cat | cat > /tmp/test_long_pipeline.txt"
+  );
+  EXPECT_TRUE(result.success_);
+  EXPECT_EQ(result.exit_status_, 0);
+
+  std::ifstream file("/tmp/test_long_pipeline.txt");
+  EXPECT_TRUE(file.is_open());
+
+  std::string line;
+  EXPECT_TRUE(std::getline(file, line));
+  EXPECT_EQ(line, "long");
+  file.close();
+
+  std::remove("/tmp/test_long_pipeline.txt");
+}
+
+TEST_F(RunnerTest, PipelineStagesExpandTheirWordsOnce) {
+  // A spawned stage cannot change the shell any more than a forked one
+  ASSERT_TRUE(runner_->run("x=0; /bin/echo $((x=5)) | cat > /dev/null").success_);
+  EXPECT_EQ(context_->get_variable("x"), "0");
+
+  // The command word of a forked stage is only expanded in the child
+  std::remove("/tmp/test_stage_word.txt");
+  ASSERT_TRUE(runner_->run("$(echo once >> /tmp/test_stage_word.txt; echo true) | cat").success_);
+  std::ifstream file("/tmp/test_stage_word.txt");
+  std::string   line;
+  int           lines = 0;
+  while (std::getline(file, line)) {
+    ++lines;
+  }
+  EXPECT_EQ(lines, 1);
+  std::remove("/tmp/test_stage_word.txt");
+}
+
+TEST_F(RunnerTest, PipeStatusRecordsEveryStage) {
+  auto result = runner_->run("false | true | false | true");
+  EXPECT_TRUE(result.success_);
+  EXPECT_EQ(result.exit_status_, 0);
+
+  auto pipestatus = context_->get_array("PIPESTATUS");
+  ASSERT_TRUE(pipestatus.has_value());
+  ASSERT_EQ(pipestatus->size(), 4);
+  EXPECT_EQ((*pipestatus)[0], "1");
+  EXPECT_EQ((*pipestatus)[1], "0");
+  EXPECT_EQ((*pipestatus)[2], "1");
+  EXPECT_EQ((*pipestatus)[3], "0");
+  EXPECT_EQ(hsh::expand::expand_variables("${PIPESTATUS[2]} ${PIPESTATUS[@]}", *context_), "1 1 0 1 0");
+}
+
+TEST_F(RunnerTest, Pipefail) {
+  auto result = runner_->run("false | true");
+  EXPECT_EQ(result.exit_status_, 0);
+
+  result = runner_->run("set -o pipefail");
+  EXPECT_EQ(result.exit_status_, 0);
+
+  result = runner_->run("false | true");
+  EXPECT_TRUE(result.success_);
+  EXPECT_EQ(result.exit_status_, 1);
+
+  result = runner_->run("true | true");
+  EXPECT_EQ(result.exit_status_, 0);
+}
+
+TEST_F(RunnerTest, PipelineReportsSignaledStage) {
+  // yes is killed by SIGPIPE once head exits
+  auto result = runner_->run("yes | head -n 1 > /dev/null");
+  EXPECT_TRUE(result.success_);
+  EXPECT_EQ(result.exit_status_, 0);
+
+  auto pipestatus = context_->get_array("PIPESTATUS");
+  ASSERT_TRUE(pipestatus.has_value());
+  ASSERT_EQ(pipestatus->size(), 2);
+  EXPECT_EQ((*pipestatus)[0], std::to_string(128 + SIGPIPE));
+}
+
+TEST_F(RunnerTest, BackgroundJobsAreCollected) {
+  constexpr size_t job_count = 32;
+  for (size_t i = 0; i < job_count; ++i) {
+    auto result = runner_->run("true &");
+    ASSERT_TRUE(result.success_);
+  }
+  ASSERT_EQ(job_manager_->get_jobs().size(), job_count);
+
+  size_t completed = 0;
+  auto   deadline  = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (completed < job_count && std::chrono::steady_clock::now() < deadline) {
+    completed += job_manager_->check_background_jobs().size();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  EXPECT_EQ(completed, job_count);
+  EXPECT_TRUE(job_manager_->get_jobs().empty());
+}
+
+TEST_F(RunnerTest, StoppedPipelineBecomesAJob) {
+  // kill stops its own process group, which is the whole pipeline
+  auto result = runner_->run("sleep 5 | kill -STOP 0");
+  EXPECT_TRUE(result.success_);
+  EXPECT_EQ(result.exit_status_, 148);
+
+  auto jobs = job_manager_->get_jobs();
+  ASSERT_EQ(jobs.size(), 1);
+  EXPECT_EQ(jobs[0]->status_, hsh::job::JobStatus::Stopped);
+
+  ASSERT_EQ(kill(-jobs[0]->pgid_, SIGKILL), 0);
+  EXPECT_EQ(runner_->run("wait %1").exit_status_, 128 + SIGKILL);
+}
+
+TEST_F(RunnerTest, StoppedCommandBecomesAJob) {
+  auto result = runner_->run("sh -c 'kill -STOP $$'");
+  EXPECT_TRUE(result.success_);
+  EXPECT_EQ(result.exit_status_, 148);
+
+  auto jobs = job_manager_->get_jobs();
+  ASSERT_EQ(jobs.size(), 1);
+  EXPECT_EQ(jobs[0]->status_, hsh::job::JobStatus::Stopped);
+
+  ASSERT_EQ(kill(jobs[0]->pgid_, SIGKILL), 0);
+  EXPECT_EQ(runner_->run("wait %1").exit_status_, 128 + SIGKILL);
+}
+
+TEST_F(RunnerTest, StoppedBackgroundJobIsMarked) {
+  ASSERT_TRUE(runner_->run("sleep 5 &").success_);
+  auto jobs = job_manager_->get_jobs();
+  ASSERT_EQ(jobs.size(), 1);
+  pid_t pid = jobs[0]->pgid_;
+
+  // A stop never makes the pidfd readable, the waitid sweep has to see it
+  ASSERT_EQ(kill(pid, SIGSTOP), 0);
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (job_manager_->get_jobs()[0]->status_ != hsh::job::JobStatus::Stopped &&
+         std::chrono::steady_clock::now() < deadline) {
+    job_manager_->check_background_jobs();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(job_manager_->get_jobs()[0]->status_, hsh::job::JobStatus::Stopped);
+
+  ASSERT_EQ(kill(pid, SIGKILL), 0);
+  deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (!job_manager_->get_jobs().empty() && std::chrono::steady_clock::now() < deadline) {
+    job_manager_->check_background_jobs();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_TRUE(job_manager_->get_jobs().empty());
+}
+
+TEST_F(RunnerTest, WaitForBackgroundJobs) {
+  ASSERT_TRUE(runner_->run("false &").success_);
+  EXPECT_EQ(runner_->run("wait $!").exit_status_, 1);
+  EXPECT_TRUE(job_manager_->get_jobs().empty());
+
+  // -n returns with the first job to finish and leaves the other one running
+  runner_->run("sleep 0.3 &");
+  runner_->run("sleep 0 | false &");
+  EXPECT_EQ(runner_->run("wait -n").exit_status_, 1);
+  ASSERT_EQ(job_manager_->get_jobs().size(), 1);
+  EXPECT_EQ(runner_->run("wait %1").exit_status_, 0);
+  EXPECT_TRUE(job_manager_->get_jobs().empty());
+
+  // A plain wait joins everything
+  for (int i = 0; i < 4; ++i) {
+    runner_->run("sleep 0 &");
+  }
+  EXPECT_EQ(runner_->run("wait").exit_status_, 0);
+  EXPECT_TRUE(job_manager_->get_jobs().empty());
+
+  EXPECT_EQ(runner_->run("wait -n").exit_status_, 127);
+  EXPECT_EQ(runner_->run("wait %3").exit_status_, 127);
+  EXPECT_EQ(runner_->run("wait 1").exit_status_, 127);
+
+  // A job reported at the prompt keeps its status for one wait on $!
+  ASSERT_TRUE(runner_->run("sh -c 'exit 3' &").success_);
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (!job_manager_->get_jobs().empty() && std::chrono::steady_clock::now() < deadline) {
+    job_manager_->check_background_jobs();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_TRUE(job_manager_->get_jobs().empty());
+  EXPECT_EQ(runner_->run("wait $!").exit_status_, 3);
+  EXPECT_EQ(runner_->run("wait $!").exit_status_, 127);
+}
+
+TEST_F(RunnerTest, AssignmentsOnlyApplyToTheCommand) {
+  auto result = runner_->run("HSH_OVERLAY=scoped printenv HSH_OVERLAY > /tmp/test_env_overlay.txt");
+  EXPECT_TRUE(result.success_);
+  EXPECT_EQ(result.exit_status_, 0);
+
+  std::string   line;
+  std::ifstream overlay("/tmp/test_env_overlay.txt");
+  EXPECT_TRUE(std::getline(overlay, line));
+  EXPECT_EQ(line, "scoped");
+  EXPECT_FALSE(context_->get_variable("HSH_OVERLAY").has_value());
+
+  // Exports reach children without touching the shell's own libc environment
+  runner_->run("export HSH_EXPORTED=visible");
+  result = runner_->run("printenv HSH_EXPORTED > /tmp/test_env_export.txt");
+  EXPECT_EQ(result.exit_status_, 0);
+
+  std::ifstream exported("/tmp/test_env_export.txt");
+  EXPECT_TRUE(std::getline(exported, line));
+  EXPECT_EQ(line, "visible");
+  EXPECT_EQ(std::getenv("HSH_EXPORTED"), nullptr);
+
+  context_->unset_variable("HSH_EXPORTED");
+  result = runner_->run("printenv HSH_EXPORTED");
+  EXPECT_EQ(result.exit_status_, 1);
+
+  std::remove("/tmp/test_env_overlay.txt");
+  std::remove("/tmp/test_env_export.txt");
+}
+
+TEST_F(RunnerTest, QuotedAtSplicesPositionalParameters) {
+  context_->set_positional_parameters({"sh", "-c", "exit 3"});
+  auto result = runner_->run("\"$@\"");
+  EXPECT_EQ(result.exit_status_, 3);
+
+  context_->set_positional_parameters({"one two", "three"});
+  context_->set_variable("SEEN", "");
+  result = runner_->run("for arg in \"$@\"; do SEEN=$SEEN/$arg; done");
+  EXPECT_TRUE(result.success_);
+  EXPECT_EQ(context_->get_variable("SEEN"), "/one two/three");
+
+  context_->set_positional_parameters({});
+  result = runner_->run("for arg in \"$@\"; do SEEN=unexpected; done");
+  EXPECT_EQ(context_->get_variable("SEEN"), "/one two/three");
+
+  // Without positional parameters there is no command to run
+  result = runner_->run("false; \"$@\"");
+  EXPECT_TRUE(result.success_);
+  EXPECT_EQ(result.exit_status_, 0);
+}
+
+TEST_F(RunnerTest, WhileReadLoopOverRedirectedFile) {
+  {
+    std::ofstream file("/tmp/test_read_loop.txt");
+    file << "one two three\n  x\\ y  z \nlast";
+  }
+
+  context_->set_variable("SEEN", "");
+  auto result = runner_->run("while read a b; do SEEN=$SEEN/$a:$b; done < /tmp/test_read_loop.txt");
+  EXPECT_TRUE(result.success_);
+  EXPECT_EQ(context_->get_variable("SEEN"), "/one:two three/x y:z");
+  // The unterminated last line is still assigned, but ends the loop
+  EXPECT_EQ(context_->get_variable("a"), "last");
+
+  std::remove("/tmp/test_read_loop.txt");
+}
+
+TEST_F(RunnerTest, ConditionalExpression) {
+  context_->set_variable("NAME", "release-1.24");
+  context_->set_variable("EMPTY", "");
+
+  EXPECT_EQ(runner_->run("[[ $NAME == release-* && -z $EMPTY ]]").exit_status_, 0);
+  EXPECT_EQ(runner_->run("[[ $NAME == 'release-*' ]]").exit_status_, 1);
+  // The right operands would fail with status 2 or set BASH_REMATCH if they were evaluated
+  EXPECT_EQ(runner_->run("[[ -d / || $NAME =~ ^(r) ]]").exit_status_, 0);
+  EXPECT_FALSE(context_->get_array("BASH_REMATCH").has_value());
+  EXPECT_EQ(runner_->run("[[ -z $NAME && $NAME =~ a[ ]]").exit_status_, 1);
+  EXPECT_EQ(runner_->run("[[ ! -e /nonexistent/path ]]").exit_status_, 0);
+
+  auto result = runner_->run("[[ $NAME =~ ^([a-z]+)-([0-9]+)\\.([0-9]+)$ ]]");
+  EXPECT_EQ(result.exit_status_, 0);
+  auto groups = context_->get_array("BASH_REMATCH");
+  ASSERT_TRUE(groups.has_value());
+  EXPECT_EQ(
+      std::vector<std::string>(groups->begin(), groups->end()),
+      (std::vector<std::string>{"release-1.24", "release", "1", "24"})
+  );
+
+  EXPECT_EQ(runner_->run("[[ $NAME =~ a[ ]]").exit_status_, 2);
+
+  // Quoted parts of the pattern match literally, the rest stays a regular expression
+  EXPECT_EQ(runner_->run("[[ $NAME =~ ^release-\"1.\"[0-9]+$ ]]").exit_status_, 0);
+  EXPECT_EQ(runner_->run("[[ release-1x24 =~ ^release-'1.'[0-9]+$ ]]").exit_status_, 1);
+  EXPECT_EQ(runner_->run("[[ 'a.b' =~ \"a.b\" ]]").exit_status_, 0);
+  EXPECT_EQ(runner_->run("[[ axb =~ \"a.b\" ]]").exit_status_, 1);
+  EXPECT_EQ(runner_->run("if [ -d / ]; then MARK=dir; fi").exit_status_, 0);
+  EXPECT_EQ(context_->get_variable("MARK"), "dir");
+}
+
+TEST_F(RunnerTest, BufferedBuiltinOutputKeepsItsOrder) {
+  auto result = runner_->run("for i in a b; do echo $i; pwd; /bin/echo external; done > /tmp/test_buffered_output.txt");
+  EXPECT_TRUE(result.success_);
+  EXPECT_EQ(result.exit_status_, 0);
+
+  std::ifstream            file("/tmp/test_buffered_output.txt");
+  std::vector<std::string> lines;
+  for (std::string line; std::getline(file, line);) {
+    lines.push_back(line);
+  }
+  auto cwd = std::string{context_->get_cwd()};
+  EXPECT_EQ(lines, (std::vector<std::string>{"a", cwd, "external", "b", cwd, "external"}));
+
+  std::remove("/tmp/test_buffered_output.txt");
+}
+
+TEST_F(RunnerTest, Functions) {
+  context_->set_variable("KEPT", "outer");
+  context_->set_positional_parameters({"top"});
+
+  EXPECT_EQ(runner_->run("set_both() { local KEPT=inner; SEEN=$KEPT:$1:$#; CHANGED=yes; }").exit_status_, 0);
+  EXPECT_EQ(runner_->run("set_both one two").exit_status_, 0);
+  EXPECT_EQ(context_->get_variable("SEEN"), "inner:one:2");
+  EXPECT_EQ(context_->get_variable("CHANGED"), "yes");
+  EXPECT_EQ(context_->get_variable("KEPT"), "outer");
+  EXPECT_EQ(context_->get_positional_parameter(1), "top");
+
+  // return leaves the function at once, also from inside a loop
+  runner_->run("function first { for i in a b c; do if [ $i = $1 ]; then return 7; fi; done; REACHED=yes; }");
+  EXPECT_EQ(runner_->run("first b").exit_status_, 7);
+  EXPECT_FALSE(context_->get_variable("REACHED").has_value());
+  EXPECT_EQ(runner_->run("first z").exit_status_, 0);
+  EXPECT_EQ(context_->get_variable("REACHED"), "yes");
+
+  // Recursion, each call with its own locals
+  runner_->run("count() { local n=$1; if [ $n -gt 0 ]; then count $(($n - 1)); fi; DEPTH=$DEPTH$n; }");
+  EXPECT_EQ(runner_->run("count 3").exit_status_, 0);
+  EXPECT_EQ(context_->get_variable("DEPTH"), "0123");
+
+  // Functions run in pipelines like builtins
+  EXPECT_EQ(runner_->run("first b | cat").exit_status_, 0);
+
+  // Assignments in front of a call are exported for the call only
+  runner_->run("child_sees() { sh -c 'test \"$PREFIXED\" = call'; }");
+  EXPECT_EQ(runner_->run("PREFIXED=call child_sees").exit_status_, 0);
+  EXPECT_FALSE(context_->get_variable("PREFIXED").has_value());
+  EXPECT_FALSE(context_->is_exported("PREFIXED"));
+  EXPECT_EQ(runner_->run("child_sees").exit_status_, 1);
+
+  // Runaway recursion is stopped before the stack runs out
+  runner_->run("forever() { forever; }");
+  EXPECT_EQ(runner_->run("forever").exit_status_, 1);
+
+  EXPECT_EQ(runner_->run("return 1").exit_status_, 2);
+  EXPECT_EQ(runner_->run("local x").exit_status_, 1);
+}
+
+TEST_F(RunnerTest, TimedPipeline) {
+  auto result = runner_->run("time echo timed | cat > /dev/null");
+  EXPECT_TRUE(result.success_);
+  EXPECT_EQ(result.exit_status_, 0);
+
+  result = runner_->run("time false");
+  EXPECT_TRUE(result.success_);
+  EXPECT_EQ(result.exit_status_, 1);
+
+  result = runner_->run("time");
+  EXPECT_TRUE(result.success_);
+  EXPECT_EQ(result.exit_status_, 0);
+}
+
+TEST_F(RunnerTest, BackgroundPipelineReturnsImmediately) {
+  auto start   = std::chrono::steady_clock::now();
+  auto result  = runner_->run("sleep 5 | sleep 5 &");
+  auto elapsed = std::chrono::steady_clock::now() - start;
+
+  EXPECT_TRUE(result.success_);
+  EXPECT_EQ(result.exit_status_, 0);
+  EXPECT_LT(elapsed, std::chrono::seconds(2));
+
+  auto jobs = job_manager_->get_jobs();
+  ASSERT_EQ(jobs.size(), 1);
+  ASSERT_EQ(jobs[0]->processes_.size(), 2);
+  EXPECT_EQ(jobs[0]->pgid_, jobs[0]->processes_.front().pid_);
+  EXPECT_EQ(context_->get_last_background_pid(), jobs[0]->processes_.back().pid_);
+  EXPECT_EQ(job_manager_->find_job(jobs[0]->processes_.back().pid_), jobs[0]);
+
+  // Clean up the whole process group
+  auto processes = jobs[0]->processes_;
+  kill(-jobs[0]->pgid_, SIGKILL);
+  for (auto const& process : processes) {
+    waitpid(process.pid_, nullptr, 0);
+  }
+}
+
+TEST_F(RunnerTest, ForegroundBackgroundPipeline) {
+  auto result = runner_->run("sleep 0 | false &");
+  ASSERT_TRUE(result.success_);
+  ASSERT_EQ(job_manager_->get_jobs().size(), 1);
+
+  result = runner_->run("fg %1");
+  EXPECT_TRUE(result.success_);
+  EXPECT_EQ(result.exit_status_, 1);
+  EXPECT_TRUE(job_manager_->get_jobs().empty());
+}
+
+TEST_F(RunnerTest, LastCommandReplacesTheShell) {
+  // The child stands in for `hsh -c`, readlink reports the pid it runs as
+  for (std::string_view command :
+       {"/bin/readlink /proc/self > /tmp/test_exec_tail.txt",
+        "/bin/echo x | /bin/readlink /proc/self > /tmp/test_exec_tail.txt"}) {
+    pid_t pid = fork();
+    ASSERT_NE(pid, -1);
+    if (pid == 0) {
+      std::_Exit(100 + runner_->run(command, true).exit_status_);
+    }
+
+    int status = 0;
+    ASSERT_EQ(waitpid(pid, &status, 0), pid);
+    EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0) << command;
+
+    std::ifstream file("/tmp/test_exec_tail.txt");
+    std::string   line;
+    std::getline(file, line);
+    EXPECT_EQ(line, std::to_string(pid)) << command;
+  }
+  std::remove("/tmp/test_exec_tail.txt");
+}
+
+TEST_F(RunnerTest, ExecKeepsRedirections) {
+  EXPECT_EQ(runner_->run("exec 9> /tmp/test_exec_fd.txt").exit_status_, 0);
+  ASSERT_NE(fcntl(9, F_GETFD), -1);
+  EXPECT_EQ(write(9, "kept\n", 5), 5);
+  // Commands run from a forked pipeline stage inherit it as well
+  EXPECT_EQ(runner_->run("(sh -c 'echo piped >&9') | cat").exit_status_, 0);
+  close(9);
+
+  std::ifstream file("/tmp/test_exec_fd.txt");
+  std::string   line;
+  std::getline(file, line);
+  EXPECT_EQ(line, "kept");
+  std::getline(file, line);
+  EXPECT_EQ(line, "piped");
+  std::remove("/tmp/test_exec_fd.txt");
+
+  // A command that cannot be run leaves the shell in place
+  EXPECT_EQ(runner_->run("exec /nonexistent/command").exit_status_, 127);
+}
+
 } // namespace hsh::shell::test